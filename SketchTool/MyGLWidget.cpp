@@ -159,6 +159,12 @@ void MyGLWidget::paintGL()
     {
         drawExistingLine(&painter, line);
     }
+    painter.end();
+
+    //the paint engine leaves its own program, VAO and textures bound, and
+    //turns the depth test off
+    gl->invalidateBindings();
+    gl->invalidateCapability(GL_DEPTH_TEST);
 }
 
 
@@ -1538,7 +1544,7 @@ void MyGLWidget::adjustCameraToSelectedNode()
         //Transform origin by modelview to get position of center of object
         //in world space
         glm::vec4 origin = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-        glm::mat4 modelview = object->getModelviewForDrawing();
+        glm::mat4 modelview = scenegraph->getModelviewForDrawing(object);
         glm::vec4 obj_world_pos = modelview * origin;
 
         //Translate this position slightly away from object
@@ -85,7 +85,12 @@ void OpenGLWindow::paintGL()
     painter.setFont(QFont("Sans", 12));
     QStaticText text(QString("Frame rate: %1 fps").arg(framerate));
     painter.drawStaticText(5, 20, text);
+    painter.end();
 
+    //the paint engine leaves its own program, VAO and textures bound, and
+    //turns the depth test off
+    gl->invalidateBindings();
+    gl->invalidateCapability(GL_DEPTH_TEST);
 }
 
 
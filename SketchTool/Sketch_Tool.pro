@@ -37,10 +37,13 @@ HEADERS  += mainwindow.h \
     MyGLWidget.h \
     sgraph/AbstractNode.h \
     sgraph/GroupNode.h \
+    sgraph/InstanceNode.h \
     sgraph/INode.h \
     sgraph/LeafNode.h \
     sgraph/Scenegraph.h \
     sgraph/TransformNode.h \
+    sgraph/FlatScenegraph.h \
+    sgraph/NodeIndex.h \
     ui_mainwindow.h \
     customdialog.h \
     console_input.h \
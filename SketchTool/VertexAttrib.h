@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include "IVertexData.h"
+#include "VertexLayout.h"
 
 
 
@@ -18,6 +19,15 @@ class VertexAttrib:public util::IVertexData
 
 
 public:
+    /**
+     * @brief Layout
+     * The attributes of this vertex, in the order returned by
+     * getAllAttributes(). PolygonMesh stores its vertices in this layout.
+     */
+    typedef util::VertexLayout<util::PositionAttribute,
+                               util::NormalAttribute,
+                               util::TexcoordAttribute> Layout;
+
     VertexAttrib()
     {
         position = glm::vec4(0,0,0,1);
@@ -69,7 +79,6 @@ public:
     vector<float> getData(string attribName) throw(runtime_error)
     {
         vector<float> result;
-        stringstream message;
 
 
         if (attribName == "position")
@@ -95,6 +104,7 @@ public:
         }
         else
         {
+            stringstream message;
             message << "No attribute: " << attribName << " found!";
             throw runtime_error(message.str());
         }
@@ -115,8 +125,8 @@ public:
      */
     void setData(string attribName, const vector<float>& data) throw(runtime_error)
     {
-        stringstream message;
-
+        //only build an error message when there is an error: constructing a
+        //stringstream is far more expensive than setting the data
         if (attribName == "position")
         {
             position = glm::vec4(0,0,0,1);
@@ -127,8 +137,7 @@ public:
             case 1: position.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: " + attribName);
             }
         }
         else if (attribName == "normal")
@@ -141,8 +150,7 @@ public:
             case 1: normal.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: " + attribName);
             }
         }
         else if (attribName == "texcoord")
@@ -155,14 +163,12 @@ public:
             case 1: texcoord.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: " + attribName);
             }
         }
         else
         {
-            message << "Attribute: " << attribName << " unsupported!";
-            throw runtime_error(message.str());
+            throw runtime_error("Attribute: " + attribName + " unsupported!");
         }
     }
 
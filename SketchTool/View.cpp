@@ -101,6 +101,7 @@ void View::draw(util::OpenGLFunctions& gl)
                         1,
                         false,
                         glm::value_ptr(proj));
+  renderer.setProjection(proj,WINDOW_HEIGHT);
 
   //gl.glPolygonMode(GL.GL_FRONT_AND_BACK,GL3.GL_LINE); //OUTLINES
 
@@ -180,8 +181,8 @@ void View::initScenegraph(util::OpenGLFunctions &gl, const string& filename) thr
     delete scenegraph;
 
   program.enable(gl);
-  sgraph::ScenegraphInfo<VertexAttrib> sinfo;
-  sinfo = sgraph::SceneXMLReader::importScenegraph<VertexAttrib>(filename);
+  sgraph::ScenegraphInfo<VertexAttrib> sinfo =
+      sgraph::SceneXMLReader::importScenegraph<VertexAttrib>(filename);
   scenegraph = sinfo.scenegraph;
 
   renderer.setContext(&gl);
@@ -190,13 +191,7 @@ void View::initScenegraph(util::OpenGLFunctions &gl, const string& filename) thr
   shaderVarsToVertexAttribs["vNormal"] = "normal";
   shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
   renderer.initShaderProgram(program,shaderVarsToVertexAttribs);
-  scenegraph->setRenderer<VertexAttrib>(&renderer,sinfo.meshes);
-
-  //Get all names of nodes
-  for(auto entry : scenegraph->getNodes())
-  {
-      scenegraph->addNodeName(entry.first);
-  }
+  scenegraph->setRenderer<VertexAttrib>(&renderer,std::move(sinfo.meshes));
 
   program.disable(gl);
 
@@ -220,11 +215,6 @@ void View::addToScenegraph(string shape, vector<float> shape_params)
     string transform_node_name = "transform_" + to_string(transform_node_count);
     string leaf_node_name = "leaf_" + to_string(leaf_node_count);
 
-    //Add these new names to the node_names member of the scenegraph
-    scenegraph->addNodeName(group_node_name);
-    scenegraph->addNodeName(transform_node_name);
-    scenegraph->addNodeName(leaf_node_name);
-
     //Start by creating a new group node
     sgraph::INode* group_node = new sgraph::GroupNode(scenegraph, group_node_name);
     //Make group node child of root to start
@@ -478,7 +468,7 @@ void View::saveTextures(fstream& output_file)
 void View::saveLights(fstream& output_file)
 {
     //Grab lights from scenegraph renderer
-    vector<util::Light> lights = scenegraph->getRendererLights();
+    const vector<util::Light>& lights = scenegraph->getRendererLights();
     glm::vec3 ambient;
     glm::vec3 diffuse;
     glm::vec3 specular;
@@ -487,7 +477,7 @@ void View::saveLights(fstream& output_file)
     glm::vec4 spotdirection;
 
     //Iterate through lights, grab properties and insert into output file
-    for(auto light : lights)
+    for(const util::Light& light : lights)
     {
         //Set light properties
         ambient = light.getAmbient();
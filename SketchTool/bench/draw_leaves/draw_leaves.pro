@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Benchmark of the CPU time that drawing a frame
+# takes per leaf. It draws a scenegraph of 10000
+# leaves of one mesh. Run it from the SketchTool
+# directory:
+#
+#   draw_leaves [groups [leaves-per-group]]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = draw_leaves
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
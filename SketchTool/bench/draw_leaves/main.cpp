@@ -0,0 +1,158 @@
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "OpenGLFunctions.h"
+#include "ShaderProgram.h"
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "sgraph/GLScenegraphRenderer.h"
+#include "sgraph/Scenegraph.h"
+#include "sgraph/GroupNode.h"
+#include "sgraph/TransformNode.h"
+#include "sgraph/LeafNode.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <map>
+#include <stack>
+using namespace std;
+
+/*
+ * Times the CPU side of drawing a frame of a scenegraph of groups x leaves
+ * (100 x 100 by default) leaves of models/sphere.obj, each with a transform
+ * of its own and one of five materials, in an offscreen OpenGL 3.3 context.
+ * The frame is drawn from the flat form of the scenegraph
+ * (Scenegraph::draw), with the camera still and moving. Every time is the best of 50 frames, and is up to
+ * the last GL call being made, not to the GPU finishing the frame.
+ */
+int main(int argc, char *argv[])
+{
+    QGuiApplication a(argc, argv);
+    int groups = 100,leaves = 100;
+
+    if (argc>1)
+        groups = atoi(argv[1]);
+    if (argc>2)
+        leaves = atoi(argv[2]);
+
+    QSurfaceFormat format;
+    format.setVersion(3,3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if (!context.create() || !context.makeCurrent(&surface))
+    {
+        printf("Cannot make an OpenGL 3.3 context\n");
+        return 1;
+    }
+
+    util::OpenGLFunctions gl;
+    util::ShaderProgram program;
+    sgraph::GLScenegraphRenderer renderer;
+    sgraph::Scenegraph scenegraph;
+
+    try
+    {
+        //the same as View::init and View::initScenegraph
+        program.createProgram(gl,
+                              string("shaders/phong-multiple.vert"),
+                              string("shaders/phong-multiple.frag"));
+        program.enable(gl);
+        renderer.setContext(&gl);
+        map<string,string> shaderVarsToVertexAttribs;
+        shaderVarsToVertexAttribs["vPosition"] = "position";
+        shaderVarsToVertexAttribs["vNormal"] = "normal";
+        shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
+        renderer.initShaderProgram(program,shaderVarsToVertexAttribs);
+
+        util::ObjImportOptions options;
+        options.indexed = true;
+        map<string,util::PolygonMesh<VertexAttrib> > meshes;
+        meshes["sphere"] = util::ObjImporter<VertexAttrib>::importFile("models/sphere.obj",options);
+
+        //a grid of groups in front of the camera, each a grid of small spheres
+        sgraph::GroupNode *root = new sgraph::GroupNode(&scenegraph,"root");
+        for (int g=0;g<groups;g++)
+        {
+            sgraph::TransformNode *t = new sgraph::TransformNode(&scenegraph,"");
+            sgraph::GroupNode *group = new sgraph::GroupNode(&scenegraph,"");
+
+            t->setTransform(glm::translate(glm::mat4(1.0f),
+                                           glm::vec3(3.0f*(g%10-5),3.0f*(g/10-5),-30.0f)));
+            for (int l=0;l<leaves;l++)
+            {
+                sgraph::TransformNode *lt = new sgraph::TransformNode(&scenegraph,"");
+                sgraph::LeafNode *leaf = new sgraph::LeafNode("sphere",&scenegraph,"");
+                util::Material material;
+
+                lt->setTransform(glm::scale(glm::translate(glm::mat4(1.0f),
+                                                           glm::vec3(0.1f*(l%10),0.1f*(l/10),0.0f)),
+                                            glm::vec3(0.05f)));
+                material.setShininess((float)(l%5));
+                leaf->setMaterial(material);
+                lt->addChild(leaf);
+                group->addChild(lt);
+            }
+            t->addChild(group);
+            root->addChild(t);
+        }
+        scenegraph.makeScenegraph(root);
+        scenegraph.setRenderer<VertexAttrib>(&renderer,std::move(meshes));
+        renderer.setProjection(glm::perspective(glm::radians(60.0f),1.0f,0.1f,1000.0f),800);
+
+        printf("%d leaves\n",groups*leaves);
+        printf("%-8s %10s %10s\n","camera","ms","ns/leaf");
+        for (int moving=0;moving<2;moving++)
+        {
+            stack<glm::mat4> modelView;
+            double best = 1e30;
+
+            modelView.push(glm::lookAt(glm::vec3(0,0,5),glm::vec3(0,0,-30),glm::vec3(0,1,0)));
+            for (int frame=0;frame<50;frame++)
+            {
+                if (moving)
+                    modelView.top() = glm::lookAt(glm::vec3(0.01f*frame,0,5),
+                                                  glm::vec3(0,0,-30),
+                                                  glm::vec3(0,1,0));
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                scenegraph.draw(modelView);
+                double ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+
+                if (ms<best)
+                    best = ms;
+            }
+            printf("%-8s %10.3f %10.1f\n",
+                   moving?"moving":"still",
+                   best,
+                   best*1e6/(groups*leaves));
+        }
+        gl.glFinish();
+        program.disable(gl);
+    }
+    catch (string e)
+    {
+        printf("failed: %s\n",e.c_str());
+        return 1;
+    }
+    catch (runtime_error e)
+    {
+        printf("failed: %s\n",e.what());
+        return 1;
+    }
+
+    scenegraph.dispose();
+    renderer.dispose();
+    context.doneCurrent();
+    return 0;
+}
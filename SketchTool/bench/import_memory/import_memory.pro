@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Benchmark of the peak memory of the OBJ
+# importers. It imports one file with one importer
+# per run, so that each run has a peak of its own,
+# and can write a large grid to import. Run it from
+# the SketchTool directory:
+#
+#   import_memory generate file [size]
+#   import_memory stream|mapped|indexed|streamFile [file]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = import_memory
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
+
+win32: LIBS += -lpsapi
@@ -0,0 +1,179 @@
+#include <QCoreApplication>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+using namespace std;
+
+/*
+ * The most memory this process has had resident so far, in bytes
+ */
+static double peakResident()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters));
+    return (double)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+    return (double)usage.ru_maxrss;
+#else
+    return usage.ru_maxrss*1024.0;
+#endif
+#endif
+}
+
+/*
+ * Writes a size x size grid of vertices, each with its own texture
+ * coordinate and normal, made of (size-1) x (size-1) quads. The heights
+ * vary so that the file is not all the same digits
+ */
+static bool generate(const string& path,int size)
+{
+    ofstream out(path.c_str());
+
+    if (!out)
+        return false;
+    for (int x=0;x<size;x++)
+    {
+        for (int y=0;y<size;y++)
+        {
+            float z = 0.005f+0.005f*sin(0.37f*x+0.11f*y);
+            out << "v " << 0.001f*x << " " << 0.001f*y << " " << z << "\n";
+        }
+    }
+    for (int x=0;x<size;x++)
+    {
+        for (int y=0;y<size;y++)
+            out << "vt " << 0.001f*x << " " << 0.001f*y << "\n";
+    }
+    for (int i=0;i<size*size;i++)
+        out << "vn 0 0 1\n";
+    for (int x=0;x+1<size;x++)
+    {
+        for (int y=0;y+1<size;y++)
+        {
+            int a = x*size+y+1,b = a+1,c = a+size+1,d = a+size;
+            out << "f " << a << "/" << a << "/" << a << " "
+                << b << "/" << b << "/" << b << " "
+                << c << "/" << c << "/" << c << " "
+                << d << "/" << d << "/" << d << "\n";
+        }
+    }
+    return (bool)out;
+}
+
+/*
+ * Imports one OBJ file with one of the importers and prints the peak resident
+ * memory of the process, the time taken and the size of the mesh made:
+ *
+ *   stream      importFile(ifstream&,false), which reads the file a line at a
+ *               time into intermediate arrays
+ *   mapped      importFile(filename,false), which maps the file as a whole
+ *   indexed     importFile(filename,options) with options.indexed
+ *   streamFile  streamFile(filename,false,mesh), which reads the file twice
+ *               through a fixed buffer and writes the mesh in place
+ *
+ * Only one importer is run per process, so that the peak is its own. With
+ * "generate", it writes a grid of size x size vertices (1000 by default,
+ * 137MB) to import instead.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    if (argc<2)
+    {
+        printf("usage: import_memory generate file [size]\n"
+               "       import_memory stream|mapped|indexed|streamFile [file]\n");
+        return 1;
+    }
+
+    string importer = argv[1];
+
+    if (importer=="generate")
+    {
+        if (argc<3)
+        {
+            printf("No file to generate\n");
+            return 1;
+        }
+        int size = (argc>3)?atoi(argv[3]):1000;
+        if (!generate(argv[2],size))
+        {
+            printf("Cannot write %s\n",argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    string path = (argc>2)?argv[2]:"models/thomas-lyons-object.obj";
+    util::PolygonMesh<VertexAttrib> mesh;
+    double before = peakResident();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    try
+    {
+        if (importer=="stream")
+        {
+            ifstream in(path.c_str());
+            if (!in)
+                throw string("Cannot open "+path);
+            mesh = util::ObjImporter<VertexAttrib>::importFile(in,false);
+        }
+        else if (importer=="mapped")
+            mesh = util::ObjImporter<VertexAttrib>::importFile(path,false);
+        else if (importer=="indexed")
+        {
+            util::ObjImportOptions options;
+            options.indexed = true;
+            mesh = util::ObjImporter<VertexAttrib>::importFile(path,options);
+        }
+        else if (importer=="streamFile")
+            util::ObjImporter<VertexAttrib>::streamFile(path,false,mesh);
+        else
+        {
+            printf("No importer called %s\n",importer.c_str());
+            return 1;
+        }
+    }
+    catch (string e)
+    {
+        printf("failed   %s: %s\n",path.c_str(),e.c_str());
+        return 1;
+    }
+
+    double ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    typedef VertexAttrib::Layout Layout;
+    double meshBytes = (double)mesh.getPrimitiveCount()*sizeof(unsigned int);
+
+    for (int i=0;i<Layout::attributeCount;i++)
+        meshBytes += (double)mesh.getVertexCount()*Layout::components(i)*sizeof(float);
+
+    printf("%-12s %s\n",importer.c_str(),path.c_str());
+    printf("peak resident  %8.1f MB (%.1f MB before importing)\n",
+           peakResident()/1048576.0,before/1048576.0);
+    printf("time           %8.1f ms\n",ms);
+    printf("mesh           %8.1f MB, %d vertices, %d indices\n",
+           meshBytes/1048576.0,mesh.getVertexCount(),mesh.getPrimitiveCount());
+    return 0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Benchmark of the multi-threaded OBJ import. It
+# times ObjImporter::importFile with 1 to N threads
+# on every OBJ model. Run it from the SketchTool
+# directory:
+#
+#   import_threads [max-threads [models-directory]]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = import_threads
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
@@ -0,0 +1,96 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "Parallel.h"
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+using namespace std;
+
+/*
+ * Times ObjImporter::importFile(filename,scaleAndCenter,numThreads) with 1 to
+ * max-threads threads (one per core by default, at least 4) on every OBJ file
+ * in the given directory (models/ by default). Every time is the best of at
+ * least 5 runs and of 200ms of runs, so that the file is in the page cache
+ * and small files are timed often enough. Files of less than
+ * 256KB per thread are parsed by fewer threads than asked for, so the number
+ * actually used is printed too.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    unsigned int maxThreads = thread::hardware_concurrency();
+    string directory = "models";
+
+    if (maxThreads<4)
+        maxThreads = 4;
+    if (argc>1)
+        maxThreads = (unsigned int)atoi(argv[1]);
+    if (argc>2)
+        directory = argv[2];
+
+    QDir dir(QString::fromStdString(directory));
+    if (!dir.exists())
+    {
+        printf("No such directory: %s\n",directory.c_str());
+        return 1;
+    }
+
+    printf("%u cores\n",thread::hardware_concurrency());
+    printf("%-28s %10s %8s %8s %10s %8s\n",
+           "model","size","threads","used","ms","speedup");
+
+    QStringList files = dir.entryList(QStringList() << "*.obj",QDir::Files,QDir::Name);
+    for (int i=0;i<files.size();i++)
+    {
+        string path = directory + "/" + files.at(i).toStdString();
+        QFileInfo info(QString::fromStdString(path));
+        double single = 0.0;
+
+        try
+        {
+            for (unsigned int t=1;t<=maxThreads;t++)
+            {
+                double best = 1e30,total = 0.0;
+
+                for (int r=0;(r<5) || (total<200.0);r++)
+                {
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    util::PolygonMesh<VertexAttrib> mesh =
+                            util::ObjImporter<VertexAttrib>::importFile(path,true,t);
+                    double ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+
+                    total += ms;
+                    if (ms<best)
+                        best = ms;
+                }
+                if (t==1)
+                    single = best;
+                printf("%-28s %10lld %8u %8u %10.3f %7.2fx\n",
+                       files.at(i).toStdString().c_str(),
+                       (long long)info.size(),
+                       t,
+                       util::threadCount((size_t)info.size(),t,256*1024),
+                       best,
+                       single/best);
+            }
+        }
+        catch (string e)
+        {
+            printf("failed   %s: %s\n",path.c_str(),e.c_str());
+            return 1;
+        }
+    }
+
+    return 0;
+}
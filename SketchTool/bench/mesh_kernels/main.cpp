@@ -0,0 +1,120 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "Parallel.h"
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+using namespace std;
+
+/*
+ * The best time of f, in ms, over at least 20 runs and 200ms of runs
+ */
+template <class F>
+static double best(F f)
+{
+    double fastest = 1e30,total = 0.0;
+
+    for (int r=0;(r<20) || (total<200.0);r++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        f();
+        double ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+
+        total += ms;
+        if (ms<fastest)
+            fastest = ms;
+    }
+    return fastest;
+}
+
+/*
+ * Times PolygonMesh::computeBoundingBox and PolygonMesh::computeNormals, which
+ * run the loops of util::MeshKernels, on every OBJ file in the given
+ * directory (models/ by default), imported indexed. Each is timed on one
+ * thread and on up to the given number of threads (one per core by default,
+ * at least 4). Meshes with fewer than MeshKernels::GRAIN vertices or
+ * polygons use one thread whatever is asked for, which the "used" columns
+ * show.
+ *
+ * The loops use SSE2 if the compiler supports it, and the scalar loops if
+ * GLM_FORCE_PURE is defined (CONFIG+=pure), so the two are timed by two
+ * builds.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    unsigned int maxThreads = thread::hardware_concurrency();
+    string directory = "models";
+
+    if (maxThreads<4)
+        maxThreads = 4;
+    if (argc>1)
+        maxThreads = (unsigned int)atoi(argv[1]);
+    if (argc>2)
+        directory = argv[2];
+
+    QDir dir(QString::fromStdString(directory));
+    if (!dir.exists())
+    {
+        printf("No such directory: %s\n",directory.c_str());
+        return 1;
+    }
+
+#if (GLM_ARCH & GLM_ARCH_SSE2)
+    printf("SSE2 loops, %u cores\n",thread::hardware_concurrency());
+#else
+    printf("scalar loops, %u cores\n",thread::hardware_concurrency());
+#endif
+    printf("%-28s %9s %10s %10s %4s %10s %10s %4s\n",
+           "model","vertices","bounds 1","bounds N","used","normals 1","normals N","used");
+
+    QStringList files = dir.entryList(QStringList() << "*.obj",QDir::Files,QDir::Name);
+    for (int i=0;i<files.size();i++)
+    {
+        string path = directory + "/" + files.at(i).toStdString();
+        util::PolygonMesh<VertexAttrib> mesh;
+
+        try
+        {
+            util::ObjImportOptions options;
+            options.indexed = true;
+            mesh = util::ObjImporter<VertexAttrib>::importFile(path,options);
+        }
+        catch (string e)
+        {
+            printf("failed   %s: %s\n",path.c_str(),e.c_str());
+            return 1;
+        }
+
+        size_t vertices = (size_t)mesh.getVertexCount();
+        size_t polygons = (mesh.getPrimitiveSize()>0)?
+                    (size_t)(mesh.getPrimitiveCount()/mesh.getPrimitiveSize()):0;
+
+        double bounds1 = best([&](){mesh.computeBoundingBox(1);});
+        double boundsN = best([&](){mesh.computeBoundingBox(maxThreads);});
+        double normals1 = best([&](){mesh.computeNormals(1);});
+        double normalsN = best([&](){mesh.computeNormals(maxThreads);});
+
+        printf("%-28s %9lu %10.3f %10.3f %4u %10.3f %10.3f %4u\n",
+               files.at(i).toStdString().c_str(),
+               (unsigned long)vertices,
+               bounds1,
+               boundsN,
+               util::threadCount(vertices,maxThreads,util::MeshKernels::GRAIN),
+               normals1,
+               normalsN,
+               util::threadCount(polygons,maxThreads,util::MeshKernels::GRAIN));
+    }
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#-------------------------------------------------
+#
+# Benchmark of the vertex normal and bounding box
+# loops in MeshKernels, on one thread and on N, on
+# every OBJ model. Build it with CONFIG+=pure to
+# time the scalar loops instead of the SSE2 ones.
+# Run it from the SketchTool directory:
+#
+#   mesh_kernels [threads [models-directory]]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = mesh_kernels
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+pure: DEFINES += GLM_FORCE_PURE
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
@@ -0,0 +1,136 @@
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "OpenGLFunctions.h"
+#include "ShaderProgram.h"
+#include "ShaderLocationsVault.h"
+#include "ObjectInstance.h"
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <map>
+using namespace std;
+
+/*
+ * Times ObjectInstance::initPolygonMesh, which lays the vertex data out and
+ * writes it to a buffer of its own (see ObjectInstance::fillVertexBuffer), on
+ * one model (models/thomas-lyons-object.obj by default) imported the way the
+ * scenegraph reader does. It is timed in both vertex formats, with the three
+ * attributes the view uses and with the position alone, in an offscreen
+ * OpenGL 3.3 context. Every time is the best of 50 runs, each up to a
+ * glFinish.
+ *
+ * The interface it uses has not changed since the vertex data was first
+ * packed into one array of bytes, so the same program built against older
+ * trees gives the times to compare to.
+ */
+int main(int argc, char *argv[])
+{
+    QGuiApplication a(argc, argv);
+    string path = "models/thomas-lyons-object.obj";
+
+    if (argc>1)
+        path = argv[1];
+
+    QSurfaceFormat format;
+    format.setVersion(3,3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if (!context.create() || !context.makeCurrent(&surface))
+    {
+        printf("Cannot make an OpenGL 3.3 context\n");
+        return 1;
+    }
+
+    util::OpenGLFunctions gl;
+    util::ShaderProgram program;
+
+    try
+    {
+        //the same as View::init
+        program.createProgram(gl,
+                              string("shaders/phong-multiple.vert"),
+                              string("shaders/phong-multiple.frag"));
+        util::ShaderLocationsVault shaderLocations = program.getAllShaderVariables(gl);
+
+        //the same as SceneXMLReader
+        util::ObjImportOptions options;
+        options.indexed = true;
+        options.numThreads = 0;
+        options.optimize = true;
+        util::PolygonMesh<VertexAttrib> mesh =
+                util::ObjImporter<VertexAttrib>::importFile(path,options);
+
+        map<string,string> all,positions;
+        all["vPosition"] = "position";
+        all["vNormal"] = "normal";
+        all["vTexCoord"] = "texcoord";
+        positions["vPosition"] = "position";
+
+        printf("%s: %d vertices\n",path.c_str(),mesh.getVertexCount());
+        printf("%-10s %-12s %10s\n","format","attributes","ms");
+
+        program.enable(gl);
+        for (int f=0;f<2;f++)
+        {
+            util::ObjectInstance::VertexFormat vertexFormat =
+                    (f==0)?util::ObjectInstance::FLOAT_VERTICES:util::ObjectInstance::COMPACT_VERTICES;
+
+            for (int m=0;m<2;m++)
+            {
+                const map<string,string>& shaderVarsToVertexAttribs = (m==0)?all:positions;
+                double best = 1e30;
+
+                for (int r=0;r<50;r++)
+                {
+                    util::ObjectInstance instance("model");
+
+                    gl.glFinish();
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    instance.initPolygonMesh<VertexAttrib>(gl,
+                                                           shaderLocations,
+                                                           shaderVarsToVertexAttribs,
+                                                           mesh,
+                                                           vertexFormat);
+                    gl.glFinish();
+                    double ms = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+
+                    instance.cleanup(gl);
+                    if (ms<best)
+                        best = ms;
+                }
+                printf("%-10s %-12s %10.3f\n",
+                       (f==0)?"float":"compact",
+                       (m==0)?"all":"position",
+                       best);
+            }
+        }
+        program.disable(gl);
+    }
+    catch (string e)
+    {
+        printf("failed   %s: %s\n",path.c_str(),e.c_str());
+        return 1;
+    }
+    catch (runtime_error e)
+    {
+        printf("failed   %s: %s\n",path.c_str(),e.what());
+        return 1;
+    }
+
+    context.doneCurrent();
+    return 0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Benchmark of the upload of a mesh to the GPU. It
+# times ObjectInstance::initPolygonMesh on one OBJ
+# model, for each vertex format. Run it from the
+# SketchTool directory:
+#
+#   mesh_upload [model]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = mesh_upload
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
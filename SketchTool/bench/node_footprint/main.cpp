@@ -0,0 +1,159 @@
+#include <QCoreApplication>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "Material.h"
+#include "sgraph/Scenegraph.h"
+#include "sgraph/GroupNode.h"
+#include "sgraph/TransformNode.h"
+#include "sgraph/LeafNode.h"
+#include <malloc.h>
+#include <chrono>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+
+/*
+ * The allocations made through operator new, and the bytes they take up
+ * (as the C library rounds them up) that have not been given back
+ */
+static size_t numAllocations = 0;
+static size_t liveBytes = 0;
+
+static size_t usableSize(void *p)
+{
+#ifdef _WIN32
+    return _msize(p);
+#else
+    return malloc_usable_size(p);
+#endif
+}
+
+void *operator new(size_t size)
+{
+    void *p = malloc((size>0)?size:1);
+
+    if (p==NULL)
+        throw bad_alloc();
+    numAllocations++;
+    liveBytes += usableSize(p);
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p==NULL)
+        return;
+    liveBytes -= usableSize(p);
+    free(p);
+}
+
+/*
+ * The bytes that the node pools (see util::ObjectPool) have taken straight
+ * from malloc. The pools are looked for so that this also builds against
+ * trees from before there were any
+ */
+static size_t pooledBytes()
+{
+#ifdef _OBJECTPOOL_H_
+    return sgraph::GroupNode::pool().getReserved()
+            + sgraph::TransformNode::pool().getReserved()
+            + sgraph::LeafNode::pool().getReserved();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Adds objects (a group, a transform and a leaf, each with a name of its
+ * own, 33334 by default to make 100000 nodes) to a scenegraph, the way the
+ * sketch tool adds shapes
+ */
+static void addObjects(sgraph::Scenegraph& scenegraph,
+                       const string& prefix,
+                       int objects,
+                       vector<sgraph::INode *>& nodes)
+{
+    util::Material material;
+
+    material.setShininess(3);
+    for (int i=0;i<objects;i++)
+    {
+        sgraph::GroupNode *group = new sgraph::GroupNode(&scenegraph,prefix+"group-"+to_string(i));
+        sgraph::TransformNode *transform = new sgraph::TransformNode(&scenegraph,prefix+"transform-"+to_string(i));
+        sgraph::LeafNode *leaf = new sgraph::LeafNode("box",&scenegraph,prefix+"leaf-"+to_string(i));
+
+        transform->addTranslation((float)i,0,0);
+        leaf->setMaterial(material);
+        leaf->setTextureName("wood");
+        transform->addChild(leaf);
+        group->addChild(transform);
+        nodes.push_back(group);
+        nodes.push_back(transform);
+        nodes.push_back(leaf);
+    }
+}
+
+/*
+ * Measures what a scenegraph of 100000 nodes takes: the memory of the nodes
+ * (names included), that of the index of their names in the scenegraph,
+ * and the heap allocations per node made while building it and while
+ * cloning it.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    int objects = 33334;
+
+    if (argc>1)
+        objects = atoi(argv[1]);
+
+    int numNodes = 3*objects;
+    vector<sgraph::INode *> nodes;
+    nodes.reserve(numNodes);
+
+    //the nodes of a scenegraph that is built and then dropped, with its
+    //index of names, which leaves what the nodes take on their own
+    sgraph::Scenegraph scratch;
+    size_t bytes = liveBytes,pooled = pooledBytes(),allocations = numAllocations;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    addObjects(scratch,"scratch-",objects,nodes);
+    double buildMs = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    size_t buildAllocations = numAllocations-allocations;
+    size_t withIndex = liveBytes-bytes;
+    //the nodes are not in its tree, so this only drops the index
+    scratch.dispose();
+    size_t nodeBytes = liveBytes-bytes+pooledBytes()-pooled;
+    size_t indexBytes = withIndex-(liveBytes-bytes);
+
+    //a tree of the same size, which is cloned
+    sgraph::Scenegraph scenegraph;
+    vector<sgraph::INode *> objectNodes;
+    objectNodes.reserve(numNodes);
+    sgraph::GroupNode *root = new sgraph::GroupNode(&scenegraph,"root");
+    addObjects(scenegraph,"",objects,objectNodes);
+    for (size_t i=0;i<objectNodes.size();i+=3)
+        root->addChild(objectNodes[i]);
+    scenegraph.makeScenegraph(root);
+
+    allocations = numAllocations;
+    start = chrono::steady_clock::now();
+    sgraph::INode *copy = root->clone();
+    double cloneMs = chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+    size_t cloneAllocations = numAllocations-allocations;
+
+    printf("%d nodes\n",numNodes);
+    printf("node memory:  %.1f MB per 100k nodes\n",nodeBytes/1048576.0*100000/numNodes);
+    printf("name index:   %.1f MB per 100k nodes\n",indexBytes/1048576.0*100000/numNodes);
+    printf("building:     %.1f allocations per node, %.1f ms\n",
+           (double)buildAllocations/numNodes,buildMs);
+    printf("cloning:      %.1f allocations per node, %.1f ms\n",
+           (double)cloneAllocations/numNodes,cloneMs);
+
+    delete copy;
+    for (size_t i=0;i<nodes.size();i+=3)
+        delete nodes[i];
+    return 0;
+}
@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Benchmark of the memory that scenegraph nodes
+# take. It builds and clones a scenegraph of
+# about 100000 nodes. Run it from anywhere:
+#
+#   node_footprint [objects]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = node_footprint
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
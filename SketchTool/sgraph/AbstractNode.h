@@ -4,6 +4,7 @@
 #include "INode.h"
 #include "glm/glm.hpp"
 #include "View.h"
+#include "InternedString.h"
 #include <string>
 using namespace std;
 
@@ -24,7 +25,7 @@ namespace sgraph
      * The name given to this node
      */
   protected:
-    string name;
+    util::InternedString name;
     /**
      * The parent of this node. Each node except the root has a parent. The root's parent is null
      */
@@ -35,18 +36,83 @@ namespace sgraph
     sgraph::Scenegraph *scenegraph;
 
     /**
+     * What few nodes have, kept out of the node so that the others do not
+     * carry it. NULL until something is put in it
+     */
+    struct ColdData
+    {
+      /**
        * A list of lights that are attached to this node. The position/direction of
        * the light is specified in terms of this node's coordinate system
        */
-    vector<util::Light> lights;
+      vector<util::Light> lights;
+
+      /**
+       * The texture a leaf had before it was last changed
+       */
+      util::InternedString savedTexture;
+    };
+    ColdData *cold;
 
     AbstractNode(sgraph::Scenegraph *graph,const string& name)
     {
       this->parent = NULL;
+      cold = NULL;
       scenegraph = graph;
       setName(name);
     }
 
+    ~AbstractNode()
+    {
+      delete cold;
+    }
+
+    /**
+     * @brief getColdData
+     * Gets the cold data of this node, which is made the first time it is
+     * needed
+     */
+    ColdData& getColdData()
+    {
+      if (cold==NULL)
+        cold = new ColdData();
+      return *cold;
+    }
+
+    /**
+     * @brief willChange
+     * Tells the scenegraph that this node is about to change, so that what
+     * shares it with this part of the tree gets a copy of its own first. Must
+     * be called by everything that changes what is drawn
+     */
+    void willChange()
+    {
+      scenegraph->nodeWillChange(this);
+    }
+
+    /**
+     * @brief copyLightsTo
+     * Gives the lights of this node to another one, for making copies
+     */
+    void copyLightsTo(INode *node)
+    {
+      const vector<util::Light>& lights = getLights();
+
+      for (unsigned int i=0;i<lights.size();i++)
+        node->addLight(lights[i]);
+    }
+
+    /**
+     * @brief getLights
+     * Gets the lights attached to this node
+     */
+    const vector<util::Light>& getLights() const
+    {
+      static const vector<util::Light> none;
+
+      return (cold!=NULL)?cold->lights:none;
+    }
+
     /**
      * @brief getNode
      * By default, this method checks only itself. Nodes that have children should override this
@@ -140,14 +206,19 @@ namespace sgraph
 
     /**
      * @brief setName
-     * Sets the name of this node
+     * Sets the name of this node, and moves it to that name in the index of
+     * nodes of its scenegraph
      *
      * @param name
      * The desired name of this node
      */
     void setName(const string& name)
     {
+      util::InternedString oldName = this->name;
+
       this->name = name;
+      if (scenegraph!=NULL)
+        scenegraph->renameNode(this,oldName,name);
     }
 
     INode* getParent() {return parent;}
@@ -247,37 +318,19 @@ namespace sgraph
      */
     void addLight(const util::Light& l) throw(runtime_error)
     {
-      lights.push_back(l);
+      willChange();
+      getColdData().lights.push_back(l);
+      scenegraph->lightsChanged();
     }
 
     /**
-     * @brief getLightsInView
-     * Used to retreive all lights currently in the view. Necessary for
-     * rendering
-     *
-     * @param modelview
-     * The composite transformation currently applied to the view
-     *
-     * @return
-     * Returns a vector of util::Lights representing all lights in the current
-     * view
+     * @brief unshare
+     * By default, a node shares nothing
      */
-    vector<util::Light> getLightsInView(stack<glm::mat4>& modelview)
+    void unshare()
     {
-      vector<util::Light> listLights;
-
-      for (unsigned int i=0;i<lights.size();i++)
-        {
-          util::Light lnew(lights[i]);
-          glm::vec4 pos = lnew.getPosition();
-          pos = modelview.top() * pos;
-          lnew.setPosition(pos);
-          listLights.push_back(lnew);
-        }
-      return listLights;
     }
 
-
     /**
      * @brief changeNodeTexture
      * Changes the texture of this node - throws runtime error for AbstractNode
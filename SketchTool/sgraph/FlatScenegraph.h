@@ -0,0 +1,687 @@
+#ifndef _FLATSCENEGRAPH_H_
+#define _FLATSCENEGRAPH_H_
+
+#include "INode.h"
+#include "Material.h"
+#include "Light.h"
+#include "MatrixSIMD.h"
+#include "Frustum.h"
+#include "glm/glm.hpp"
+#include <glm/gtc/matrix_inverse.hpp>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+class TextureImage;
+}
+
+namespace sgraph
+{
+
+/**
+ * The scenegraph laid out flat for drawing. The nodes of the tree are kept in
+ * depth-first order, and what drawing needs of each node is kept in arrays
+ * indexed by that order: its parent, the end of its subtree, its local
+ * transformation and its transformation to the coordinate system of the
+ * root, and for leaves the mesh, material and texture they are drawn with.
+ * Parents come before their children, so all the world transformations are
+ * found in one pass over the arrays, and the boxes around what the subtrees
+ * draw, in the coordinate system of the root, in one pass back over them
+ * (see updateBounds). The lights of the nodes are kept with
+ * their positions in the coordinate system of the root, which are only found
+ * again when the transformations above them change.
+ *
+ * The tree of INode objects is still what is edited. Nodes pass edits of
+ * their transformations and leaf properties on to their entries here, and
+ * edits of the structure of the tree make it be flattened again before it
+ * is next drawn.
+ */
+class FlatScenegraph
+{
+public:
+    FlatScenegraph()
+    {
+        root = NULL;
+        built = false;
+        dirtyBegin = dirtyEnd = 0;
+        boundsBegin = boundsEnd = 0;
+        resolvedVersion = 0;
+    }
+
+    /**
+     * @brief setRoot
+     * Sets the root of the tree that is flattened
+     */
+    void setRoot(INode *root)
+    {
+        this->root = root;
+        invalidate();
+    }
+
+    INode *getRoot()
+    {
+        return root;
+    }
+
+    /**
+     * @brief invalidate
+     * Makes the tree be flattened again before it is next drawn. This must
+     * be called whenever nodes are added to it or taken out of it
+     */
+    void invalidate()
+    {
+        built = false;
+    }
+
+    /**
+     * @brief clear
+     * Forgets the tree and everything about its nodes
+     */
+    void clear()
+    {
+        root = NULL;
+        built = false;
+        nodes.clear();
+        types.clear();
+        parents.clear();
+        ends.clear();
+        locals.clear();
+        worlds.clear();
+        worldNormals.clear();
+        dirty.clear();
+        meshes.clear();
+        materials.clear();
+        textures.clear();
+        textureMatrices.clear();
+        modelviews.clear();
+        normalMatrices.clear();
+        viewVersions.clear();
+        meshNames.clear();
+        meshIds.clear();
+        textureNames.clear();
+        textureIds.clear();
+        meshHandles.clear();
+        textureHandles.clear();
+        meshMins.clear();
+        meshMaxs.clear();
+        boundsMins.clear();
+        boundsMaxs.clear();
+        materialTable.clear();
+        firstLights.clear();
+        lightCounts.clear();
+        nodeLights.clear();
+        worldLightPositions.clear();
+        indices.clear();
+        dirtyBegin = dirtyEnd = 0;
+        boundsBegin = boundsEnd = 0;
+    }
+
+    /**
+     * @brief update
+     * Flattens the tree again if it has changed, finds what the renderer
+     * draws the leaves with (see resolve), and finds the world
+     * transformations and the bounds that edits have changed
+     *
+     * @param renderer
+     * The renderer (a GLScenegraphRenderer)
+     */
+    template <class Renderer>
+    void update(const Renderer& renderer)
+    {
+        if (!built)
+            build();
+        resolve(renderer);
+        updateWorldTransforms();
+        updateBounds();
+    }
+
+    size_t size() const
+    {
+        return nodes.size();
+    }
+
+    /**
+     * @brief addNode
+     * Adds a node after the ones added so far. Called by INode::flatten
+     *
+     * @param node
+     * The node
+     *
+     * @param type
+     * The type of the node
+     *
+     * @param parent
+     * The index of the parent of the node, -1 for the root
+     *
+     * @param local
+     * The transformation of the node (identity for nodes other than transform
+     * nodes)
+     *
+     * @return
+     * The index of the node
+     */
+    int addNode(INode *node,NodeType type,int parent,const glm::mat4& local)
+    {
+        int index = (int)nodes.size();
+
+        nodes.push_back(node);
+        types.push_back(type);
+        parents.push_back(parent);
+        ends.push_back(index+1);
+        locals.push_back(local);
+        worlds.push_back(glm::mat4(1.0f));
+        worldNormals.push_back(glm::mat3(1.0f));
+        dirty.push_back(1);
+        meshes.push_back(-1);
+        materials.push_back(-1);
+        textures.push_back(-1);
+        textureMatrices.push_back(glm::mat4(1.0f));
+        modelviews.push_back(glm::mat4(1.0f));
+        normalMatrices.push_back(glm::mat3(1.0f));
+        viewVersions.push_back(0);
+        boundsMins.push_back(glm::vec3(1.0f));
+        boundsMaxs.push_back(glm::vec3(-1.0f));
+        firstLights.push_back((int)nodeLights.size());
+        lightCounts.push_back(0);
+        //a node in a subtree that is drawn in more than one place (see
+        //InstanceNode) is found at the first of them
+        indices.insert(make_pair(node,index));
+        return index;
+    }
+
+    /**
+     * @brief endSubtree
+     * Marks the end of the subtree of a node, once all of its descendants have
+     * been added. Called by INode::flatten
+     *
+     * @param index
+     * The index of the node
+     */
+    void endSubtree(int index)
+    {
+        ends[index] = (int)nodes.size();
+    }
+
+    /**
+     * @brief addLights
+     * Adds the lights of a node, after the lights of its subtree. Called by
+     * INode::flatten
+     *
+     * @param index
+     * The index of the node
+     *
+     * @param lights
+     * The lights, in the coordinate system the node is drawn in (that of its
+     * parent)
+     */
+    void addLights(int index,const vector<util::Light>& lights)
+    {
+        firstLights[index] = (int)nodeLights.size();
+        lightCounts[index] = (int)lights.size();
+        for (size_t i=0;i<lights.size();i++)
+        {
+            nodeLights.push_back(lights[i]);
+            worldLightPositions.push_back(lights[i].getPosition());
+        }
+    }
+
+    /**
+     * @brief getLightsInView
+     * Gets all the lights in the view coordinate system, in the order the
+     * tree of nodes gives them in (those of the subtree of a node before its
+     * own)
+     *
+     * @param view
+     * The view
+     *
+     * @param lights
+     * Receives the lights. Its memory is kept from frame to frame, so after
+     * the first one nothing is allocated
+     */
+    void getLightsInView(const glm::mat4& view,vector<util::Light>& lights) const
+    {
+        lights.resize(nodeLights.size());
+        for (size_t i=0;i<nodeLights.size();i++)
+        {
+            lights[i] = nodeLights[i];
+            lights[i].setPosition(view * worldLightPositions[i]);
+        }
+    }
+
+    /**
+     * @brief setLeaf
+     * Sets what a leaf is drawn with. Called by leaves when they are edited
+     *
+     * @param node
+     * The leaf. Nothing is done if it has not been added
+     */
+    void setLeaf(INode *node,
+                 const string& mesh,
+                 const util::Material& material,
+                 const string& texture,
+                 const glm::mat4& textureMatrix)
+    {
+        unordered_map<INode *,int>::iterator it = indices.find(node);
+
+        if (it==indices.end())
+            return;
+        setLeaf(it->second,mesh,material,texture,textureMatrix);
+    }
+
+    /**
+     * @brief setLeaf
+     * Sets what the leaf at an index is drawn with. Called by INode::flatten
+     */
+    void setLeaf(int index,
+                 const string& mesh,
+                 const util::Material& material,
+                 const string& texture,
+                 const glm::mat4& textureMatrix)
+    {
+        meshes[index] = idOf(mesh,meshNames,meshIds);
+        textures[index] = idOf(texture,textureNames,textureIds);
+        if (materials[index]<0)
+        {
+            materials[index] = (int)materialTable.size();
+            materialTable.push_back(material);
+        }
+        else
+            materialTable[materials[index]] = material;
+        textureMatrices[index] = textureMatrix;
+        markBoundsDirty(index,index+1);
+    }
+
+    /**
+     * @brief setLocalTransform
+     * Sets the transformation of a transform node, which makes the world
+     * transformations of its subtree be found again. Called by transform
+     * nodes when they are edited
+     *
+     * @param node
+     * The node. Nothing is done if it has not been added
+     */
+    void setLocalTransform(INode *node,const glm::mat4& local)
+    {
+        unordered_map<INode *,int>::iterator it = indices.find(node);
+
+        if (it==indices.end())
+            return;
+
+        int index = it->second;
+        locals[index] = local;
+        markDirty(index);
+    }
+
+    /**
+     * @brief getModelview
+     * Gets the modelview that a leaf was last drawn with
+     *
+     * @param node
+     * The leaf
+     *
+     * @param modelview
+     * Receives the modelview, if the leaf has been drawn
+     *
+     * @return
+     * False if the leaf has not been added
+     */
+    bool getModelview(INode *node,glm::mat4& modelview)
+    {
+        unordered_map<INode *,int>::iterator it = indices.find(node);
+
+        if (it==indices.end())
+            return false;
+        modelview = modelviews[it->second];
+        return true;
+    }
+
+    /*
+     * What the renderer reads, by index
+     */
+    INode *getNode(int i) const {return nodes[i];}
+    NodeType getType(int i) const {return types[i];}
+    int getSubtreeEnd(int i) const {return ends[i];}
+    const glm::mat4& getWorldTransform(int i) const {return worlds[i];}
+    const string& getMeshName(int i) const {return meshNames[meshes[i]];}
+    const util::Material& getMaterial(int i) const {return materialTable[materials[i]];}
+    const string& getTextureName(int i) const {return textureNames[textures[i]];}
+    const glm::mat4& getTextureMatrix(int i) const {return textureMatrices[i];}
+    bool hasMesh(int i) const {return meshes[i]>=0;}
+
+    /*
+     * What the renderer draws a leaf with, as found by resolve: the id of its
+     * mesh (-1 if it has none, or the renderer does not have it) and its
+     * texture
+     */
+    int getMeshId(int i) const {return (meshes[i]>=0)?meshHandles[meshes[i]]:-1;}
+    util::TextureImage *getTexture(int i) const {return textureHandles[textures[i]];}
+
+    /*
+     * The box around what the subtree of a node draws, in the coordinate
+     * system of the root, as found by update. It is empty (the minimum is
+     * above the maximum) if the subtree draws nothing
+     */
+    bool hasBounds(int i) const {return boundsMins[i].x<=boundsMaxs[i].x;}
+    const glm::vec3& getBoundsMin(int i) const {return boundsMins[i];}
+    const glm::vec3& getBoundsMax(int i) const {return boundsMaxs[i];}
+
+    /**
+     * @brief resolve
+     * Finds what the renderer draws each mesh and texture name with, once
+     * for every name, so that drawing a leaf looks up none. They are found
+     * again when the renderer has had meshes or textures added since, and
+     * only for the names that are new otherwise
+     *
+     * @param renderer
+     * The renderer (a GLScenegraphRenderer)
+     */
+    template <class Renderer>
+    void resolve(const Renderer& renderer)
+    {
+        if (renderer.getResourceVersion()!=resolvedVersion)
+        {
+            meshHandles.clear();
+            textureHandles.clear();
+            meshMins.clear();
+            meshMaxs.clear();
+            resolvedVersion = renderer.getResourceVersion();
+            //the bounds of every leaf may have changed with its mesh
+            markBoundsDirty(0,nodes.size());
+        }
+        while (meshHandles.size()<meshNames.size())
+        {
+            glm::vec3 minimum(1.0f),maximum(-1.0f);
+            const string& name = meshNames[meshHandles.size()];
+
+            meshHandles.push_back(renderer.getMeshId(name));
+            renderer.getMeshBounds(name,minimum,maximum);
+            meshMins.push_back(minimum);
+            meshMaxs.push_back(maximum);
+        }
+        while (textureHandles.size()<textureNames.size())
+            textureHandles.push_back(renderer.getTexture(textureNames[textureHandles.size()]));
+    }
+
+    /**
+     * @brief getDrawTransforms
+     * Gets the modelview and the normal matrix of a leaf for a view. They are
+     * only found again if the world transformation of the leaf or the view
+     * have changed since the last time
+     *
+     * @param i
+     * The index of the leaf
+     *
+     * @param view,viewNormalMatrix,viewVersion
+     * The view, the matrix that transforms normals by it, and its version
+     *
+     * @param modelview,normalMatrix
+     * Receive the pointers to the matrices
+     */
+    void getDrawTransforms(int i,
+                           const glm::mat4& view,
+                           const glm::mat3& viewNormalMatrix,
+                           unsigned long viewVersion,
+                           const glm::mat4 *& modelview,
+                           const glm::mat3 *& normalMatrix)
+    {
+        if (viewVersions[i]!=viewVersion)
+        {
+            util::multiplyMatrices(view,worlds[i],modelviews[i]);
+            normalMatrices[i] = viewNormalMatrix * worldNormals[i];
+            viewVersions[i] = viewVersion;
+        }
+        modelview = &modelviews[i];
+        normalMatrix = &normalMatrices[i];
+    }
+
+protected:
+    /**
+     * @brief build
+     * Flattens the tree from scratch
+     */
+    void build()
+    {
+        INode *r = root;
+
+        clear();
+        root = r;
+        if (root!=NULL)
+            root->flatten(*this,-1);
+        built = true;
+        dirtyBegin = 0;
+        dirtyEnd = nodes.size();
+        markBoundsDirty(0,nodes.size());
+    }
+
+    /**
+     * @brief markBoundsDirty
+     * Makes the bounds of a range of nodes, and of the ancestors of the
+     * first of them, be found again
+     */
+    void markBoundsDirty(size_t begin,size_t end)
+    {
+        if (boundsBegin>=boundsEnd)
+        {
+            boundsBegin = begin;
+            boundsEnd = end;
+        }
+        else
+        {
+            boundsBegin = std::min(boundsBegin,begin);
+            boundsEnd = std::max(boundsEnd,end);
+        }
+    }
+
+    /**
+     * @brief markDirty
+     * Makes the world transformation of a node and its subtree be found
+     * again
+     */
+    void markDirty(int index)
+    {
+        if (!built)
+            return;
+        dirty[index] = 1;
+        if (dirtyBegin>=dirtyEnd)
+        {
+            dirtyBegin = index;
+            dirtyEnd = ends[index];
+        }
+        else
+        {
+            dirtyBegin = std::min(dirtyBegin,(size_t)index);
+            dirtyEnd = std::max(dirtyEnd,(size_t)ends[index]);
+        }
+    }
+
+    /**
+     * @brief updateWorldTransforms
+     * Finds the world transformations of the dirty nodes and their subtrees,
+     * in one pass over the range that has them. A node is dirty if it or its
+     * parent is, since its parent comes before it
+     */
+    void updateWorldTransforms()
+    {
+        static const glm::mat4 identity(1.0f);
+
+        for (size_t i=dirtyBegin;i<dirtyEnd;i++)
+        {
+            int p = parents[i];
+
+            if ((p>=0) && dirty[p])
+                dirty[i] = 1;
+            if (!dirty[i])
+                continue;
+
+            const glm::mat4& parentWorld = (p>=0)?worlds[p]:identity;
+            for (int k=firstLights[i];k<firstLights[i]+lightCounts[i];k++)
+                worldLightPositions[k] = parentWorld * nodeLights[k].getPosition();
+            if (types[i]==TRANSFORM)
+                util::multiplyMatrices(parentWorld,locals[i],worlds[i]);
+            else
+                worlds[i] = parentWorld;
+
+            if (types[i]==LEAF)
+            {
+                worldNormals[i] = glm::inverseTranspose(glm::mat3(worlds[i]));
+                viewVersions[i] = 0;
+            }
+        }
+        for (size_t i=dirtyBegin;i<dirtyEnd;i++)
+            dirty[i] = 0;
+        if (dirtyBegin<dirtyEnd)
+            markBoundsDirty(dirtyBegin,dirtyEnd);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    /**
+     * @brief updateBounds
+     * Finds the bounds of the nodes whose bounds are dirty, children before
+     * their parents, and then those of the ancestors of the first of them.
+     * Those are the only nodes before the range that have children in it
+     */
+    void updateBounds()
+    {
+        if (boundsBegin>=boundsEnd)
+            return;
+        for (size_t i=boundsEnd;i>boundsBegin;i--)
+            computeBounds((int)i-1);
+        for (int p=parents[boundsBegin];p>=0;p=parents[p])
+            computeBounds(p);
+        boundsBegin = boundsEnd = 0;
+    }
+
+    /**
+     * @brief computeBounds
+     * Finds the bounds of a node: those of its mesh in its world
+     * transformation for a leaf, and the box around the bounds of its
+     * children otherwise
+     */
+    void computeBounds(int i)
+    {
+        glm::vec3 minimum(1.0f),maximum(-1.0f);
+
+        if (types[i]==LEAF)
+        {
+            int m = meshes[i];
+
+            if ((m>=0) && (meshMins[m].x<=meshMaxs[m].x))
+            {
+                glm::vec3 center,extent;
+
+                util::Frustum::transformBox(worlds[i],meshMins[m],meshMaxs[m],center,extent);
+                minimum = center-extent;
+                maximum = center+extent;
+            }
+        }
+        else
+        {
+            //the children of a node are the roots of the subtrees in its own
+            for (int c=i+1;c<ends[i];c=ends[c])
+            {
+                if (boundsMins[c].x>boundsMaxs[c].x)
+                    continue;
+                if (minimum.x>maximum.x)
+                {
+                    minimum = boundsMins[c];
+                    maximum = boundsMaxs[c];
+                }
+                else
+                {
+                    minimum = glm::min(minimum,boundsMins[c]);
+                    maximum = glm::max(maximum,boundsMaxs[c]);
+                }
+            }
+        }
+        boundsMins[i] = minimum;
+        boundsMaxs[i] = maximum;
+    }
+
+    /**
+     * @brief idOf
+     * The index of a name in a table of names, which is added if it is not in
+     * it yet
+     */
+    static int idOf(const string& name,vector<string>& names,map<string,int>& ids)
+    {
+        map<string,int>::iterator it = ids.find(name);
+
+        if (it!=ids.end())
+            return it->second;
+        ids[name] = (int)names.size();
+        names.push_back(name);
+        return (int)names.size()-1;
+    }
+
+    INode *root;
+    bool built;
+
+    /**
+     * One entry for every node, in depth-first order. The end of the subtree
+     * of a node is the index after its last descendant. The mesh, material
+     * and texture of a leaf are indices into meshNames, materialTable and
+     * textureNames (-1 for other nodes). The modelview and normal matrix of a
+     * leaf are those it was last drawn with, for the view whose version is
+     * in viewVersions
+     */
+    vector<INode *> nodes;
+    vector<NodeType> types;
+    vector<int> parents,ends;
+    vector<glm::mat4> locals,worlds;
+    vector<glm::mat3> worldNormals;
+    vector<unsigned char> dirty;
+    vector<int> meshes,materials,textures;
+    vector<glm::mat4> textureMatrices;
+    vector<glm::mat4> modelviews;
+    vector<glm::mat3> normalMatrices;
+    vector<unsigned long> viewVersions;
+
+    vector<string> meshNames,textureNames;
+    map<string,int> meshIds,textureIds;
+
+    /**
+     * What the renderer draws each of meshNames and textureNames with, and
+     * the bounds of each mesh (empty if the renderer does not have it), for
+     * the version of its meshes and textures in resolvedVersion
+     */
+    vector<int> meshHandles;
+    vector<util::TextureImage *> textureHandles;
+    vector<glm::vec3> meshMins,meshMaxs;
+    unsigned long resolvedVersion;
+
+    /**
+     * The bounds of each node in the coordinate system of the root, and the
+     * range of nodes whose bounds may be dirty
+     */
+    vector<glm::vec3> boundsMins,boundsMaxs;
+    size_t boundsBegin,boundsEnd;
+    vector<util::Material> materialTable;
+
+    /**
+     * The lights of each node are nodeLights[firstLights[i]] onwards, with
+     * their positions in the coordinate system of the root in
+     * worldLightPositions
+     */
+    vector<int> firstLights,lightCounts;
+    vector<util::Light> nodeLights;
+    vector<glm::vec4> worldLightPositions;
+
+    /**
+     * The index of each node, for passing edits on. Nodes that are shared
+     * are edited only once they no longer are, which flattens the tree again
+     */
+    unordered_map<INode *,int> indices;
+
+    /**
+     * The range of nodes that may be dirty
+     */
+    size_t dirtyBegin,dirtyEnd;
+};
+}
+
+#endif
@@ -2,21 +2,30 @@
 #define _GLSCENEGRAPHRENDERER_H_
 
 #include "INode.h"
+#include "FlatScenegraph.h"
 #include "OpenGLFunctions.h"
 #include "glm/glm.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include "Material.h"
 #include "TextureImage.h"
 #include "ObjectInstance.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
 #include "IVertexData.h"
 #include "ShaderLocationsVault.h"
+#include "UniformBuffers.h"
+#include "RadixSort.h"
+#include "Frustum.h"
 #include <string>
 #include <sstream>
 #include <map>
 #include <stack>
 #include <cmath>
+#include <cstring>
+#include <cstddef>
 #include <fstream>
 #include "glm/gtc/matrix_transform.hpp"
+#include <glm/gtc/matrix_inverse.hpp>
 using namespace std;
 
 namespace sgraph
@@ -30,6 +39,80 @@ namespace sgraph
  */
 class GLScenegraphRenderer
 {
+public:
+    /**
+     * The orders in which the leaves of a frame can be drawn
+     */
+    enum SortOrder
+    {
+        /**
+         * Leaves with the same VAO, texture and mesh together, so that they
+         * change as little state as possible and are drawn with as few
+         * instanced calls as possible. Front to back within the same state
+         */
+        SORT_BY_STATE,
+        /**
+         * Nearest leaves first, so that the depth test rejects as many hidden
+         * fragments as possible. Leaves at about the same depth are still
+         * grouped by state
+         */
+        SORT_FRONT_TO_BACK
+    };
+
+    /**
+     * What drawing the last frame took, and what it would have taken to draw
+     * its leaves in the order the scenegraph was traversed
+     */
+    struct RenderQueueStats
+    {
+        size_t packets; //leaves drawn
+        size_t drawCalls,textureBinds,vertexArrayBinds;
+        size_t unsortedDrawCalls,unsortedTextureBinds,unsortedVertexArrayBinds;
+
+        RenderQueueStats()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            packets = 0;
+            drawCalls = textureBinds = vertexArrayBinds = 0;
+            unsortedDrawCalls = unsortedTextureBinds = unsortedVertexArrayBinds = 0;
+        }
+
+        /**
+         * The draw calls and binds that sorting saved. This is negative if
+         * the order asked for costs more state changes than traversal order
+         */
+        long getStateChangesSaved() const
+        {
+            return (long)(unsortedDrawCalls+unsortedTextureBinds+unsortedVertexArrayBinds)
+                    - (long)(drawCalls+textureBinds+vertexArrayBinds);
+        }
+    };
+
+    /**
+     * What view frustum culling rejected in the last frame. Subtrees are
+     * tested at group nodes, and leaves are tested only if no subtree they
+     * are in was found to be wholly inside the frustum
+     */
+    struct CullingStats
+    {
+        size_t subtreesTested,subtreesCulled;
+        size_t leavesTested,leavesCulled,leavesVisible;
+
+        CullingStats()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            subtreesTested = subtreesCulled = 0;
+            leavesTested = leavesCulled = leavesVisible = 0;
+        }
+    };
 
 private:
     /**
@@ -41,6 +124,164 @@ private:
      */
 protected :
     util::ShaderLocationsVault shaderLocations;
+    /**
+     * The binding points of the uniform blocks of the shader program
+     */
+    enum UniformBinding
+    {
+        DRAW_BINDING = 0,
+        MATERIAL_BINDING = 1,
+        LIGHT_BINDING = 2
+    };
+
+    /**
+     * The most lights the shader program takes (MAXLIGHTS in
+     * phong-multiple.frag)
+     */
+    static const int MAX_LIGHTS = 10;
+
+    /**
+     * The most instances drawn in one call (MAXINSTANCES in
+     * phong-multiple.vert)
+     */
+    static const int MAX_INSTANCES = 64;
+
+    /**
+     * InstanceProperties of phong-multiple.vert, laid out as std140
+     */
+    struct InstanceData
+    {
+        glm::mat4 modelview,normalmatrix,texturematrix;
+        GLint materialindex;
+        GLint padding[3];
+    };
+
+    /**
+     * DrawBlock of phong-multiple.vert, laid out as std140
+     */
+    struct DrawBlock
+    {
+        glm::vec4 positionscale,positionoffset;
+        GLint octahedralnormals;
+        GLint padding[3];
+        InstanceData instances[MAX_INSTANCES];
+    };
+
+    /**
+     * LightProperties of phong-multiple.frag, laid out as std140
+     */
+    struct LightData
+    {
+        glm::vec4 ambient,diffuse,specular,position,spotdirection;
+        float cosSpotCutoff;
+        float padding[3];
+    };
+
+    /**
+     * LightBlock of phong-multiple.frag, laid out as std140
+     */
+    struct LightBlock
+    {
+        LightData light[MAX_LIGHTS];
+        GLint numLights;
+        GLint padding[3];
+    };
+
+    /**
+     * The handles of what the renderer sets in the shader program, looked up
+     * once when the program is set, so that drawing does not look up any
+     * names. A uniform that a program may leave out is -1 if it does, which
+     * glUniform ignores
+     */
+    struct UniformHandles
+    {
+        int image; //optional
+        GLuint drawBlock,materialBlock,lightBlock;
+
+        UniformHandles()
+        {
+            image = -1;
+            drawBlock = materialBlock = lightBlock = GL_INVALID_INDEX;
+        }
+    };
+    UniformHandles uniforms;
+
+    /**
+     * The uniform buffers that the blocks are written to: one block of
+     * drawBlocks for every mesh drawn and one of lightBlocks every frame, and
+     * every material in use once in materialTable
+     */
+    util::UniformRing drawBlocks,lightBlocks;
+    util::MaterialTable materialTable;
+
+    /**
+     * What a leaf queued by drawMesh is drawn with. Its matrices and material
+     * are at the same index in queuedInstances, and its sort key at that
+     * index in sortItems
+     */
+    struct DrawPacket
+    {
+        util::ObjectInstance *mesh; //the version of the mesh to draw
+        util::TextureImage *texture; //NULL to keep the bound one
+    };
+
+    /**
+     * The render queue of the frame. It is sorted by flushRenderQueue, and
+     * runs of packets with the same mesh and texture are drawn with one
+     * instanced draw call each. The vectors are kept from frame to frame, so
+     * that they do not allocate again
+     */
+    vector<DrawPacket> renderQueue;
+    vector<InstanceData> queuedInstances;
+    vector<util::SortItem> sortItems,sortScratch;
+    SortOrder sortOrder;
+    RenderQueueStats queueStats;
+
+    /**
+     * The view frustum, and whether leaves and subtrees outside it are culled.
+     * worldFrustum is the frustum in the coordinate system of the root of the
+     * scenegraph, which subtrees are tested against. subtreesInside has, for
+     * every subtree being drawn, whether it is known to be wholly inside the
+     * frustum. The boxes of the queued leaves that
+     * must still be tested are in leafBoxes (in view coordinates), with the
+     * index of each one's packet at the same index in leafBoxPackets
+     */
+    util::Frustum frustum,worldFrustum;
+    bool culling;
+    vector<bool> subtreesInside;
+    vector<int> openSubtrees; //the ends of the subtrees entered in a flat scenegraph
+    util::BoxBatch leafBoxes;
+    vector<uint32_t> leafBoxPackets;
+    vector<unsigned char> leafBoxVisible;
+    CullingStats cullingStats;
+
+    /**
+     * The view of the frame being drawn (the top of the modelview stack
+     * passed to draw) and the matrix that transforms normals by it. The
+     * version goes up every time the view changes, so that leaves can tell
+     * whether the matrices they keep are still good
+     */
+    glm::mat4 view;
+    glm::mat3 viewNormalMatrix;
+    unsigned long viewVersion;
+
+    /**
+     * A run of sorted packets drawn with one instanced call: where it starts
+     * in sortItems, how many packets it has, and the offset of its draw block
+     * from the start of the batch of blocks written to drawBlocks
+     */
+    struct DrawRun
+    {
+        size_t first;
+        int count;
+        size_t offset;
+    };
+
+    /**
+     * The runs of the render queue being drawn, kept from frame to frame
+     */
+    vector<DrawRun> drawRuns;
+
     /**
      * A table of shader variables -> vertex attribute names in each mesh
      */
@@ -53,13 +294,48 @@ protected :
 
     /**
      * @brief lights
-     * A vector to store all the lights
+     * The lights of the frame being drawn, in view coordinates. They are
+     * gathered into it again every frame, which keeps its memory
      */
     vector<util::Light> lights;
     /**
-     * A table of renderers for individual meshes
+     * What a mesh is drawn with: its renderer, and coarser versions of it,
+     * finest first, made when the mesh is added
      */
-    map<string, util::ObjectInstance *> meshRenderers;
+    struct MeshEntry
+    {
+        util::ObjectInstance *full;
+        vector<util::ObjectInstance *> lods;
+    };
+
+    /**
+     * The meshes that have been added. Leaves refer to them by their index
+     * in meshes, which is found from their names in meshIds once, when they
+     * are flattened or queued, so that drawing does not look up any names
+     */
+    vector<MeshEntry> meshes;
+    map<string,int> meshIds;
+
+    /**
+     * Goes up every time a mesh or a texture is added, so that what the
+     * names of leaves were resolved to can be told to be out of date
+     */
+    unsigned long resourceVersion;
+
+    /**
+     * The most coarser versions to make of each mesh, and how many pixels a
+     * triangle should cover on screen at least before a coarser version is
+     * drawn
+     */
+    unsigned int lodLevels;
+    float lodPixelsPerTriangle;
+
+    /**
+     * The projection and the height of the viewport in pixels, used to find
+     * how large a mesh appears on screen
+     */
+    glm::mat4 projection;
+    int viewportHeight;
 
     /**
      * A variable tracking whether shader locations have been set. This must be done before
@@ -67,10 +343,54 @@ protected :
      */
     bool shaderLocationsSet;
 
+    /**
+     * The format in which the vertex data of meshes added from now on is
+     * sent to the GPU
+     */
+    util::ObjectInstance::VertexFormat vertexFormat;
+
+    /**
+     * The shared vertex and index buffers that all meshes are put in, one
+     * pair (and one VAO) for every vertex format
+     */
+    util::BufferArenas bufferArenas;
+
+    /**
+     * The VAO and texture bound while drawing, so that meshes from the same
+     * arena or with the same texture do not bind them again
+     */
+    GLuint boundVertexArray;
+    util::TextureImage *boundTexture;
+
 public:
     GLScenegraphRenderer()
     {
         shaderLocationsSet = false;
+        vertexFormat = util::ObjectInstance::FLOAT_VERTICES;
+        lodLevels = 4;
+        lodPixelsPerTriangle = 8.0f;
+        viewportHeight = 0;
+        boundVertexArray = 0;
+        boundTexture = NULL;
+        sortOrder = SORT_BY_STATE;
+        culling = true;
+        viewVersion = 0;
+        resourceVersion = 1;
+    }
+
+    /**
+     * @brief setVertexFormat
+     * Sets the format in which the vertex data of meshes added after this call
+     * is sent to the GPU. util::ObjectInstance::COMPACT_VERTICES is decoded by
+     * the vertex shader with the positionscale, positionoffset and
+     * octahedralnormals members of its DrawBlock (see phong-multiple.vert).
+     *
+     * @param format
+     * The vertex format
+     */
+    void setVertexFormat(util::ObjectInstance::VertexFormat format)
+    {
+        vertexFormat = format;
     }
 
     /**
@@ -92,13 +412,212 @@ public:
 
     }
 
+    /**
+     * @brief setLevelsOfDetail
+     * Sets how many coarser versions are made of meshes added after this call.
+     * Each version has about half the triangles of the one before it.
+     *
+     * @param levels
+     * The most coarser versions to make of a mesh. 0 turns levels of detail off
+     *
+     * @param pixelsPerTriangle
+     * The least number of pixels a triangle of a mesh should cover on screen
+     * before a coarser version of the mesh is drawn instead
+     */
+    void setLevelsOfDetail(unsigned int levels,float pixelsPerTriangle=8.0f)
+    {
+        lodLevels = levels;
+        lodPixelsPerTriangle = pixelsPerTriangle;
+    }
+
+    /**
+     * @brief setProjection
+     * Sets the projection that the scene is drawn with, so that the renderer
+     * can pick a level of detail for each mesh from how large it appears on
+     * screen, and cull what is outside the view frustum. Until this is
+     * called, every mesh is drawn, at full detail.
+     *
+     * @param projection
+     * The projection matrix
+     *
+     * @param viewportHeight
+     * The height of the viewport in pixels
+     */
+    void setProjection(const glm::mat4& projection,int viewportHeight)
+    {
+        this->projection = projection;
+        this->viewportHeight = viewportHeight;
+        frustum = util::Frustum(projection);
+    }
+
+    /**
+     * @brief setCulling
+     * Turns view frustum culling on or off. It is on by default
+     */
+    void setCulling(bool culling)
+    {
+        this->culling = culling;
+    }
+
+    /**
+     * @brief getCullingStats
+     * Returns how many subtrees and leaves were culled in the last frame
+     * drawn, and how many leaves were not
+     */
+    const CullingStats& getCullingStats() const
+    {
+        return cullingStats;
+    }
+
+    /**
+     * @brief getMeshBounds
+     * Gets the bounding box of a mesh that has been added
+     *
+     * @param name
+     * The name of the mesh
+     *
+     * @param minimum,maximum
+     * Receive the corners of the box
+     *
+     * @return
+     * False if no mesh of this name has been added
+     */
+    bool getMeshBounds(const string& name,glm::vec3& minimum,glm::vec3& maximum) const
+    {
+        int mesh = getMeshId(name);
+
+        if (mesh<0)
+            return false;
+        minimum = glm::vec3(meshes[mesh].full->getMinimumBounds());
+        maximum = glm::vec3(meshes[mesh].full->getMaximumBounds());
+        return true;
+    }
+
+    /**
+     * @brief getMeshId
+     * Gets the index by which drawMesh takes a mesh that has been added
+     *
+     * @param name
+     * The name of the mesh
+     *
+     * @return
+     * The index, -1 if no mesh of this name has been added
+     */
+    int getMeshId(const string& name) const
+    {
+        map<string,int>::const_iterator it = meshIds.find(name);
+
+        if (it==meshIds.end())
+            return -1;
+        return it->second;
+    }
+
+    /**
+     * @brief getTexture
+     * Gets the texture that drawMesh is to draw with for a texture name
+     *
+     * @param name
+     * The name of the texture
+     *
+     * @return
+     * The texture, NULL to keep the bound one
+     */
+    util::TextureImage *getTexture(const string& name) const
+    {
+        map<string,util::TextureImage *>::const_iterator it = textures.find(name);
+
+        if (it!=textures.end())
+            return it->second;
+        if ((textures.count("checkerboard")>0) && (textures.count("checkerboard-box")>0))
+        {
+            it = textures.find("red");
+            if (it!=textures.end())
+                return it->second;
+        }
+        return NULL;
+    }
+
+    /**
+     * @brief getResourceVersion
+     * Gets the version of the meshes and textures of this renderer, which
+     * goes up every time one is added. Ids and textures got for names before
+     * it last went up may be out of date
+     */
+    unsigned long getResourceVersion() const
+    {
+        return resourceVersion;
+    }
+
+    /**
+     * @brief enterSubtree
+     * Tests the bounds of a subtree against the view frustum before it is
+     * drawn. Unless this returns false, leaveSubtree must be called once the
+     * subtree is drawn
+     *
+     * @param minimum,maximum
+     * The corners of the bounds of the subtree
+     *
+     * @return
+     * False if the subtree is outside the frustum, and must not be drawn
+     */
+    bool enterSubtree(const glm::vec3& minimum,const glm::vec3& maximum)
+    {
+        bool inside = !culling || (!subtreesInside.empty() && subtreesInside.back());
+
+        if (!inside)
+        {
+            cullingStats.subtreesTested++;
+            util::Frustum::Result result =
+                    worldFrustum.test(0.5f*(minimum+maximum),0.5f*(maximum-minimum));
+            if (result==util::Frustum::OUTSIDE)
+            {
+                cullingStats.subtreesCulled++;
+                return false;
+            }
+            inside = (result==util::Frustum::INSIDE);
+        }
+        subtreesInside.push_back(inside);
+        return true;
+    }
+
+    /**
+     * @brief leaveSubtree
+     * Ends a subtree entered with enterSubtree
+     */
+    void leaveSubtree()
+    {
+        subtreesInside.pop_back();
+    }
+
+    /**
+     * @brief setSortOrder
+     * Sets the order in which the leaves of a frame are drawn
+     *
+     * @param order
+     * The order
+     */
+    void setSortOrder(SortOrder order)
+    {
+        sortOrder = order;
+    }
+
+    /**
+     * @brief getRenderQueueStats
+     * Returns the number of draw calls and binds of the last frame drawn, and
+     * how many sorting it saved
+     */
+    const RenderQueueStats& getRenderQueueStats() const
+    {
+        return queueStats;
+    }
+
     /**
      * @brief getLights
      * Returns all lights contained within this renderer
      * @return
      * A vector of util::Light
      */
-    vector<util::Light> getLights()
+    const vector<util::Light>& getLights() const
     {
         return lights;
     }
@@ -108,17 +627,20 @@ public:
      * Add a mesh to be drawn later. The rendering context should be set before
      * calling this function, as this function needs it to perform its tasks.
      * This function creates a new sgraph::GLMeshRenderer object for this mesh
+     * and puts its vertices and indices in the shared buffers for its vertex
+     * format
      *
      * @param name
      * The name by which this mesh is referred to by the scenegraph
      *
      * @param
      * mesh
-     * The util::PolygonMesh object that represents this mesh
+     * The util::PolygonMesh object that represents this mesh. It is only read
+     * to upload it, and can be released afterwards
      */
     template <class K>
     void addMesh(const string& name,
-                 util::PolygonMesh<K>& mesh) throw(runtime_error)
+                 const util::PolygonMesh<K>& mesh) throw(runtime_error)
     {
         if (!shaderLocationsSet)
             throw runtime_error("Attempting to add mesh before setting shader variables. Call initShaderProgram first");
@@ -128,18 +650,49 @@ public:
         //verify that the mesh has all the vertex attributes as specified in the map
         if (mesh.getVertexCount()<=0)
             return;
-        K vertexData = mesh.getVertexAttributes()[0];
         for (map<string,string>::iterator it=shaderVarsToVertexAttribs.begin();
              it!=shaderVarsToVertexAttribs.end();it++) {
-            if (!vertexData.hasData(it->second))
+            if (util::PolygonMesh<K>::Layout::find(it->second)<0)
                 throw runtime_error("Mesh does not have vertex attribute "+it->second);
         }
         util::ObjectInstance *mr = new util::ObjectInstance(name);
         mr->initPolygonMesh<K>(*glContext,
                             shaderLocations,
                             shaderVarsToVertexAttribs,
-                            mesh);
-        this->meshRenderers[name] = mr;
+                            mesh,
+                            vertexFormat,
+                            &bufferArenas);
+
+        //a mesh added again under the same name keeps its id
+        int id = getMeshId(name);
+        if (id<0)
+        {
+            id = (int)meshes.size();
+            meshIds[name] = id;
+            meshes.push_back(MeshEntry());
+        }
+        MeshEntry& entry = meshes[id];
+        entry.full = mr;
+        entry.lods.clear();
+        resourceVersion++;
+
+        vector<util::PolygonMesh<K> > chain =
+                util::MeshSimplifier<K>::lodChain(mesh,lodLevels);
+        vector<util::ObjectInstance *>& lods = entry.lods;
+        for (size_t i=0;i<chain.size();i++)
+        {
+            //collapses leave holes in the vertex cache order of the mesh
+            util::MeshOptimizer<K>::optimize(chain[i]);
+
+            util::ObjectInstance *lod = new util::ObjectInstance(name);
+            lod->initPolygonMesh<K>(*glContext,
+                                    shaderLocations,
+                                    shaderVarsToVertexAttribs,
+                                    chain[i],
+                                    vertexFormat,
+                                    &bufferArenas);
+            lods.push_back(lod);
+        }
     }
 
     /**
@@ -164,31 +717,105 @@ public:
         im->setMagnificationFilter(QOpenGLTexture::LinearMipMapLinear);
         im->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
         im->setWrapMode(QOpenGLTexture::Repeat);
+        //Qt bound the texture to make it, behind the back of the state cache
+        if (glContext!=NULL)
+            glContext->invalidateTextureBindings();
         textures[name]=image;
+        resourceVersion++;
     }
 
     /**
      * @brief draw
-     * Begin rendering of the scenegraph from the root
+     * Begin rendering of a scenegraph from its flat form. Its nodes are gone
+     * through in the order they are in, which skips the subtree of every
+     * group that is outside the view frustum
      *
-     * @param root
-     * The root node of the scenegraph
+     * @param scene
+     * The flat form of the scenegraph, which is brought up to date first
      *
      * @param modelView
      * The composite transformation applied to the rendered scene
      */
-    void draw(INode *root, stack<glm::mat4>& modelView)
+    void draw(FlatScenegraph& scene, stack<glm::mat4>& modelView)
+    {
+      scene.update(*this);
+      if (scene.getRoot()==NULL)
+        return;
+
+      beginFrame(modelView);
+      scene.getLightsInView(view,lights);
+      initLightsInShader(lights);
+
+      int n = (int)scene.size();
+      int i = 0;
+      openSubtrees.clear();
+      while (i<n)
+        {
+          while (!openSubtrees.empty() && (openSubtrees.back()<=i))
+            {
+              openSubtrees.pop_back();
+              leaveSubtree();
+            }
+
+          if (scene.getType(i)==GROUP)
+            {
+              if (!scene.hasBounds(i)
+                  || !enterSubtree(scene.getBoundsMin(i),scene.getBoundsMax(i)))
+                {
+                  i = scene.getSubtreeEnd(i);
+                  continue;
+                }
+              openSubtrees.push_back(scene.getSubtreeEnd(i));
+            }
+          else if ((scene.getType(i)==LEAF) && (scene.getMeshId(i)>=0))
+            {
+              const glm::mat4 *transformation;
+              const glm::mat3 *normalMatrix;
+
+              scene.getDrawTransforms(i,view,viewNormalMatrix,viewVersion,
+                                      transformation,normalMatrix);
+              drawMesh(scene.getMeshId(i),scene.getMaterial(i),
+                       scene.getTexture(i),scene.getTextureMatrix(i),
+                       *transformation,*normalMatrix);
+            }
+          i++;
+        }
+      while (!openSubtrees.empty())
+        {
+          openSubtrees.pop_back();
+          leaveSubtree();
+        }
+      endFrame();
+    }
+
+    /**
+     * @brief beginFrame
+     * Sets up the state and the view of a frame, before its lights are
+     * passed to the shader and its leaves are drawn
+     */
+    void beginFrame(stack<glm::mat4>& modelView)
     {
       glContext->glEnable(GL_TEXTURE_2D);
       glContext->glActiveTexture(GL_TEXTURE0);
-      int loc = -1;
-      loc = shaderLocations.getLocation("image");
-      if (loc >= 0) {
-        glContext->glUniform1i(loc, 0);
-      }
-      lights = root->getLightsInView(modelView);
-      this->initLightsInShader(lights);
-      root->draw(*this,modelView);
+      glContext->glUniform1i(uniforms.image, 0);
+      glContext->glBindBufferBase(GL_UNIFORM_BUFFER,MATERIAL_BINDING,materialTable.getBuffer());
+      boundVertexArray = 0;
+      boundTexture = NULL;
+      queueStats.reset();
+      cullingStats.reset();
+      subtreesInside.clear();
+      setView(modelView.top());
+    }
+
+    /**
+     * @brief endFrame
+     * Draws what is left in the render queue at the end of a frame
+     */
+    void endFrame()
+    {
+      flushRenderQueue();
+      glContext->glBindVertexArray(0);
+      boundVertexArray = 0;
     }
 
     /**
@@ -209,75 +836,32 @@ public:
 
     /**
      * @brief initLightsInShader
-     * Used to add the lights to the shader
+     * Used to add the lights to the shader. They are written to the light
+     * block of the shader all at once. It has room for MAX_LIGHTS of them,
+     * and those after are left out
      *
      * @param lights
      * A vector of util::Light to pass to the shader
      */
     void initLightsInShader(const vector<util::Light>& lights)
     {
-        int loc = -1;
+        LightBlock block;
 
+        memset(&block, 0, sizeof(block));
+        block.numLights = (GLint)std::min(lights.size(),(size_t)MAX_LIGHTS);
 
-        util::OpenGLFunctions *gl = glContext;
-
-        loc = shaderLocations.getLocation("numLights");
-        if (loc >= 0) {
-          gl->glUniform1i(loc, 2);//lights.size());
-        } else {
-          throw runtime_error("No shader variable for \" numLights \"");
-        }
-
-        for (int i = 0; i < lights.size(); i++)
+        for (int i = 0; i < block.numLights; i++)
           {
-            stringstream str;
-            str << "light[" << i << "].";
-            string name = str.str();
-            loc = shaderLocations.getLocation(name + "ambient");
-            if (loc >= 0) {
-              gl->glUniform3fv(loc, 1, glm::value_ptr(lights[i].getAmbient()));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "ambient" + " \"");
-            }
-
-            loc = shaderLocations.getLocation(name + "diffuse");
-            if (loc >= 0) {
-              gl->glUniform3fv(loc, 1, glm::value_ptr(lights[i].getDiffuse()));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "diffuse" + " \"");
-            }
-
-            loc = shaderLocations.getLocation(name + "specular");
-            if (loc >= 0) {
-              gl->glUniform3fv(loc, 1, glm::value_ptr(lights[i].getSpecular()));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "specular" + " \"");
-            }
-
-            loc = shaderLocations.getLocation(name + "position");
-            if (loc >= 0) {
-              gl->glUniform4fv(loc, 1, glm::value_ptr(lights[i].getPosition()));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "position" + " \"");
-            }
+            LightData& light = block.light[i];
 
-
-            loc = shaderLocations.getLocation(name + "spotdirection");
-            if (loc >= 0) {
-              gl->glUniform4fv(loc, 1, glm::value_ptr(lights[i].getSpotDirection()));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "spotdirection" + " \"");
-            }
-
-            loc = shaderLocations.getLocation(name + "cosSpotCutoff");
-            if (loc >= 0) {
-              gl->glUniform1f(loc, (float) cos(glm::radians(lights[i].getSpotCutoff())));
-            } else {
-              throw runtime_error("No shader variable for \" " + name + "cosSpotCutoff" + " \"");
-            }
+            light.ambient = glm::vec4(lights[i].getAmbient(), 0);
+            light.diffuse = glm::vec4(lights[i].getDiffuse(), 0);
+            light.specular = glm::vec4(lights[i].getSpecular(), 0);
+            light.position = lights[i].getPosition();
+            light.spotdirection = lights[i].getSpotDirection();
+            light.cosSpotCutoff = (float) cos(glm::radians(lights[i].getSpotCutoff()));
         }
-
-
+        lightBlocks.bind(*glContext, LIGHT_BINDING, &block, sizeof(block));
       }
 
 
@@ -287,117 +871,391 @@ public:
      */
     void dispose()
     {
-        for (map<string,util::ObjectInstance *>::iterator it=meshRenderers.begin();
-             it!=meshRenderers.end();it++)
+        for (size_t i=0;i<meshes.size();i++)
           {
-            it->second->cleanup(*glContext);
+            meshes[i].full->cleanup(*glContext);
+            for (size_t j=0;j<meshes[i].lods.size();j++)
+                meshes[i].lods[j]->cleanup(*glContext);
           }
+        //after the meshes, which give their ranges back to the arenas
+        bufferArenas.cleanup(*glContext);
+        drawBlocks.cleanup(*glContext);
+        lightBlocks.cleanup(*glContext);
+        materialTable.cleanup(*glContext);
+        renderQueue.clear();
+        queuedInstances.clear();
+        sortItems.clear();
+        leafBoxes.clear();
+        leafBoxPackets.clear();
     }
 
     /**
      * @brief drawMesh
-     * Draws a specific mesh. If the mesh has been added to this renderer, it
-     * delegates to its corresponding mesh renderer. This function first passes
-     * the material to the shader.
+     * Draws a mesh that has been added to this renderer. The mesh is only put
+     * in the render queue here, with its material and transformations, and
+     * drawn by flushRenderQueue.
      *
-     * @param name
-     * The name of the mesh to draw
+     * @param mesh
+     * The id of the mesh to draw (see getMeshId)
      *
      * @param material
      * The material to be applied to the mesh during rendering
      *
-     * @param textureName
-     * The name of the texture to be applied to the mesh during rendering
+     * @param texture
+     * The texture to be applied to the mesh during rendering (see getTexture)
      *
      * @param textureMatrix
      * The texture matrix associated with this leaf node
      *
      * @param transformation
      * The current transformation applied to this mesh (from modelview)
+     *
+     * @param normalMatrix
+     * The transformation applied to the normals of this mesh
      */
-    void drawMesh(const string& name,
+    void drawMesh(int mesh,
                   const util::Material& material,
-                  const string& textureName,
+                  util::TextureImage *texture,
                   const glm::mat4& textureMatrix,
-                  const glm::mat4& transformation)
+                  const glm::mat4& transformation,
+                  const glm::mat3& normalMatrix)
     {
-        if (meshRenderers.count(name)==1)
+        InstanceData instance;
+
+        instance.modelview = transformation;
+        instance.normalmatrix = glm::mat4(normalMatrix);
+        instance.texturematrix = textureMatrix;
+        instance.materialindex = materialTable.indexOf(*glContext,material);
+        if (instance.materialindex<0)
         {
-            int loc = shaderLocations.getLocation("material.ambient");
-            //set the ambient
-            if (loc<0)
-                throw runtime_error("No shader variable for \" material.ambient \"");
+            //the queued leaves need the table as it is
+            flushRenderQueue();
+            materialTable.startOver();
+            instance.materialindex = materialTable.indexOf(*glContext,material);
+        }
+        instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
 
-            glContext->glUniform3fv(loc,1,glm::value_ptr(material.getAmbient()));
+        DrawPacket packet;
+        packet.mesh = chooseLevelOfDetail(meshes[mesh],transformation);
+        packet.texture = texture;
 
-            loc = shaderLocations.getLocation("material.diffuse");
-            //set the diffuse
-            if (loc<0)
-                throw runtime_error("No shader variable for \" material.diffuse \"");
+        util::SortItem item;
+        item.key = sortKey(packet,-transformation[3][2]);
+        item.index = (uint32_t)renderQueue.size();
 
-            glContext->glUniform3fv(loc,1,glm::value_ptr(material.getDiffuse()));
+        //the leaf is tested against the frustum with the rest of the
+        //queue, unless it is in a subtree wholly inside it
+        if (culling && (subtreesInside.empty() || !subtreesInside.back()))
+        {
+            glm::vec3 center,extent;
 
-            loc = shaderLocations.getLocation("material.specular");
-            //set the specular
-            if (loc<0)
-                throw runtime_error("No shader variable for \" material.specular \"");
+            util::Frustum::transformBox(transformation,
+                                        glm::vec3(packet.mesh->getMinimumBounds()),
+                                        glm::vec3(packet.mesh->getMaximumBounds()),
+                                        center,extent);
+            leafBoxes.add(center,extent);
+            leafBoxPackets.push_back(item.index);
+        }
 
-            glContext->glUniform3fv(loc,1,glm::value_ptr(material.getSpecular()));
+        renderQueue.push_back(packet);
+        queuedInstances.push_back(instance);
+        sortItems.push_back(item);
+    }
 
-            loc = shaderLocations.getLocation("material.shininess");
-            //set the shininess
-            if (loc<0)
-                throw runtime_error("No shader variable for \" material.shininess \"");
+    /**
+     * @brief flushRenderQueue
+     * Culls the leaves queued by drawMesh, sorts the rest in the sort order
+     * and draws them, one instanced draw call for every run of at most
+     * MAX_INSTANCES leaves that share a mesh and a texture. The draw blocks
+     * of all the runs are written to drawBlocks at once, before the first of
+     * them is drawn, so that each draw only binds its own
+     */
+    void flushRenderQueue()
+    {
+        cullRenderQueue();
+        countUnsortedStateChanges();
+        util::radixSort(sortItems,sortScratch);
+
+        size_t i = 0;
+        drawRuns.clear();
+        while (i<sortItems.size())
+        {
+            const DrawPacket& packet = renderQueue[sortItems[i].index];
+            util::ObjectInstance *mr = packet.mesh;
+            DrawRun run;
+
+            run.first = i;
+            run.count = 0;
+            while ((i+run.count<sortItems.size()) && (run.count<MAX_INSTANCES))
+            {
+                const DrawPacket& next = renderQueue[sortItems[i+run.count].index];
+                if ((next.mesh!=mr) || (next.texture!=packet.texture))
+                    break;
+                run.count++;
+            }
+            i += run.count;
+
+            //the whole block is bound even if only part of it is written
+            DrawBlock *block = (DrawBlock *)drawBlocks.stage(offsetof(DrawBlock,instances)
+                                                             +run.count*sizeof(InstanceData),
+                                                             sizeof(DrawBlock),
+                                                             run.offset);
+
+            //how the vertex shader gets back the vertex data of this mesh
+            bool compact = (mr->getVertexFormat()==util::ObjectInstance::COMPACT_VERTICES);
+            block->positionscale = mr->getPositionScale();
+            block->positionoffset = mr->getPositionOffset();
+            block->octahedralnormals = compact?1:0;
+            block->padding[0] = block->padding[1] = block->padding[2] = 0;
+            for (int k=0;k<run.count;k++)
+                block->instances[k] = queuedInstances[sortItems[run.first+k].index];
+            drawRuns.push_back(run);
+        }
+        size_t base = drawBlocks.upload(*glContext);
+
+        for (size_t r=0;r<drawRuns.size();r++)
+        {
+            const DrawRun& run = drawRuns[r];
+            const DrawPacket& packet = renderQueue[sortItems[run.first].index];
+            util::ObjectInstance *mr = packet.mesh;
 
-            glContext->glUniform1f(loc,material.getShininess());
+            if ((packet.texture!=NULL) && (packet.texture!=boundTexture))
+              {
+                boundTexture = packet.texture;
+                glContext->glBindTexture(GL_TEXTURE_2D,boundTexture->getTexture()->textureId());
+                queueStats.textureBinds++;
+              }
+            if (mr->getVertexArray()!=boundVertexArray)
+              {
+                boundVertexArray = mr->getVertexArray();
+                glContext->glBindVertexArray(boundVertexArray);
+                queueStats.vertexArrayBinds++;
+              }
 
+            drawBlocks.bindRange(*glContext,DRAW_BINDING,base+run.offset,sizeof(DrawBlock));
+            mr->drawElementsInstanced(*glContext,run.count);
+            queueStats.drawCalls++;
+        }
+        queueStats.packets += renderQueue.size();
+        cullingStats.leavesVisible += renderQueue.size();
+        renderQueue.clear();
+        queuedInstances.clear();
+        sortItems.clear();
+    }
 
-            loc = shaderLocations.getLocation("modelview");
-            if (loc<0)
-                throw runtime_error("No shader variable for \" modelview \"");
+protected:
+    /**
+     * @brief resolveUniformHandles
+     * Looks up the uniforms and the uniform blocks that the renderer sets in
+     * the given program, checks that the program has the ones it must have,
+     * and binds the blocks to their binding points
+     *
+     * @param program
+     * The shader program, whose variables are in the current shader locations
+     */
+    void resolveUniformHandles(GLuint program) throw(runtime_error)
+    {
+        uniforms.image = shaderLocations.getLocation("image");
+        uniforms.drawBlock = requiredBlock(program,"DrawBlock",DRAW_BINDING);
+        uniforms.materialBlock = requiredBlock(program,"MaterialBlock",MATERIAL_BINDING);
+        uniforms.lightBlock = requiredBlock(program,"LightBlock",LIGHT_BINDING);
+    }
 
-            glContext->glUniformMatrix4fv(loc,
-                                  1,
-                                  false,glm::value_ptr(transformation));
+    GLuint requiredBlock(GLuint program,const string& name,GLuint binding) throw(runtime_error)
+    {
+        GLuint index = glContext->glGetUniformBlockIndex(program,name.c_str());
 
-            loc = shaderLocations.getLocation("normalmatrix");
-            if (loc<0)
-                throw runtime_error("No shader variable for \" normalmatrix \"");
-            glm::mat4 normalmatrix = glm::inverse(glm::transpose(transformation));
+        if (index==GL_INVALID_INDEX)
+            throw runtime_error("No uniform block \" "+name+" \"");
+        glContext->glUniformBlockBinding(program,index,binding);
+        return index;
+    }
 
-            glContext->glUniformMatrix4fv(loc,
-                                  1,
-                                  false,glm::value_ptr(normalmatrix));
+    /**
+     * @brief sortKey
+     * The key that a packet is sorted by. The state part has the VAO, the
+     * texture and the first index of the mesh (which tells meshes in the
+     * same arena apart), cut down to 8, 12 and 20 bits. Keys of different
+     * states may be equal that way, which only makes the packets less likely
+     * to be drawn together. The depth part has the top 24 bits of the depth
+     * as a float, which sort the same way as the depths themselves
+     *
+     * @param packet
+     * The packet
+     *
+     * @param depth
+     * How far in front of the eye the packet is
+     */
+    uint64_t sortKey(const DrawPacket& packet,float depth) const
+    {
+        uint64_t texture = (packet.texture!=NULL)?packet.texture->getTexture()->textureId():0;
+        uint64_t state = ((uint64_t)(packet.mesh->getVertexArray()&0xff)<<32)
+                | ((texture&0xfff)<<20)
+                | ((packet.mesh->getFirstIndex()/3)&0xfffff);
+        uint32_t depthBits;
 
-            //glm::mat4 t = glm::mat4(1.0f);
-            //t *= glm::scale(glm::mat4(1.0f), glm::vec3(1.1f, 1.1f, 1.1f));
-            loc = shaderLocations.getLocation("texturematrix");
-            if (loc<0)
-                throw runtime_error("No shader variable for \" texturematrix \"");
-            glContext->glUniformMatrix4fv(loc,
-                                  1,
-                                  false,glm::value_ptr(textureMatrix));
+        depth = std::max(depth,0.0f);
+        memcpy(&depthBits,&depth,sizeof(depthBits));
+        depthBits >>= 8;
 
+        if (sortOrder==SORT_FRONT_TO_BACK)
+            return ((uint64_t)depthBits<<40) | state;
+        return (state<<24) | depthBits;
+    }
 
-            if (textures.count(textureName)>0)
-              textures[textureName]->getTexture()->bind();
-            else if (textures.count("checkerboard")>0 && textures.count("checkerboard-box")>0)
+    /**
+     * @brief setView
+     * Sets the view of the frame to be drawn, and finds what depends on it
+     * again if it has changed
+     */
+    void setView(const glm::mat4& view)
+    {
+        if ((viewVersion==0) || (view!=this->view))
+        {
+            this->view = view;
+            viewNormalMatrix = glm::inverseTranspose(glm::mat3(view));
+            viewVersion++;
+        }
+        //the projection may have changed even if the view has not
+        worldFrustum = frustum.transformed(view);
+    }
+
+    /**
+     * @brief cullRenderQueue
+     * Tests the boxes of the queued leaves against the frustum all at once,
+     * and takes the leaves outside it out of the queue
+     */
+    void cullRenderQueue()
+    {
+        if (leafBoxes.size()==0)
+            return;
+
+        size_t visible = leafBoxes.cull(frustum,leafBoxVisible);
+        cullingStats.leavesTested += leafBoxes.size();
+        cullingStats.leavesCulled += leafBoxes.size()-visible;
+
+        if (visible<leafBoxes.size())
+        {
+            //mark the culled packets by their mesh, then close up the gaps
+            for (size_t i=0;i<leafBoxPackets.size();i++)
             {
-                if(name != "box")
-                    textures["red"]->getTexture()->bind();
-                else
-                    textures["red"]->getTexture()->bind();
+                if (!leafBoxVisible[i])
+                    renderQueue[leafBoxPackets[i]].mesh = NULL;
             }
 
-            meshRenderers[name]->draw(*glContext);
+            size_t kept = 0;
+            for (size_t i=0;i<renderQueue.size();i++)
+            {
+                if (renderQueue[i].mesh==NULL)
+                    continue;
+                renderQueue[kept] = renderQueue[i];
+                queuedInstances[kept] = queuedInstances[i];
+                sortItems[kept].key = sortItems[i].key;
+                sortItems[kept].index = (uint32_t)kept;
+                kept++;
+            }
+            renderQueue.resize(kept);
+            queuedInstances.resize(kept);
+            sortItems.resize(kept);
         }
+        leafBoxes.clear();
+        leafBoxPackets.clear();
     }
 
+    /**
+     * @brief countUnsortedStateChanges
+     * Adds the draw calls and binds that drawing the render queue in the
+     * order it was filled in would take to the stats
+     */
+    void countUnsortedStateChanges()
+    {
+        const DrawPacket *previous = NULL;
+        util::TextureImage *texture = boundTexture;
+        GLuint vertexArray = boundVertexArray;
+        int run = 0;
 
+        for (size_t i=0;i<renderQueue.size();i++)
+        {
+            const DrawPacket& packet = renderQueue[i];
+
+            if ((previous==NULL) || (packet.mesh!=previous->mesh)
+                    || (packet.texture!=previous->texture) || (run==MAX_INSTANCES))
+            {
+                queueStats.unsortedDrawCalls++;
+                run = 0;
+            }
+            run++;
+            if ((packet.texture!=NULL) && (packet.texture!=texture))
+            {
+                texture = packet.texture;
+                queueStats.unsortedTextureBinds++;
+            }
+            if (packet.mesh->getVertexArray()!=vertexArray)
+            {
+                vertexArray = packet.mesh->getVertexArray();
+                queueStats.unsortedVertexArrayBinds++;
+            }
+            previous = &packet;
+        }
+    }
+
+    /**
+     * @brief chooseLevelOfDetail
+     * Picks the coarsest version of a mesh whose triangles still cover at most
+     * lodPixelsPerTriangle pixels each, judging the size of the mesh on screen
+     * from the sphere around its bounding box
+     *
+     * @param entry
+     * The mesh
+     *
+     * @param transformation
+     * The modelview transformation the mesh is drawn with
+     */
+    util::ObjectInstance *chooseLevelOfDetail(const MeshEntry& entry,
+                                              const glm::mat4& transformation)
+    {
+        util::ObjectInstance *full = entry.full;
+
+        if (entry.lods.empty() || (viewportHeight<=0))
+            return full;
+
+        glm::vec4 minimum = full->getMinimumBounds();
+        glm::vec4 maximum = full->getMaximumBounds();
+        glm::vec4 center = transformation * glm::vec4(glm::vec3(minimum+maximum)*0.5f,1.0f);
+        float scale = std::max(glm::length(glm::vec3(transformation[0])),
+                               std::max(glm::length(glm::vec3(transformation[1])),
+                                        glm::length(glm::vec3(transformation[2]))));
+        float radius = 0.5f*scale*glm::length(glm::vec3(maximum-minimum));
+
+        //radius in pixels, for a perspective or an orthographic projection
+        float pixels = radius*projection[1][1]*0.5f*viewportHeight;
+        if (projection[2][3]!=0.0f)
+        {
+            float depth = -center.z;
+            if (depth<=radius)
+                return full;
+            pixels /= depth;
+        }
+
+        float triangles = 3.14159265f*pixels*pixels/lodPixelsPerTriangle;
+        util::ObjectInstance *chosen = full;
+        for (size_t i=0;i<entry.lods.size();i++)
+        {
+            if (entry.lods[i]->getPrimitiveCount()/3<triangles)
+                break;
+            chosen = entry.lods[i];
+        }
+        return chosen;
+    }
+
+public:
     /**
      * @brief initShaderProgram
      * Queries the shader program for all variables and locations then adds
-     * them to the renderer
+     * them to the renderer. The uniforms and uniform blocks that the renderer
+     * sets are looked up here once, so this throws if the program lacks one
+     * that it needs. This also makes the uniform buffers that the blocks are
+     * read from
      *
      * @param shaderProgram
      * The shader program we are querying
@@ -413,6 +1271,11 @@ public:
           throw runtime_error("No context set");
 
         shaderLocations = shaderProgram.getAllShaderVariables(*glContext);
+        resolveUniformHandles(shaderProgram.getProgram());
+        //room for a few hundred draws before the ring starts over
+        drawBlocks.init(*glContext,1<<22);
+        lightBlocks.init(*glContext,64*sizeof(LightBlock));
+        materialTable.init(*glContext);
         this->shaderVarsToVertexAttribs = shaderVarsToVertexAttribs;
         shaderLocationsSet = true;
 
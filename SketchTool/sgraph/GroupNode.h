@@ -3,6 +3,8 @@
 
 #include "OpenGLFunctions.h"
 #include "AbstractNode.h"
+#include "FlatScenegraph.h"
+#include "ObjectPool.h"
 #include "glm/glm.hpp"
 #include "Light.h"
 #include <vector>
@@ -27,6 +29,11 @@ namespace sgraph
     vector<INode *> children;
 
   public:
+    /**
+     * Groups are taken from a pool of their own (see util::ObjectPool)
+     */
+    UTIL_POOLED_ALLOCATION(GroupNode)
+
     GroupNode(sgraph::Scenegraph *graph,const string& name)
       :AbstractNode(graph,name)
     {
@@ -47,7 +54,9 @@ namespace sgraph
      */
     void clearChildren() throw(runtime_error)
     {
+        willChange();
         children.clear();
+        scenegraph->structureChanged();
     }
 
     /**
@@ -129,24 +138,28 @@ namespace sgraph
     }
 
     /**
-     * @brief draw
-     * To draw this node, we simply delegate drawing to each of its children
+     * @brief flatten
+     * Adds this node and then the subtrees of its children to the flat form
+     * of the scenegraph, followed by the lights of this node
      *
-     * @param context
-     * The generic renderer context sgraph::IScenegraphRenderer
+     * @param flat
+     * The flat form of the scenegraph
      *
-     * @param modelView
-     * The stack of modelview matrices (current transformation applied to node)
+     * @param parent
+     * The index of the parent of this node in it, -1 for the root
      */
-    void draw(GLScenegraphRenderer& context,stack<glm::mat4>& modelView)
+    void flatten(FlatScenegraph& flat,int parent)
     {
+      int index = flat.addNode(this,GROUP,parent,glm::mat4(1.0f));
+
       for (int i=0;i<children.size();i++)
         {
-          children[i]->draw(context,modelView);
+          children[i]->flatten(flat,index);
         }
+      flat.endSubtree(index);
+      flat.addLights(index,getLights());
     }
 
-
     /**
      * @brief saveToXML
      * Used to save XML for this node to the specified output file. Recursively
@@ -184,12 +197,14 @@ namespace sgraph
     {
       vector<INode *> newc;
 
+      newc.reserve(children.size());
       for (int i=0;i<children.size();i++)
         {
           newc.push_back(children[i]->clone());
         }
 
       GroupNode *newgroup = new GroupNode(scenegraph,name);
+      newgroup->children.reserve(newc.size());
 
       for (int i=0;i<children.size();i++)
         {
@@ -202,6 +217,7 @@ namespace sgraph
 
           }
         }
+      copyLightsTo(newgroup);
       return newgroup;
     }
 
@@ -214,8 +230,10 @@ namespace sgraph
      */
     void addChild(INode *child) throw(runtime_error)
     {
+      willChange();
       children.push_back(child);
       child->setParent(this);
+      scenegraph->structureChanged();
     }
 
     /**
@@ -230,39 +248,6 @@ namespace sgraph
       return children;
     }
 
-    /**
-     * @brief getLightsInView
-     * Overridden version of @link{AbstractNode}. This version first collects
-     * all the lights from its children, and then appends to them the lights
-     * from this node as well. This function uses the original version to
-     * get the lights in this node.
-     *
-     * @param modelview
-     * The stack of transformations currently applied to this node
-     *
-     * @return
-     * A vector containing the lights currently in the view
-     */
-    vector<util::Light> getLightsInView(stack<glm::mat4>& modelview)
-    {
-      vector<util::Light> lights,templights;
-      for (unsigned int i = 0; i < children.size(); i++)
-        {
-          templights = children[i]->getLightsInView(modelview);
-          for (unsigned int j=0;j<templights.size();j++)
-            {
-              lights.push_back(templights[j]);
-            }
-        }
-      //now get the lights from this node's lights
-      templights = AbstractNode::getLightsInView(modelview);
-      for (unsigned int i=0;i<templights.size();i++)
-        {
-          lights.push_back(templights[i]);
-        }
-      return lights;
-    }
-
     /**
      * @brief getNodeType
      * Returns the type associated with this node - GROUP in this case
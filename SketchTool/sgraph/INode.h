@@ -16,7 +16,7 @@ using namespace std;
 namespace sgraph
 {
   class Scenegraph;
-  class GLScenegraphRenderer;
+  class FlatScenegraph;
 
   enum NodeType{
       GROUP,
@@ -60,23 +60,6 @@ namespace sgraph
 
     virtual ~INode(){}
 
-    /**
-     * Draw the scene graph rooted at this node, using the modelview stack and context
-     * \param context the generic renderer context {@link sgraph.IScenegraphRenderer}
-     * \param modelView the stack of modelview matrices
-     */
-    /**
-     * @brief draw
-     * Draw the scenegraph rooted at this node, using the modelview and context
-     *
-     * @param context
-     * The generic renderer context {@link sgraph.IScenegraphRenderer}
-     *
-     * @param modelView
-     * The stack of modelview transformations applied to this node
-     */
-    virtual void draw(GLScenegraphRenderer& context,stack<glm::mat4>& modelView)=0;\
-
     /**
      * @brief clone
      * Returns a deep copy of the scenegraph subtree rooted at this node
@@ -198,20 +181,26 @@ namespace sgraph
     virtual void clearChildren()=0;
 
     /**
-     * @brief getLightsInView
-     * Return a list of all lights in this scenegraph in the view coordinate
-     * system. This function is called on the root of the scenegraph. It is
-     * assumed that the modelview.top() is set to the world-to-view
-     * transformation
+     * @brief flatten
+     * Adds this node and then its subtree to the flat form of the scenegraph,
+     * in depth-first order
      *
-     * @param modelview
-     * The stack of transformations applied to the scenegraph
+     * @param flat
+     * The flat form of the scenegraph
      *
-     * @return
-     * A vector containing all the lights in the scenegraphs view coordinate
-     * system
+     * @param parent
+     * The index of the parent of this node in it, -1 for the root
+     */
+    virtual void flatten(FlatScenegraph& flat,int parent)=0;
+
+    /**
+     * @brief unshare
+     * Gives this node a copy of its own of the subtree it shares with other
+     * places in the scenegraph, if it does (see sgraph::InstanceNode), so
+     * that the subtree can be changed without changing them. Called by the
+     * scenegraph just before a node in the subtree is changed
      */
-    virtual vector<util::Light> getLightsInView(stack<glm::mat4>& modelview)=0;
+    virtual void unshare()=0;
 
     /**
      * @brief saveToXML
@@ -0,0 +1,238 @@
+#ifndef _INSTANCENODE_H_
+#define _INSTANCENODE_H_
+
+#include "GroupNode.h"
+#include "FlatScenegraph.h"
+#include "ObjectPool.h"
+#include "glm/glm.hpp"
+#include <vector>
+#include <stack>
+#include <string>
+using namespace std;
+
+namespace sgraph
+{
+  /**
+ * A group that draws a subtree from elsewhere in the scenegraph as if it were
+ * its first child, without copying it. This is what a group that is a copy
+ * of another one is made as, so that many copies of a subtree take the memory
+ * of one. The copies are placed by the transforms above them, and may have
+ * children of their own after the shared subtree.
+ *
+ * The shared subtree stays where it is in the tree, and its nodes have their
+ * parents there. When a node in it is about to change, every instance that
+ * shares it is given a copy of its own first (see Scenegraph::nodeWillChange),
+ * so that what the instances draw does not change with it.
+ */
+  class InstanceNode:public GroupNode
+  {
+
+  protected:
+    /**
+     * The root of the subtree this node draws, NULL once it has a copy of its
+     * own
+     */
+    INode *shared;
+
+  public:
+    /**
+     * Instances are taken from a pool of their own (see util::ObjectPool)
+     */
+    UTIL_POOLED_ALLOCATION(InstanceNode)
+
+    /**
+     * @brief InstanceNode
+     * Makes a group that shares a subtree
+     *
+     * @param graph
+     * The scenegraph to which this node belongs
+     *
+     * @param name
+     * The name of this node
+     *
+     * @param source
+     * The root of the subtree it shares. It must not be an ancestor of this
+     * node
+     */
+    InstanceNode(sgraph::Scenegraph *graph,const string& name,INode *source)
+      :GroupNode(graph,name)
+    {
+      shared = source;
+      scenegraph->addInstance(shared,this);
+    }
+
+    ~InstanceNode()
+    {
+      if (shared!=NULL)
+        scenegraph->removeInstance(shared,this);
+    }
+
+    /**
+     * @brief getShared
+     * Gets the root of the subtree this node shares
+     *
+     * @return
+     * The root, or NULL if this node has a copy of its own
+     */
+    INode *getShared()
+    {
+      return shared;
+    }
+
+    /**
+     * @brief unshare
+     * Gives this node a copy of the subtree it shares, as its first child
+     */
+    void unshare()
+    {
+      if (shared==NULL)
+        return;
+
+      //this node is about to change, which may be in a subtree shared in turn
+      willChange();
+
+      INode *source = shared;
+      INode *copy = source->clone();
+
+      scenegraph->removeInstance(source,this);
+      shared = NULL;
+      children.insert(children.begin(),copy);
+      copy->setParent(this);
+      //the nodes of the copy were added to the index of names last, so the
+      //ones it was copied from are added again to be found by them
+      source->setScenegraph(scenegraph);
+      scenegraph->structureChanged();
+    }
+
+    /**
+     * @brief getNode
+     * Searches this node's subtree, and the subtree it shares, for a node with
+     * the specified name. A node in the shared subtree is returned as it is:
+     * changing it gives the instances copies of their own first
+     *
+     * @param name
+     * The name of the node to be found
+     *
+     * @return
+     * Node with specified name, null if node not found
+     */
+    INode *getNode(const string& name)
+    {
+      INode *n = AbstractNode::getNode(name);
+      if (n!=NULL)
+        {
+          return n;
+        }
+
+      if (shared!=NULL)
+        {
+          n = shared->getNode(name);
+          if (n!=NULL)
+            {
+              return n;
+            }
+        }
+      return GroupNode::getNode(name);
+    }
+
+    /**
+     * @brief setScenegraph
+     * Sets the reference to the scenegraph object for this node and its
+     * children. A node that is moved to another scenegraph takes a copy of
+     * the subtree it shares along
+     *
+     * @param graph
+     * The reference to the scenegraph object
+     */
+    void setScenegraph(sgraph::Scenegraph *graph)
+    {
+      if ((shared!=NULL) && (graph!=scenegraph))
+        unshare();
+      GroupNode::setScenegraph(graph);
+    }
+
+    /**
+     * @brief flatten
+     * Adds this node, the shared subtree and then the subtrees of its children
+     * to the flat form of the scenegraph, followed by the lights of this node.
+     * The shared subtree is added once for every place it is drawn in
+     *
+     * @param flat
+     * The flat form of the scenegraph
+     *
+     * @param parent
+     * The index of the parent of this node in it, -1 for the root
+     */
+    void flatten(FlatScenegraph& flat,int parent)
+    {
+      int index = flat.addNode(this,GROUP,parent,glm::mat4(1.0f));
+
+      if (shared!=NULL)
+        shared->flatten(flat,index);
+      for (int i=0;i<children.size();i++)
+        {
+          children[i]->flatten(flat,index);
+        }
+      flat.endSubtree(index);
+      flat.addLights(index,getLights());
+    }
+
+    /**
+     * @brief saveToXML
+     * Saves this node as a group with the shared subtree written out in full
+     * as its first child, followed by its children. Names need not be unique,
+     * so a copyof attribute could name another node when the file is read
+     *
+     * @param output_file
+     * The file to which the generated XML is saved
+     */
+    void saveToXML(fstream& output_file)
+    {
+        if (shared==NULL)
+        {
+            GroupNode::saveToXML(output_file);
+            return;
+        }
+
+        if(name == "")
+            output_file << "<group>" << endl;
+        else
+        {
+            string tag_string = "<group name=\"" + name + "\">";
+            output_file << tag_string << endl;
+        }
+        shared->saveToXML(output_file);
+        for(int i=0; i < children.size(); i++)
+        {
+            children[i]->saveToXML(output_file);
+        }
+        output_file << "</group>" << endl;
+    }
+
+    /**
+     * @brief clone
+     * Makes another instance of the same subtree, with copies of the children
+     * of this node
+     *
+     * @return
+     * The copy
+     */
+    INode *clone()
+    {
+      if (shared==NULL)
+        return GroupNode::clone();
+
+      InstanceNode *newinstance = new InstanceNode(scenegraph,name,shared);
+      newinstance->children.reserve(children.size());
+
+      for (int i=0;i<children.size();i++)
+        {
+          newinstance->addChild(children[i]->clone());
+        }
+      copyLightsTo(newinstance);
+      return newinstance;
+    }
+  };
+}
+
+#endif
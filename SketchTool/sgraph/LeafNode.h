@@ -2,6 +2,8 @@
 #define _LEAFNODE_H_
 
 #include "AbstractNode.h"
+#include "FlatScenegraph.h"
+#include "ObjectPool.h"
 #include "OpenGLFunctions.h"
 #include "Material.h"
 #include "glm/glm.hpp"
@@ -26,7 +28,7 @@ protected:
      * The name of the object instance that this leaf contains. All object instances are stored
      * in the scene graph itself, so that an instance can be reused in several leaves
      */
-    string objInstanceName;
+    util::InternedString objInstanceName;
 
     /**
      * The material associated with the object instance at this leaf
@@ -36,9 +38,7 @@ protected:
     /**
      * The name of the texture associated with the object instance at tbis leaf
      */
-    string textureName;
-
-    string previous_tex_name;
+    util::InternedString textureName;
 
     /**
      * @brief texture_matrix
@@ -47,12 +47,22 @@ protected:
     glm::mat4 texture_matrix = glm::mat4(1.0f);
 
     /**
-     * @brief modelview_for_drawing
-     * The modelview of this node at the time of drawing.
+     * @brief leafChanged
+     * Passes a change to what this leaf is drawn with on to the flat form of
+     * the scenegraph
      */
-    glm::mat4 modelview_for_drawing = glm::mat4(1.0f);
+    void leafChanged()
+    {
+        if (objInstanceName.length()>0)
+            scenegraph->leafChanged(this,objInstanceName,material,textureName,texture_matrix);
+    }
 
 public:
+    /**
+     * Leaves are taken from a pool of their own (see util::ObjectPool)
+     */
+    UTIL_POOLED_ALLOCATION(LeafNode)
+
     LeafNode(const string& instanceOf,sgraph::Scenegraph *graph,const string& name)
         :AbstractNode(graph,name)
     {
@@ -71,7 +81,9 @@ public:
      */
     void setMaterial(const util::Material& mat) throw(runtime_error)
     {
+        willChange();
         material = mat;
+        leafChanged();
     }
 
     /**
@@ -83,7 +95,9 @@ public:
      */
     void setTextureName(const string& name) throw(runtime_error)
     {
+        willChange();
         textureName = name;
+        leafChanged();
     }
 
     /**
@@ -95,7 +109,9 @@ public:
      */
     void setTextureMatrix(const glm::mat4& mat) throw(runtime_error)
     {
+        willChange();
         texture_matrix = mat;
+        leafChanged();
     }
 
     /**
@@ -122,18 +138,6 @@ public:
         return material;
     }
 
-    /**
-     * @brief getModelviewForDrawing
-     * Gets this node's modelview matrix at the time of drawing
-     *
-     * @return
-     * The modelview matrix for this node at the time of drawing
-     */
-    glm::mat4& getModelviewForDrawing()
-    {
-        return modelview_for_drawing;
-    }
-
     /**
      * @brief clone
      * Makes a copy of this leaf node
@@ -145,32 +149,30 @@ public:
     {
         LeafNode *newclone = new LeafNode(this->objInstanceName,scenegraph,name);
         newclone->setMaterial(this->getMaterial());
+        newclone->textureName = textureName;
+        newclone->texture_matrix = texture_matrix;
+        copyLightsTo(newclone);
         return newclone;
     }
 
     /**
-     * @brief draw
-     * Delegates to the scenegraph for rendering. This has two advantages:
-     *  1. It keeps the leaf light
-     *  2. It abstracts the actual drawing to the specific implementation of
-     *     the scenegraph renderer
+     * @brief flatten
+     * Adds this leaf, with what it is drawn with and its lights, to the flat
+     * form of the scenegraph
      *
-     * @param context
-     * The generic renderer context {@link sgraph::IScenegraphRenderer}
+     * @param flat
+     * The flat form of the scenegraph
      *
-     * @param modelView
-     * The stack of modelview matrices
+     * @param parent
+     * The index of the parent of this node in it, -1 for the root
      */
-    void draw(GLScenegraphRenderer& context,stack<glm::mat4>& modelView) throw(runtime_error)
+    void flatten(FlatScenegraph& flat,int parent)
     {
-        if (objInstanceName.length()>0)
-        {
-            //Save modelview for reference
-            modelview_for_drawing = modelView.top();
+        int index = flat.addNode(this,LEAF,parent,glm::mat4(1.0f));
 
-            //Draw object
-            context.drawMesh(objInstanceName,material,textureName,texture_matrix,modelView.top());
-        }
+        if (objInstanceName.length()>0)
+            flat.setLeaf(index,objInstanceName,material,textureName,texture_matrix);
+        flat.addLights(index,getLights());
     }
 
 
@@ -256,8 +258,10 @@ public:
      */
     void changeNodeTexture(const string& texture_name) throw(runtime_error)
     {
-        previous_tex_name = textureName;
+        willChange();
+        getColdData().savedTexture = textureName;
         textureName = texture_name;
+        leafChanged();
     }
 
     /**
@@ -266,9 +270,12 @@ public:
      */
     void revertNodeTexture() throw(runtime_error)
     {
-        string temp = previous_tex_name;
-        previous_tex_name = textureName;
+        willChange();
+        ColdData& saved = getColdData();
+        util::InternedString temp = saved.savedTexture;
+        saved.savedTexture = textureName;
         textureName = temp;
+        leafChanged();
     }
 
     /**
@@ -0,0 +1,343 @@
+#ifndef _NODEINDEX_H_
+#define _NODEINDEX_H_
+
+#include "INode.h"
+#include "InternedString.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+using namespace std;
+
+namespace sgraph
+{
+
+/**
+ * An index of the nodes of a scenegraph by name. Every name is interned (see
+ * util::InternedString, which the nodes keep their names as too) and given
+ * an id the first time it is seen, and the index keeps the nodes by id.
+ * Finding a node by name is two hash lookups, and the names are also
+ * kept in sorted order (put together again only after names have changed)
+ * for finding all the nodes whose names start with a prefix or match a
+ * wildcard pattern.
+ *
+ * Names are not guaranteed to be unique. A name finds the node given it
+ * last, and if that node is renamed, one of the nodes given it before has
+ * it again.
+ */
+class NodeIndex
+{
+public:
+    NodeIndex()
+    {
+        sortedValid = true;
+    }
+
+    /**
+     * @brief add
+     * Adds a node under a name. Nothing is done if it is already there
+     */
+    void add(const string& name,INode *node)
+    {
+        int id = intern(name);
+
+        if (nodes[id]==node)
+            return;
+        if (nodes[id]!=NULL)
+        {
+            unshadow(id,node);
+            shadowed.insert(make_pair(id,nodes[id]));
+        }
+        nodes[id] = node;
+        sortedValid = false;
+    }
+
+    /**
+     * @brief remove
+     * Takes a node out from under a name, if it is there
+     */
+    void remove(const string& name,INode *node)
+    {
+        int id = getId(name);
+
+        if (id<0)
+            return;
+
+        if (nodes[id]!=node)
+        {
+            unshadow(id,node);
+            return;
+        }
+
+        //the node given the name before this one has it again
+        unordered_multimap<int,INode *>::iterator previous = shadowed.find(id);
+        if (previous==shadowed.end())
+            nodes[id] = NULL;
+        else
+        {
+            nodes[id] = previous->second;
+            shadowed.erase(previous);
+        }
+        sortedValid = false;
+    }
+
+    /**
+     * @brief rename
+     * Moves a node from one name to another
+     */
+    void rename(INode *node,const string& oldName,const string& newName)
+    {
+        if (oldName==newName)
+            return;
+        remove(oldName,node);
+        add(newName,node);
+    }
+
+    void clear()
+    {
+        ids.clear();
+        names.clear();
+        nodes.clear();
+        shadowed.clear();
+        sorted.clear();
+        sortedValid = true;
+    }
+
+    /**
+     * @brief find
+     * The node with a name, NULL if there is none
+     */
+    INode *find(const string& name) const
+    {
+        int id = getId(name);
+
+        if (id<0)
+            return NULL;
+        return nodes[id];
+    }
+
+    /**
+     * @brief getId
+     * The id that a name has been interned as, -1 if it never has been
+     */
+    int getId(const string& name) const
+    {
+        util::InternedString interned;
+
+        if (!util::InternedString::find(name,interned))
+            return -1;
+
+        unordered_map<util::InternedString,int,util::InternedString::Hash>::const_iterator it =
+                ids.find(interned);
+
+        if (it==ids.end())
+            return -1;
+        return it->second;
+    }
+
+    const string& getName(int id) const
+    {
+        return names[id];
+    }
+
+    /**
+     * @brief getNode
+     * The node with the name of an id, NULL if there is none
+     */
+    INode *getNode(int id) const
+    {
+        return nodes[id];
+    }
+
+    /**
+     * @brief getSortedIds
+     * The ids of all the names that have a node, in order of name
+     */
+    const vector<int>& getSortedIds() const
+    {
+        sort();
+        return sorted;
+    }
+
+    /**
+     * @brief findWithPrefix
+     * Finds the nodes whose names start with a prefix, in order of name
+     *
+     * @param found
+     * The nodes found are added to it
+     */
+    void findWithPrefix(const string& prefix,vector<INode *>& found) const
+    {
+        sort();
+        for (vector<int>::const_iterator it=lowerBound(prefix);it!=sorted.end();it++)
+        {
+            const string& name = names[*it];
+            if (name.compare(0,prefix.length(),prefix)!=0)
+                break;
+            found.push_back(nodes[*it]);
+        }
+    }
+
+    /**
+     * @brief findMatching
+     * Finds the nodes whose names match a pattern, in order of name. In the
+     * pattern, '*' matches any number of characters and '?' any one
+     * character. Only the names that start with the part of the pattern
+     * before the first of these are looked at
+     *
+     * @param found
+     * The nodes found are added to it
+     */
+    void findMatching(const string& pattern,vector<INode *>& found) const
+    {
+        string prefix = pattern.substr(0,pattern.find_first_of("*?"));
+
+        sort();
+        for (vector<int>::const_iterator it=lowerBound(prefix);it!=sorted.end();it++)
+        {
+            const string& name = names[*it];
+            if (name.compare(0,prefix.length(),prefix)!=0)
+                break;
+            if (matches(pattern,name))
+                found.push_back(nodes[*it]);
+        }
+    }
+
+    /**
+     * @brief matches
+     * Whether a name matches a pattern with '*' and '?' wildcards
+     */
+    static bool matches(const string& pattern,const string& name)
+    {
+        size_t p = 0,n = 0;
+        size_t star = string::npos,resume = 0;
+
+        while (n<name.length())
+        {
+            if ((p<pattern.length()) && ((pattern[p]=='?') || (pattern[p]==name[n])))
+            {
+                p++;
+                n++;
+            }
+            else if ((p<pattern.length()) && (pattern[p]=='*'))
+            {
+                star = p++;
+                resume = n;
+            }
+            else if (star!=string::npos)
+            {
+                //let the last '*' take one more character
+                p = star+1;
+                n = ++resume;
+            }
+            else
+                return false;
+        }
+        while ((p<pattern.length()) && (pattern[p]=='*'))
+            p++;
+        return p==pattern.length();
+    }
+
+private:
+    int intern(const string& name)
+    {
+        util::InternedString interned(name);
+        unordered_map<util::InternedString,int,util::InternedString::Hash>::iterator it =
+                ids.find(interned);
+
+        if (it!=ids.end())
+            return it->second;
+
+        int id = (int)names.size();
+        ids[interned] = id;
+        names.push_back(interned);
+        nodes.push_back(NULL);
+        return id;
+    }
+
+    /**
+     * @brief unshadow
+     * Takes a node out of those that had a name before the one that has it
+     * now, if it is there
+     */
+    void unshadow(int id,INode *node)
+    {
+        pair<unordered_multimap<int,INode *>::iterator,
+             unordered_multimap<int,INode *>::iterator> range = shadowed.equal_range(id);
+
+        for (unordered_multimap<int,INode *>::iterator it=range.first;it!=range.second;it++)
+        {
+            if (it->second==node)
+            {
+                shadowed.erase(it);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief sort
+     * Puts the ids of the names that have a node in order of name, if names
+     * have changed since the last time
+     */
+    void sort() const
+    {
+        if (sortedValid)
+            return;
+
+        sorted.clear();
+        for (size_t i=0;i<names.size();i++)
+        {
+            if (nodes[i]!=NULL)
+                sorted.push_back((int)i);
+        }
+        std::sort(sorted.begin(),sorted.end(),NameLess(names));
+        sortedValid = true;
+    }
+
+    vector<int>::const_iterator lowerBound(const string& prefix) const
+    {
+        vector<int>::const_iterator first = sorted.begin();
+        size_t count = sorted.size();
+
+        while (count>0)
+        {
+            size_t step = count/2;
+            vector<int>::const_iterator middle = first+step;
+            if (names[*middle].str()<prefix)
+            {
+                first = middle+1;
+                count -= step+1;
+            }
+            else
+                count = step;
+        }
+        return first;
+    }
+
+    struct NameLess
+    {
+        const vector<util::InternedString>& names;
+
+        NameLess(const vector<util::InternedString>& names):names(names) {}
+
+        bool operator()(int a,int b) const
+        {
+            return names[a].str()<names[b].str();
+        }
+    };
+
+    unordered_map<util::InternedString,int,util::InternedString::Hash> ids;
+    vector<util::InternedString> names;
+    vector<INode *> nodes; //by id, the node that has the name now
+
+    /**
+     * The nodes that were given a name before the one that has it now, by id
+     */
+    unordered_multimap<int,INode *> shadowed;
+    mutable vector<int> sorted;
+    mutable bool sortedValid;
+};
+}
+
+#endif
@@ -7,10 +7,12 @@
 #include <QXmlDefaultHandler>
 #include <qxml.h>
 #include "ObjImporter.h"
+#include "MeshCache.h"
 #include "INode.h"
 #include "TransformNode.h"
 #include "LeafNode.h"
 #include "GroupNode.h"
+#include "InstanceNode.h"
 #include "Light.h"
 #include "ScenegraphInfo.h"
 #include <string>
@@ -62,7 +64,7 @@ namespace sgraph
       if (answer)
         {
           info.scenegraph = handler.getScenegraph();
-          info.meshes = handler.getMeshes();
+          info.meshes.swap(handler.getMeshes());
         }
       else
         {
@@ -108,9 +110,10 @@ namespace sgraph
      *
      * @return
      * The map of (name,util::PolygonMesh) pairs associated with this XML
-     * readers
+     * readers. It is returned by reference so that the caller can take the
+     * meshes over without copying them
      */
-    map<string,util::PolygonMesh<K>> getMeshes()
+    map<string,util::PolygonMesh<K>>& getMeshes()
     {
       return meshes;
     }
@@ -178,27 +181,42 @@ namespace sgraph
             }
           if ((copyof.length() > 0) && (subgraph.count(copyof)==1))
             {
-              node = subgraph[copyof]->clone();
-              node->setName(name);
+              INode *source = subgraph[copyof];
+              INode *ancestor = stackNodes.top();
+
+              while ((ancestor!=NULL) && (ancestor!=source))
+                ancestor = ancestor->getParent();
+
+              //the subtree is shared, unless it is still being read because
+              //this group is inside it
+              if (ancestor==NULL)
+                node = new sgraph::InstanceNode(scenegraph,name,source);
+              else
+                {
+                  node = source->clone();
+                  node->setName(name);
+                }
             }
           else if (fromfile.length() > 0)
             {
-              sgraph::ScenegraphInfo<K> tempsginfo;
-              tempsginfo = sgraph::SceneXMLReader::importScenegraph<K>(fromfile);
+              sgraph::ScenegraphInfo<K> tempsginfo =
+                  sgraph::SceneXMLReader::importScenegraph<K>(fromfile);
 
               node = new sgraph::GroupNode(scenegraph,name);
 
               for (typename map<string,util::PolygonMesh<K>>::iterator it=tempsginfo.meshes.begin();
                    it!=tempsginfo.meshes.end();it++)
                 {
-                  meshes[it->first] = it->second;
+                  meshes[it->first] = std::move(it->second);
                 }
               //rename all the nodes in tempsg to prepend with the name of the group node
-              map<string, INode *> nodes = tempsginfo.scenegraph->getNodes();
-              for (map<string,INode *>::iterator it=nodes.begin();it!=nodes.end();it++)
+              //(the nodes are found first, since renaming them changes the index)
+              vector<INode *> nodes;
+              tempsginfo.scenegraph->findNodes("*",nodes);
+              for (vector<INode *>::iterator it=nodes.begin();it!=nodes.end();it++)
                 {
-                  it->second->setName(name + "-" + it->second->getName());
-                  scenegraph->addNode(it->second->getName(), it->second);
+                  (*it)->setName(name + "-" + (*it)->getName());
+                  scenegraph->addNode((*it)->getName(), *it);
                 }
 
               node->addChild(tempsginfo.scenegraph->getRoot());
@@ -284,9 +302,16 @@ namespace sgraph
           if ((name.length() > 0) && (path.length() > 0))
             {
               util::PolygonMesh<K> mesh;
-              ifstream in(path.c_str());
-              mesh = util::ObjImporter<K>::importFile(in, false);
-              meshes[name] = mesh;
+              util::ObjImportOptions options;
+
+              //one vertex per distinct (v,vt,vn) triplet, parsed on all cores
+              //and reordered for the vertex cache.
+              //warm_cache must ask for the same options to be useful
+              options.indexed = true;
+              options.numThreads = 0;
+              options.optimize = true;
+              mesh = util::MeshCache<K>::importFile(path, options);
+              meshes[name] = std::move(mesh);
 
               //Also add object to object map for saving
               path = path.substr(0, path.find_first_of('.'));
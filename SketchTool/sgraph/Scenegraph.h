@@ -3,12 +3,16 @@
 
 #include "GLScenegraphRenderer.h"
 #include "INode.h"
+#include "FlatScenegraph.h"
+#include "NodeIndex.h"
 #include "OpenGLFunctions.h"
 #include "glm/glm.hpp"
 #include "IVertexData.h"
 #include "PolygonMesh.h"
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -35,9 +39,10 @@ namespace sgraph
 
 
     /**
-     * A map to store the (name,node) pairs. A map is chosen for efficient search
+     * The nodes of this scenegraph by name, kept up to date as nodes are added
+     * and renamed
      */
-    map<string,INode *> nodes;
+    NodeIndex nodes;
 
     /**
      * A map to store the (name,path) pairs for textures
@@ -55,18 +60,26 @@ namespace sgraph
      */
     GLScenegraphRenderer *renderer;
 
-    /**
-     * @brief node_names
-     * A vector containing the names of all nodes in the scenegraph
-     */
-    vector<string> node_names;
-
     /**
      * @brief object_select_tex
      * The name of the texture to change to when an object is selected
      */
     string object_select_tex = "selected_object";
 
+    /**
+     * @brief flat
+     * The scenegraph laid out flat, which is what is drawn. The nodes pass
+     * their edits on to it through this object
+     */
+    FlatScenegraph flat;
+
+    /**
+     * @brief instances
+     * The nodes that share a subtree with other places in the scenegraph (see
+     * InstanceNode), by the root of the subtree they share
+     */
+    unordered_map<INode *,vector<INode *> > instances;
+
 
   public:
     Scenegraph()
@@ -91,6 +104,9 @@ namespace sgraph
           delete root;
           root = NULL;
         }
+      flat.clear();
+      nodes.clear();
+      instances.clear();
     }
 
 
@@ -100,7 +116,7 @@ namespace sgraph
      * @return
      * A list of lights contained within the scenegraph's renderer
      */
-    vector<util::Light> getRendererLights()
+    const vector<util::Light>& getRendererLights()
     {
         return renderer->getLights();
     }
@@ -114,19 +130,26 @@ namespace sgraph
      * @param renderer
      * The IScenegraphRenderer object that will act as the scenegraph's
      * renderer
+     *
+     * @param meshes
+     * The meshes of the scenegraph. They are handed over (moved) to this
+     * function, which releases each one as soon as it has been uploaded
      */
     template <class VertexType>
     void setRenderer(GLScenegraphRenderer *renderer,map<string,
-                     util::PolygonMesh<VertexType> >& meshes) throw(runtime_error)
+                     util::PolygonMesh<VertexType> >&& meshes) throw(runtime_error)
     {
+      map<string,util::PolygonMesh<VertexType> > toUpload;
+
       this->renderer = renderer;
+      toUpload.swap(meshes);
 
       //now add all the meshes
-      for (typename map<string,util::PolygonMesh<VertexType> >::iterator it=meshes.begin();
-           it!=meshes.end();
-           it++)
+      while (!toUpload.empty())
         {
+          typename map<string,util::PolygonMesh<VertexType> >::iterator it = toUpload.begin();
           this->renderer->addMesh<VertexType>(it->first,it->second);
+          toUpload.erase(it);
         }
 
       //pass all the texture objects
@@ -159,7 +182,133 @@ namespace sgraph
     {
       this->root = root;
       this->root->setScenegraph(this);
+      flat.setRoot(root);
+    }
+
+    /**
+     * @brief transformChanged
+     * Called by a transform node of this scenegraph when its transform or
+     * animation transform changes
+     *
+     * @param node
+     * The node
+     *
+     * @param local
+     * Its animation transform times its transform
+     */
+    void transformChanged(INode *node,const glm::mat4& local)
+    {
+      flat.setLocalTransform(node,local);
+    }
+
+    /**
+     * @brief leafChanged
+     * Called by a leaf of this scenegraph when what it is drawn with changes
+     */
+    void leafChanged(INode *node,
+                     const string& mesh,
+                     const util::Material& material,
+                     const string& texture,
+                     const glm::mat4& textureMatrix)
+    {
+      flat.setLeaf(node,mesh,material,texture,textureMatrix);
+    }
+
+    /**
+     * @brief structureChanged
+     * Called by a node of this scenegraph when it is given a child or its
+     * children are taken away
+     */
+    void structureChanged()
+    {
+      flat.invalidate();
+    }
+
+    /**
+     * @brief lightsChanged
+     * Called by a node of this scenegraph when it is given a light
+     */
+    void lightsChanged()
+    {
+      flat.invalidate();
+    }
+
+    /**
+     * @brief addInstance
+     * Called by a node of this scenegraph when it starts sharing a subtree
+     *
+     * @param shared
+     * The root of the subtree
+     *
+     * @param instance
+     * The node that shares it
+     */
+    void addInstance(INode *shared,INode *instance)
+    {
+      vector<INode *>& sharing = instances[shared];
+
+      if (find(sharing.begin(),sharing.end(),instance)==sharing.end())
+        sharing.push_back(instance);
+    }
+
+    /**
+     * @brief removeInstance
+     * Called by a node of this scenegraph when it stops sharing a subtree
+     */
+    void removeInstance(INode *shared,INode *instance)
+    {
+      unordered_map<INode *,vector<INode *> >::iterator it = instances.find(shared);
+
+      if (it==instances.end())
+        return;
+
+      vector<INode *>& sharing = it->second;
+      sharing.erase(std::remove(sharing.begin(),sharing.end(),instance),sharing.end());
+      if (sharing.empty())
+        instances.erase(it);
+    }
+
+    /**
+     * @brief nodeWillChange
+     * Called by a node of this scenegraph just before it changes. Every node
+     * that shares a subtree the node is in gets a copy of its own of the
+     * subtree first, so that it does not change with it
+     *
+     * @param node
+     * The node
+     */
+    void nodeWillChange(INode *node)
+    {
+      if (instances.empty())
+        return;
 
+      for (INode *n=node;n!=NULL;n=n->getParent())
+        {
+          unordered_map<INode *,vector<INode *> >::iterator it;
+
+          //unsharing may copy instances of this subtree that are in the
+          //subtrees shared by the ones unshared, so look again every time
+          while ((it=instances.find(n))!=instances.end())
+            it->second.back()->unshare();
+        }
+    }
+
+    /**
+     * @brief getModelviewForDrawing
+     * Gets the modelview that a leaf was last drawn with
+     *
+     * @param node
+     * The leaf
+     *
+     * @return
+     * The modelview, or the identity if the leaf has not been drawn
+     */
+    glm::mat4 getModelviewForDrawing(INode *node)
+    {
+      glm::mat4 modelview(1.0f);
+
+      flat.getModelview(node,modelview);
+      return modelview;
     }
 
     /**
@@ -172,7 +321,7 @@ namespace sgraph
     void draw(stack<glm::mat4>& modelView) {
       if ((root!=NULL) && (renderer!=NULL))
         {
-          renderer->draw(root,modelView);
+          renderer->draw(flat,modelView);
         }
     }
 
@@ -240,7 +389,25 @@ namespace sgraph
      * The node object to add to the map
      */
     void addNode(const string& name, INode *node) {
-      nodes[name]=node;
+      nodes.add(name,node);
+    }
+
+    /**
+     * @brief renameNode
+     * Called by a node of this scenegraph when its name changes
+     *
+     * @param node
+     * The node
+     *
+     * @param oldName
+     * The name it had
+     *
+     * @param newName
+     * The name it has now
+     */
+    void renameNode(INode *node,const string& oldName,const string& newName)
+    {
+      nodes.rename(node,oldName,newName);
     }
 
 
@@ -259,16 +426,47 @@ namespace sgraph
 
     /**
      * @brief getNodes
-     * Get the map of nodes associated with this scenegraph
+     * Get the index of the nodes of this scenegraph by name
      *
      * @return
-     * The map of nodes associated with this scenegraph
+     * The index, which changes as nodes are added and renamed
      */
-    map<string, INode *> getNodes()
+    const NodeIndex& getNodes() const
     {
       return nodes;
     }
 
+    /**
+     * @brief findNodesWithPrefix
+     * Finds the nodes whose names start with a prefix, in order of name
+     *
+     * @param prefix
+     * The prefix
+     *
+     * @param found
+     * The nodes found are added to it
+     */
+    void findNodesWithPrefix(const string& prefix,vector<INode *>& found) const
+    {
+      nodes.findWithPrefix(prefix,found);
+    }
+
+    /**
+     * @brief findNodes
+     * Finds the nodes whose names match a pattern, in order of name. '*' in
+     * the pattern matches any number of characters, and '?' any one
+     *
+     * @param pattern
+     * The pattern
+     *
+     * @param found
+     * The nodes found are added to it
+     */
+    void findNodes(const string& pattern,vector<INode *>& found) const
+    {
+      nodes.findMatching(pattern,found);
+    }
+
     /**
      * @brief addTexture
      * Add a texture to this scenegraph's texture map
@@ -299,27 +497,14 @@ namespace sgraph
         objects[name] = path;
     }
 
-    /**
-     * @brief addNodeName
-     * Used to add a name to node_names vector. This vector keeps track of
-     * the names used by nodes in the scenegraph.
-     *
-     * @param name
-     * The name to add to the node_names vector
-     */
-    void addNodeName(const string& name)
-    {
-        node_names.push_back(name);
-    }
-
     /**
      * @brief printNodeNames
-     * Will print out all names contained in member node_names
+     * Will print out the names of all nodes in the scenegraph, in order
      */
     void printNodeNames()
     {
-        for(auto name : node_names)
-            std::cout << name << endl;
+        for(int id : nodes.getSortedIds())
+            std::cout << nodes.getName(id) << endl;
     }
 
     /**
@@ -336,13 +521,7 @@ namespace sgraph
      */
     bool isValidNodeName(const string& name)
     {
-        for(auto entry : node_names)
-        {
-            if(name == entry)
-                return true;
-        }
-
-        return false;
+        return nodes.find(name)!=NULL;
     }
 
     /**
@@ -359,16 +538,10 @@ namespace sgraph
     void changeNodeTexture(const string& node_name, const string& texture_name)
     {
         //Find node by name
-        if(isValidNodeName(node_name))
-        {
-            if(nodes[node_name]->getNodeType() == LEAF)
-                nodes[node_name]->changeNodeTexture(texture_name);
+        INode *node = nodes.find(node_name);
 
-        }
-        else
-        {
-            return;
-        }
+        if((node != NULL) && (node->getNodeType() == LEAF))
+            node->changeNodeTexture(texture_name);
     }
 
     /**
@@ -393,13 +566,10 @@ namespace sgraph
      */
     void revertNodeTexture(const string& node_name)
     {
-        if(isValidNodeName(node_name))
-        {
-            if(nodes[node_name]->getNodeType() == LEAF)
-                nodes[node_name]->revertNodeTexture();
-        }
-        else
-            return;
+        INode *node = nodes.find(node_name);
+
+        if((node != NULL) && (node->getNodeType() == LEAF))
+            node->revertNodeTexture();
     }
 
     /**
@@ -415,15 +585,8 @@ namespace sgraph
      */
     INode* getNodeByName(const string& name)
     {
-        //Search map of nodes to get node
-        if(isValidNodeName(name))
-        {
-            return nodes[name];
-        }
-        else
-        {
-            return nullptr;
-        }
+        //Search index of nodes to get node
+        return nodes.find(name);
     }
 
     /**
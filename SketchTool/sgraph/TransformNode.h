@@ -2,6 +2,8 @@
 #define _TRANSFORMNODE_H_
 
 #include "AbstractNode.h"
+#include "FlatScenegraph.h"
+#include "ObjectPool.h"
 #include "OpenGLFunctions.h"
 #include "glm/glm.hpp"
 #include <glm/gtc/type_ptr.hpp>
@@ -16,12 +18,6 @@ using namespace std;
 namespace sgraph
 {
 
-enum transformation_type{
-    TRANSLATE,
-    ROTATE,
-    SCALE
-};
-
   /**
  * This node represents a transformation in the scene graph. It has only one child. The transformation
  * can be viewed as changing from its child's coordinate system to its parent's coordinate system
@@ -42,41 +38,53 @@ enum transformation_type{
      */
     INode *child;
 
-    /**
-      * Add transformation container here
-      */
-    vector<pair<transformation_type,vector<float>>> transformation_order;
-
     /**
       * The translation data associated with this transform node
       */
-    vector<float> translation_data = {0.0f, 0.0f, 0.0f};
+    glm::vec3 translation_data = glm::vec3(0.0f, 0.0f, 0.0f);
 
 
     /**
       * The rotation data for the x axis
       */
-    vector<float> x_rotation_data = {0.0f, 1.0f, 0.0f, 0.0f};
+    glm::vec4 x_rotation_data = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
 
 
     /**
       * The rotation data for the y axis
       */
-    vector<float> y_rotation_data = {0.0f, 0.0f, 1.0f, 0.0f};
+    glm::vec4 y_rotation_data = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
 
 
     /**
       * The rotation data for the z axis
       */
-    vector<float> z_rotation_data = {0.0f, 0.0f, 0.0f, 1.0f};
+    glm::vec4 z_rotation_data = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
 
     /**
       * The scale data
       */
-    vector<float> scale_data = {1.0f, 1.0f, 1.0f};
+    glm::vec3 scale_data = glm::vec3(1.0f, 1.0f, 1.0f);
+
+    /**
+     * @brief transformChanged
+     * Passes a change to the transform or the animation transform of this node
+     * on to the flat form of the scenegraph, which keeps what is found from
+     * them
+     */
+    void transformChanged()
+    {
+      scenegraph->transformChanged(this,animation_transform*transform);
+    }
 
   public:
+    /**
+     * Transform nodes are taken from a pool of their own (see
+     * util::ObjectPool)
+     */
+    UTIL_POOLED_ALLOCATION(TransformNode)
+
     /**
      * @brief TransformNode
      * Default constructor. Sets transforms to default values and nulls out child.
@@ -108,7 +116,9 @@ enum transformation_type{
      */
     void clearChildren() throw(runtime_error)
     {
+        willChange();
         child = NULL;
+        scenegraph->structureChanged();
     }
 
     /**
@@ -134,6 +144,12 @@ enum transformation_type{
       TransformNode *newtransform = new TransformNode(scenegraph,name);
       newtransform->setTransform(this->transform);
       newtransform->setAnimationTransform(animation_transform);
+      newtransform->translation_data = translation_data;
+      newtransform->x_rotation_data = x_rotation_data;
+      newtransform->y_rotation_data = y_rotation_data;
+      newtransform->z_rotation_data = z_rotation_data;
+      newtransform->scale_data = scale_data;
+      copyLightsTo(newtransform);
 
       if (newchild!=NULL)
         {
@@ -212,33 +228,32 @@ enum transformation_type{
     {
       if (this->child!=NULL)
         throw runtime_error("Transform node already has a child");
+      willChange();
       this->child = child;
       this->child->setParent(this);
+      scenegraph->structureChanged();
     }
 
     /**
-     * @brief draw
-     * Draws the scenegraph rooted at this node. After preserving the current
-     * top of the modelview stack, this "post-multiplies" its animation
-     * transform and then its transform (in that order) to the top of the
-     * modelview stack. This function then recurses to this node's child. When
-     * the child is drawn, it restores the modelview matrix.
+     * @brief flatten
+     * Adds this node, with its animation transform and transform, and then the
+     * subtree of its child to the flat form of the scenegraph, followed by
+     * the lights of this node
      *
-     * @param context
-     * The generic renderer context {@link sgraph::IScenegraphRenderer}
+     * @param flat
+     * The flat form of the scenegraph
      *
-     * @param modelView
-     * The stack of modelview matrices
+     * @param parent
+     * The index of the parent of this node in it, -1 for the root
      */
-    void draw(GLScenegraphRenderer& context,stack<glm::mat4>& modelView)
+    void flatten(FlatScenegraph& flat,int parent)
     {
-      modelView.push(modelView.top());
-      modelView.top() = modelView.top()
-          * animation_transform
-          * transform;
+      int index = flat.addNode(this,TRANSFORM,parent,animation_transform*transform);
+
       if (child!=NULL)
-        child->draw(context,modelView);
-      modelView.pop();
+        child->flatten(flat,index);
+      flat.endSubtree(index);
+      flat.addLights(index,getLights());
     }
 
 
@@ -263,7 +278,7 @@ enum transformation_type{
 
         //Add set tag
         output_file << "<set>" << endl;
-        //Iterate through transformation_order and apply correct tags
+        //Write the transformations in the order they are applied
         string xml_string = "";
 
         //Apply translate first
@@ -314,7 +329,11 @@ enum transformation_type{
      */
     void setAnimationTransform(const glm::mat4& mat) throw(runtime_error)
     {
+      if (mat==animation_transform)
+        return;
+      willChange();
       animation_transform = mat;
+      transformChanged();
     }
 
     /**
@@ -338,7 +357,11 @@ enum transformation_type{
      */
     void setTransform(const glm::mat4& t) throw(runtime_error)
     {
+      if (t==transform)
+        return;
+      willChange();
       this->transform = t;
+      transformChanged();
     }
 
     /**
@@ -370,45 +393,6 @@ enum transformation_type{
         }
     }
 
-    /**
-     * @brief getLightsInView
-     * Overridden version of @link{AbstractNode}. This version first modifies
-     * the modelview matrix to include its transformation and animation
-     * transformation. Then it collects all the lights from its child and
-     * appends them to lights from this node.
-     *
-     * This function uses the @link{AbstractNode::getLightsInView} to get the
-     * lights contained in this node.
-     *
-     * @param modelview
-     * The stack of modelview matrices
-     * @return
-     */
-    vector<util::Light> getLightsInView(stack<glm::mat4>& modelview)
-    {
-      vector<util::Light> lights,templights;
-
-      modelview.push(modelview.top());
-      modelview.top() = modelview.top() * animation_transform * transform;
-      if (child != NULL)
-        {
-          templights = child->getLightsInView(modelview);
-          for (unsigned int i=0;i<templights.size();i++)
-            {
-              lights.push_back(templights[i]);
-            }
-        }
-      modelview.pop();
-
-      //now get the lights from this node's lights
-      templights = AbstractNode::getLightsInView(modelview);
-      for (unsigned int i=0;i<templights.size();i++)
-        {
-          lights.push_back(templights[i]);
-        }
-      return lights;
-    }
-
     /**
      * @brief addScale
      * Used to apply this scale to the node's transform
@@ -424,6 +408,7 @@ enum transformation_type{
      */
     void addScale(float x_scale, float y_scale, float z_scale)
     {
+        willChange();
         //Multiply scale into existing scale
         scale_data[0] *= x_scale;
         scale_data[1] *= y_scale;
@@ -431,6 +416,7 @@ enum transformation_type{
 
         //Apply scale to node's transform
         transform *= glm::scale(glm::mat4(1.0f), glm::vec3(x_scale, y_scale, z_scale));
+        transformChanged();
     }
 
     /**
@@ -451,6 +437,7 @@ enum transformation_type{
      */
     void addRotation(float angle, float x_axis, float y_axis, float z_axis)
     {
+        willChange();
         //Apply rotation to each axis
         if(x_axis == 1.0f)
         {
@@ -467,6 +454,7 @@ enum transformation_type{
 
         //Apply rotation to node's transformation
         transform *= glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(x_axis, y_axis, z_axis));
+        transformChanged();
 
     }
 
@@ -485,6 +473,7 @@ enum transformation_type{
      */
     void addTranslation(float x_trans, float y_trans, float z_trans)
     {
+        willChange();
         //Apply translation to existing translation data
         translation_data[0] += x_trans;
         translation_data[1] += y_trans;
@@ -492,6 +481,7 @@ enum transformation_type{
 
         //Apply translation to transformation member
         transform *= glm::translate(glm::mat4(1.0f), glm::vec3(x_trans, y_trans, z_trans));
+        transformChanged();
     }
 
     /**
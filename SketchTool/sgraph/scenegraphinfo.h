@@ -10,12 +10,23 @@ using namespace std;
 
 namespace sgraph
 {
+    /*
+     * The result of importing a scenegraph: the scenegraph and the meshes it
+     * uses. This can only be moved, not copied, so that the meshes are never
+     * duplicated on their way to the renderer.
+     */
     template<class K>
     class ScenegraphInfo
     {
     public:
       sgraph::Scenegraph *scenegraph;
       map<string,util::PolygonMesh<K> > meshes;
+
+      ScenegraphInfo():scenegraph(NULL) {}
+      ScenegraphInfo(ScenegraphInfo&& other) = default;
+      ScenegraphInfo& operator=(ScenegraphInfo&& other) = default;
+      ScenegraphInfo(const ScenegraphInfo&) = delete;
+      ScenegraphInfo& operator=(const ScenegraphInfo&) = delete;
     };
 }
 
@@ -1,33 +1,45 @@
 #version 140
 
+/* the layouts of these must match the std140 mirrors in the renderer */
 struct MaterialProperties
 {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
     float shininess;
 };
 
 struct LightProperties
 {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
     vec4 position;
-    float cosSpotCutoff;
     vec4 spotdirection;
+    float cosSpotCutoff;
 };
 
 
 in vec3 fNormal;
 in vec4 fPosition;
 in vec4 fTexCoord;
+flat in int fMaterial;
 
 const int MAXLIGHTS = 10;
+const int MAXMATERIALS = 256;
+
+/* all the materials in use, written once each */
+layout(std140) uniform MaterialBlock
+{
+    MaterialProperties materials[MAXMATERIALS];
+};
 
-uniform MaterialProperties material;
-uniform LightProperties light[MAXLIGHTS];
-uniform int numLights;
+/* written once per frame */
+layout(std140) uniform LightBlock
+{
+    LightProperties light[MAXLIGHTS];
+    int numLights;
+};
 
 /* texture */
 uniform sampler2D image;
@@ -42,6 +54,8 @@ void main()
     float nDotL,rDotV;
 
 
+    MaterialProperties material = materials[fMaterial];
+
     fColor = vec4(0,0,0,1);
 
     for (int i=0;i<numLights;i++)
@@ -69,10 +83,10 @@ void main()
 
         rDotV = max(dot(reflectVec,viewVec),0.0);
 
-        ambient = material.ambient * light[i].ambient;
-        diffuse = material.diffuse * light[i].diffuse * max(nDotL,0);
+        ambient = material.ambient.xyz * light[i].ambient.xyz;
+        diffuse = material.diffuse.xyz * light[i].diffuse.xyz * max(nDotL,0);
         if (nDotL>0)
-            specular = material.specular * light[i].specular * pow(rDotV,material.shininess);
+            specular = material.specular.xyz * light[i].specular.xyz * pow(rDotV,material.shininess);
         else
             specular = vec3(0,0,0);
         fColor = fColor + vec4(ambient+diffuse+0*specular,1.0);
@@ -7,12 +7,46 @@ in vec4 vNormal;
 in vec4 vTexCoord;
 
 uniform mat4 projection;
-uniform mat4 modelview;
-uniform mat4 normalmatrix;
-uniform mat4 texturematrix;
+
+const int MAXINSTANCES = 64;
+
+/* what differs between the instances of a mesh drawn together */
+struct InstanceProperties
+{
+    mat4 modelview;
+    mat4 normalmatrix;
+    mat4 texturematrix;
+    /* index into the material table of the fragment shader */
+    int materialindex;
+};
+
+/* everything that changes from one draw to the next, written by the renderer
+   into one block of a uniform buffer per draw */
+layout(std140) uniform DrawBlock
+{
+    /* how to get back compact vertex data (see util::ObjectInstance) */
+    vec4 positionscale;
+    vec4 positionoffset;
+    bool octahedralnormals;
+    /* indexed by gl_InstanceID */
+    InstanceProperties instances[MAXINSTANCES];
+};
 out vec3 fNormal;
 out vec4 fPosition;
 out vec4 fTexCoord;
+flat out int fMaterial;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.xy,1.0 - abs(e.x) - abs(e.y));
+
+    if (n.z<0.0)
+    {
+        vec2 s = vec2(e.x>=0.0 ? 1.0 : -1.0,e.y>=0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * s;
+    }
+    return normalize(n);
+}
 
 void main()
 {
@@ -21,13 +55,19 @@ void main()
     vec3 ambient,diffuse,specular;
     float nDotL,rDotV;
 
-    fPosition = modelview * vec4(vPosition.xyzw);
+    mat4 modelview = instances[gl_InstanceID].modelview;
+
+    fPosition = modelview * (vPosition*positionscale + positionoffset);
     gl_Position = projection * fPosition;
 
+    vec4 normal = vNormal;
+    if (octahedralnormals)
+        normal = vec4(decodeOctahedral(vNormal.xy),0.0);
 
-    vec4 tNormal = normalmatrix * vNormal;
+    vec4 tNormal = instances[gl_InstanceID].normalmatrix * normal;
     fNormal = normalize(tNormal.xyz);
 
-    fTexCoord = texturematrix * vec4(1*vTexCoord.s,1*vTexCoord.t,0,1);
+    fTexCoord = instances[gl_InstanceID].texturematrix * vec4(1*vTexCoord.s,1*vTexCoord.t,0,1);
+    fMaterial = instances[gl_InstanceID].materialindex;
 
 }
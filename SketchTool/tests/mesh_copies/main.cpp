@@ -0,0 +1,185 @@
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "OpenGLFunctions.h"
+#include "ShaderProgram.h"
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "sgraph/scenegraphinfo.h"
+#include "sgraph/GLScenegraphRenderer.h"
+#include "sgraph/Scenegraph.h"
+#include <atomic>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <map>
+using namespace std;
+
+/*
+ * The sizes of the allocations made while counting is on. They are kept in
+ * a fixed array, so that keeping them allocates nothing
+ */
+static const size_t MAX_ALLOCATIONS = 1<<20;
+static size_t allocationSizes[MAX_ALLOCATIONS];
+static atomic<size_t> numAllocations(0);
+static atomic<bool> counting(false);
+
+static void *allocate(size_t size)
+{
+    if (counting)
+    {
+        size_t i = numAllocations++;
+        if (i<MAX_ALLOCATIONS)
+            allocationSizes[i] = size;
+    }
+
+    void *p = malloc((size>0)?size:1);
+    if (p==NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+/*
+ * Counts the copies made of the vertex data of a model (models/thomas-lyons-
+ * object.obj by default) on the way the scenegraph reader and the view send
+ * it to the GPU: ObjImporter::importFile, a ScenegraphInfo, and
+ * Scenegraph::setRenderer, which adds it to the renderer with
+ * ObjectInstance::initPolygonMesh. Run it from the SketchTool directory.
+ *
+ * Once the mesh is imported, every allocation at least as big as one of its
+ * vertex attribute arrays is taken to be a copy of its vertex data. At most
+ * one is allowed: the vertex data put together in memory when the vertex
+ * buffer cannot be mapped. The levels of detail are turned off, because
+ * those are meshes of their own and not copies of this one.
+ *
+ * Returns 0 if the test passes, 1 if it fails and 2 if it cannot be run.
+ */
+int main(int argc, char *argv[])
+{
+    QGuiApplication a(argc, argv);
+    string path = "models/thomas-lyons-object.obj";
+
+    if (argc>1)
+        path = argv[1];
+
+    QSurfaceFormat format;
+    format.setVersion(3,3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if (!context.create() || !context.makeCurrent(&surface))
+    {
+        printf("Cannot make an OpenGL 3.3 context\n");
+        return 2;
+    }
+
+    util::OpenGLFunctions gl;
+    util::ShaderProgram program;
+    sgraph::GLScenegraphRenderer renderer;
+    sgraph::ScenegraphInfo<VertexAttrib> info;
+    size_t vertexCount = 0;
+
+    try
+    {
+        //the same as View::init and View::initScenegraph
+        program.createProgram(gl,
+                              string("shaders/phong-multiple.vert"),
+                              string("shaders/phong-multiple.frag"));
+        program.enable(gl);
+        renderer.setContext(&gl);
+        renderer.setLevelsOfDetail(0);
+        map<string,string> shaderVarsToVertexAttribs;
+        shaderVarsToVertexAttribs["vPosition"] = "position";
+        shaderVarsToVertexAttribs["vNormal"] = "normal";
+        shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
+        renderer.initShaderProgram(program,shaderVarsToVertexAttribs);
+
+        //the same as SceneXMLReader
+        util::ObjImportOptions options;
+        options.indexed = true;
+        options.numThreads = 0;
+        options.optimize = true;
+        util::PolygonMesh<VertexAttrib> mesh =
+                util::ObjImporter<VertexAttrib>::importFile(path,options);
+        vertexCount = mesh.getVertexCount();
+
+        counting = true;
+        info.scenegraph = new sgraph::Scenegraph();
+        info.meshes["model"] = std::move(mesh);
+        info.scenegraph->setRenderer<VertexAttrib>(&renderer,std::move(info.meshes));
+        counting = false;
+
+        program.disable(gl);
+    }
+    catch (string e)
+    {
+        printf("failed   %s: %s\n",path.c_str(),e.c_str());
+        return 2;
+    }
+    catch (runtime_error e)
+    {
+        printf("failed   %s: %s\n",path.c_str(),e.what());
+        return 2;
+    }
+
+    size_t fullSize = vertexCount*sizeof(glm::vec4);
+    size_t recorded = numAllocations;
+    size_t copies = 0;
+
+    if (recorded>MAX_ALLOCATIONS)
+        recorded = MAX_ALLOCATIONS;
+    for (size_t i=0;i<recorded;i++)
+    {
+        if (allocationSizes[i]>=fullSize)
+            copies++;
+    }
+
+    delete info.scenegraph;
+    renderer.dispose();
+    context.doneCurrent();
+
+    printf("%s: %lu vertices, %lu allocations, %lu of at least %lu bytes\n",
+           path.c_str(),
+           (unsigned long)vertexCount,
+           (unsigned long)numAllocations,
+           (unsigned long)copies,
+           (unsigned long)fullSize);
+    if (copies>1)
+    {
+        printf("FAIL: the vertex data was copied %lu times\n",(unsigned long)copies);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Test that counts the copies made of a mesh's
+# vertex data on its way from the OBJ file to its
+# vertex buffer. Run it from the SketchTool
+# directory:
+#
+#   mesh_copies [model]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = mesh_copies
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../../headers \
+    ../..
+
+HEADERS  += ../../VertexAttrib.h
@@ -0,0 +1,90 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QStringList>
+#include <qopengl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include <cstdio>
+#include <string>
+using namespace std;
+
+/*
+ * Pre-warms the mesh cache for every OBJ file in the given directory
+ * (models/ by default). The cache entries are made exactly the way the
+ * scenegraph reader asks for them, so run this from the SketchTool
+ * directory.
+ *
+ * For every model it also reports how many vertices the indexed import
+ * makes, compared to the number of positions in the file and to the number
+ * of triangle corners, and how well the mesh uses the vertex cache (ACMR and
+ * ATVR, see util::VertexCacheStats) in file order and once optimized.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    string directory = "models";
+    int failures = 0;
+
+    if (argc>1)
+        directory = argv[1];
+
+    QDir dir(QString::fromStdString(directory));
+    if (!dir.exists())
+    {
+        printf("No such directory: %s\n",directory.c_str());
+        return 1;
+    }
+
+    //must match the options used by SceneXMLReader
+    util::ObjImportOptions options;
+    options.indexed = true;
+    options.numThreads = 0;
+    options.optimize = true;
+
+    QStringList files = dir.entryList(QStringList() << "*.obj",QDir::Files,QDir::Name);
+    for (int i=0;i<files.size();i++)
+    {
+        string path = directory + "/" + files.at(i).toStdString();
+        try
+        {
+            util::ObjImportStats stats;
+            util::ObjImportOptions fileOrder = options;
+
+            fileOrder.optimize = false;
+            util::PolygonMesh<VertexAttrib> mesh =
+                    util::ObjImporter<VertexAttrib>::importFile(path,fileOrder,&stats);
+            util::VertexCacheStats before =
+                    util::MeshOptimizer<VertexAttrib>::analyzeVertexCache(mesh);
+            util::MeshOptimizer<VertexAttrib>::optimize(mesh);
+            util::VertexCacheStats after =
+                    util::MeshOptimizer<VertexAttrib>::analyzeVertexCache(mesh);
+            if (util::MeshCache<VertexAttrib>::warm(path,options))
+                printf("cached   %s\n",path.c_str());
+            else
+                printf("current  %s\n",path.c_str());
+            printf("         %lu positions, %lu corners -> %lu vertices"
+                   " (%.3f per position, %.3f per corner)\n",
+                   (unsigned long)stats.positions,
+                   (unsigned long)stats.corners,
+                   (unsigned long)stats.vertices,
+                   stats.vertexRatio(),
+                   stats.cornerRatio());
+            printf("         ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                   before.acmr(),after.acmr(),
+                   before.atvr(),after.atvr());
+        }
+        catch (string e)
+        {
+            printf("failed   %s: %s\n",path.c_str(),e.c_str());
+            failures++;
+        }
+    }
+
+    return (failures>0)?1:0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Command line tool that fills the binary mesh cache
+# for every OBJ model, so the sketch tool never has
+# to parse them at load time. Run it from the
+# SketchTool directory:
+#
+#   warm_cache [models-directory]
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = warm_cache
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+
+SOURCES += main.cpp
+
+INCLUDEPATH += ../../headers \
+    ..
+
+HEADERS  += ../VertexAttrib.h
@@ -0,0 +1,62 @@
+#ifndef _ARRAYVIEW_H_
+#define _ARRAYVIEW_H_
+
+#include <vector>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A read-only view of a contiguous array owned by some other object. It is
+ * as cheap to pass around as a pointer and a size, and never copies the
+ * elements.
+ *
+ * A view is only valid as long as the array it refers to is neither
+ * destroyed nor resized.
+ */
+template <class T>
+class ArrayView
+{
+public:
+    ArrayView()
+    {
+        first = NULL;
+        count = 0;
+    }
+
+    ArrayView(const T *data,size_t size)
+    {
+        first = data;
+        count = size;
+    }
+
+    ArrayView(const vector<T>& v)
+    {
+        first = v.empty()?NULL:&v[0];
+        count = v.size();
+    }
+
+    const T *data() const { return first;}
+    size_t size() const { return count;}
+    bool empty() const { return count==0;}
+    const T *begin() const { return first;}
+    const T *end() const { return first+count;}
+    const T& operator[](size_t i) const { return first[i];}
+
+    /*
+     * Make a copy of the viewed elements
+     */
+    vector<T> toVector() const
+    {
+        return vector<T>(begin(),end());
+    }
+
+private:
+    const T *first;
+    size_t count;
+};
+}
+
+#endif
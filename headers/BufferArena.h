@@ -0,0 +1,422 @@
+#ifndef _BUFFERARENA_H_
+#define _BUFFERARENA_H_
+
+#include "OpenGLFunctions.h"
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Hands out ranges of a linear space of the given capacity (e.g. vertices or
+ * indices of a buffer). Each allocation gets the smallest free range that it
+ * fits in (best fit), and freed ranges are merged with their free
+ * neighbours, so that the space does not fragment into small pieces.
+ */
+class OffsetAllocator
+{
+public:
+    OffsetAllocator()
+    {
+        capacity = 0;
+    }
+
+    size_t getCapacity() const
+    {
+        return capacity;
+    }
+
+    /*
+     * The size of the largest free range
+     */
+    size_t getLargestFree() const
+    {
+        return bySize.empty()?0:bySize.rbegin()->first;
+    }
+
+    /*
+     * Find room for size units
+     * \param offset receives the offset of the range
+     * \return false if there is no free range of that size
+     */
+    bool allocate(size_t size,size_t& offset)
+    {
+        if (size==0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        multimap<size_t,size_t>::iterator it = bySize.lower_bound(size);
+        if (it==bySize.end())
+            return false;
+
+        size_t freeSize = it->first;
+        offset = it->second;
+        bySize.erase(it);
+        byOffset.erase(offset);
+        if (freeSize>size)
+            insertFree(offset+size,freeSize-size);
+        return true;
+    }
+
+    /*
+     * Return a range given out by allocate
+     */
+    void free(size_t offset,size_t size)
+    {
+        if (size==0)
+            return;
+
+        //merge with the free range after it, and the one before it
+        map<size_t,size_t>::iterator next = byOffset.find(offset+size);
+        if (next!=byOffset.end())
+        {
+            size += next->second;
+            eraseFree(next);
+        }
+        map<size_t,size_t>::iterator previous = byOffset.lower_bound(offset);
+        if (previous!=byOffset.begin())
+        {
+            previous--;
+            if (previous->first+previous->second==offset)
+            {
+                offset = previous->first;
+                size += previous->second;
+                eraseFree(previous);
+            }
+        }
+        insertFree(offset,size);
+    }
+
+    /*
+     * Add [old capacity,capacity) to the free space
+     */
+    void grow(size_t newCapacity)
+    {
+        if (newCapacity<=capacity)
+            return;
+
+        size_t old = capacity;
+        capacity = newCapacity;
+        free(old,newCapacity-old);
+    }
+
+private:
+    void insertFree(size_t offset,size_t size)
+    {
+        byOffset[offset] = size;
+        bySize.insert(make_pair(size,offset));
+    }
+
+    void eraseFree(map<size_t,size_t>::iterator it)
+    {
+        pair<multimap<size_t,size_t>::iterator,multimap<size_t,size_t>::iterator> same =
+                bySize.equal_range(it->second);
+
+        for (multimap<size_t,size_t>::iterator s=same.first;s!=same.second;s++)
+        {
+            if (s->second==it->first)
+            {
+                bySize.erase(s);
+                break;
+            }
+        }
+        byOffset.erase(it);
+    }
+
+    size_t capacity;
+    map<size_t,size_t> byOffset; //free ranges: offset -> size
+    multimap<size_t,size_t> bySize; //the same ranges: size -> offset
+};
+
+/*
+ * How one vertex attribute is read from a vertex buffer, in the terms of
+ * glVertexAttribPointer
+ */
+struct VertexAttributeFormat
+{
+    GLuint location; //of the shader variable
+    int size;
+    GLenum type;
+    GLboolean normalized;
+    int offset; //in bytes, within a vertex
+
+    bool operator==(const VertexAttributeFormat& other) const
+    {
+        return (location==other.location) && (size==other.size)
+                && (type==other.type) && (normalized==other.normalized)
+                && (offset==other.offset);
+    }
+};
+
+/*
+ * One vertex buffer and one index buffer shared by all the meshes whose
+ * vertices have the same format, and the single VAO that reads them.
+ *
+ * Every mesh gets a range of vertices and a range of indices. The indices
+ * of a mesh stay relative to its first vertex, and are drawn with
+ * glDrawElementsBaseVertex, so that meshes only differ in their base vertex
+ * and first index and can be drawn one after the other without binding
+ * another VAO.
+ *
+ * When it runs out of room, the arena moves everything to buffers at least
+ * twice as large. Ranges keep their offsets when that happens.
+ */
+class BufferArena
+{
+public:
+    //the smallest buffers that an arena makes
+    static const size_t MIN_VERTICES = 65536;
+    static const size_t MIN_INDICES = 3*65536;
+
+    /*
+     * The part of an arena given to one mesh
+     */
+    struct Range
+    {
+        size_t baseVertex;
+        size_t vertexCount;
+        size_t firstIndex;
+        size_t indexCount;
+
+        Range()
+        {
+            baseVertex = vertexCount = firstIndex = indexCount = 0;
+        }
+    };
+
+    BufferArena(int sizeOfOneVertex,const vector<VertexAttributeFormat>& attributes)
+        :sizeOfOneVertex(sizeOfOneVertex),attributes(attributes)
+    {
+        vao = 0;
+        buffers[0] = buffers[1] = 0;
+    }
+
+    int getSizeOfOneVertex() const
+    {
+        return sizeOfOneVertex;
+    }
+
+    const vector<VertexAttributeFormat>& getAttributes() const
+    {
+        return attributes;
+    }
+
+    GLuint getVertexArray() const
+    {
+        return vao;
+    }
+
+    GLuint getVertexBuffer() const
+    {
+        return buffers[0];
+    }
+
+    GLuint getIndexBuffer() const
+    {
+        return buffers[1];
+    }
+
+    /*
+     * The number of vertices and indices that the buffers have room for
+     */
+    size_t getVertexCapacity() const
+    {
+        return vertices.getCapacity();
+    }
+
+    size_t getIndexCapacity() const
+    {
+        return indices.getCapacity();
+    }
+
+    /*
+     * Find room for a mesh, making the buffers larger if needed. Nothing is
+     * written to the range.
+     */
+    void allocate(OpenGLFunctions& gl,size_t vertexCount,size_t indexCount,Range& range)
+    {
+        if ((vao==0)
+                || (vertices.getLargestFree()<vertexCount)
+                || (indices.getLargestFree()<indexCount))
+            reserve(gl,vertexCount,indexCount);
+
+        vertices.allocate(vertexCount,range.baseVertex);
+        indices.allocate(indexCount,range.firstIndex);
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+    }
+
+    /*
+     * Give back a range made by allocate. Its contents are left as they are.
+     */
+    void release(Range& range)
+    {
+        vertices.free(range.baseVertex,range.vertexCount);
+        indices.free(range.firstIndex,range.indexCount);
+        range = Range();
+    }
+
+    /*
+     * Copy the indices of a mesh into its range
+     */
+    void writeIndices(OpenGLFunctions& gl,const Range& range,const unsigned int *data)
+    {
+        if (range.indexCount==0)
+            return;
+        gl.glBindBuffer(GL_COPY_WRITE_BUFFER,buffers[1]);
+        gl.glBufferSubData(GL_COPY_WRITE_BUFFER,
+                           range.firstIndex*sizeof(GLuint),
+                           range.indexCount*sizeof(GLuint),
+                           data);
+    }
+
+    void cleanup(OpenGLFunctions& gl)
+    {
+        if (vao!=0)
+        {
+            gl.glDeleteBuffers(2,buffers);
+            gl.glDeleteVertexArrays(1,&vao);
+            vao = 0;
+            buffers[0] = buffers[1] = 0;
+        }
+    }
+
+    /*
+     * Point the attributes of the VAO that is bound at the vertex buffer
+     * bound to GL_ARRAY_BUFFER, and enable them
+     * \param stride the stride to give glVertexAttribPointer
+     */
+    static void setAttributePointers(OpenGLFunctions& gl,
+                                     const vector<VertexAttributeFormat>& attributes,
+                                     int stride)
+    {
+        for (size_t i=0;i<attributes.size();i++)
+        {
+            const VertexAttributeFormat& a = attributes[i];
+
+            gl.glVertexAttribPointer(a.location,
+                                     a.size,
+                                     a.type,
+                                     a.normalized,
+                                     stride,
+                                     (void *)(size_t)a.offset);
+            gl.glEnableVertexAttribArray(a.location);
+        }
+    }
+
+private:
+    /*
+     * Make room for at least the given number of more vertices and indices,
+     * each in one piece
+     */
+    void reserve(OpenGLFunctions& gl,size_t vertexCount,size_t indexCount)
+    {
+        bool first = (vao==0);
+
+        if (first)
+            gl.glGenVertexArrays(1,&vao);
+        if (first || (vertices.getLargestFree()<vertexCount))
+            grow(gl,buffers[0],vertices,vertexCount,MIN_VERTICES,sizeOfOneVertex);
+        if (first || (indices.getLargestFree()<indexCount))
+            grow(gl,buffers[1],indices,indexCount,MIN_INDICES,sizeof(GLuint));
+
+        //the VAO remembers the buffers it reads from
+        gl.glBindVertexArray(vao);
+        gl.glBindBuffer(GL_ARRAY_BUFFER,buffers[0]);
+        setAttributePointers(gl,attributes,sizeOfOneVertex);
+        gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,buffers[1]);
+        gl.glBindVertexArray(0);
+    }
+
+    /*
+     * Replace the given buffer with one at least twice as large, with room
+     * for count more units in one piece, and copy the old one into it
+     */
+    static void grow(OpenGLFunctions& gl,GLuint& buffer,OffsetAllocator& allocator,
+                     size_t count,size_t minimum,size_t unitSize)
+    {
+        size_t old = allocator.getCapacity();
+        size_t capacity = std::max(minimum,2*old);
+        GLuint larger;
+
+        //enough even if the new room does not join a free range at the end
+        if (capacity-old<count)
+            capacity = old+count;
+
+        gl.glGenBuffers(1,&larger);
+        gl.glBindBuffer(GL_COPY_WRITE_BUFFER,larger);
+        gl.glBufferData(GL_COPY_WRITE_BUFFER,capacity*unitSize,NULL,GL_STATIC_DRAW);
+        if (old>0)
+        {
+            gl.glBindBuffer(GL_COPY_READ_BUFFER,buffer);
+            gl.glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,
+                                   0,0,old*unitSize);
+            gl.glDeleteBuffers(1,&buffer);
+        }
+        buffer = larger;
+        allocator.grow(capacity);
+    }
+
+    int sizeOfOneVertex;
+    vector<VertexAttributeFormat> attributes;
+    GLuint vao;
+    GLuint buffers[2]; //vertices, indices
+    OffsetAllocator vertices,indices;
+};
+
+/*
+ * The buffer arenas of a renderer, one for every vertex format in use
+ */
+class BufferArenas
+{
+public:
+    ~BufferArenas()
+    {
+        for (size_t i=0;i<arenas.size();i++)
+            delete arenas[i];
+    }
+
+    /*
+     * Returns the arena for vertices of the given format, making it if there
+     * is none yet
+     */
+    BufferArena& get(int sizeOfOneVertex,const vector<VertexAttributeFormat>& attributes)
+    {
+        for (size_t i=0;i<arenas.size();i++)
+        {
+            if ((arenas[i]->getSizeOfOneVertex()==sizeOfOneVertex)
+                    && (arenas[i]->getAttributes()==attributes))
+                return *arenas[i];
+        }
+        arenas.push_back(new BufferArena(sizeOfOneVertex,attributes));
+        return *arenas.back();
+    }
+
+    size_t size() const
+    {
+        return arenas.size();
+    }
+
+    void cleanup(OpenGLFunctions& gl)
+    {
+        for (size_t i=0;i<arenas.size();i++)
+        {
+            arenas[i]->cleanup(gl);
+            delete arenas[i];
+        }
+        arenas.clear();
+    }
+
+private:
+    vector<BufferArena *> arenas;
+};
+
+}
+
+#endif
@@ -0,0 +1,237 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define FRUSTUM_USE_SSE
+#endif
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A view frustum, as the 6 planes around it. A point p is on the inside of a
+ * plane (a,b,c,d) if a*p.x + b*p.y + c*p.z + d >= 0.
+ */
+class Frustum
+{
+public:
+    enum Result
+    {
+        OUTSIDE,
+        INTERSECTING,
+        INSIDE
+    };
+
+    /*
+     * A frustum that everything is inside of
+     */
+    Frustum()
+    {
+        for (int i=0;i<6;i++)
+            planes[i] = glm::vec4(0,0,0,1);
+    }
+
+    /*
+     * The frustum of a projection, in the coordinate system that the
+     * projection is applied to (view coordinates). The planes are taken from
+     * the rows of the matrix (Gribb and Hartmann)
+     */
+    explicit Frustum(const glm::mat4& projection)
+    {
+        glm::vec4 rows[4];
+
+        for (int r=0;r<4;r++)
+            rows[r] = glm::vec4(projection[0][r],projection[1][r],projection[2][r],projection[3][r]);
+
+        planes[0] = rows[3]+rows[0]; //left
+        planes[1] = rows[3]-rows[0]; //right
+        planes[2] = rows[3]+rows[1]; //bottom
+        planes[3] = rows[3]-rows[1]; //top
+        planes[4] = rows[3]+rows[2]; //near
+        planes[5] = rows[3]-rows[2]; //far
+        for (int i=0;i<6;i++)
+        {
+            float length = glm::length(glm::vec3(planes[i]));
+            if (length>0)
+                planes[i] /= length;
+        }
+    }
+
+    /*
+     * The same frustum, in the coordinate system that is transformed to the
+     * one of this frustum by a matrix
+     */
+    Frustum transformed(const glm::mat4& m) const
+    {
+        Frustum result;
+        glm::mat4 t = glm::transpose(m);
+
+        for (int i=0;i<6;i++)
+        {
+            result.planes[i] = t*planes[i];
+            float length = glm::length(glm::vec3(result.planes[i]));
+            if (length>0)
+                result.planes[i] /= length;
+        }
+        return result;
+    }
+
+    const glm::vec4& getPlane(int i) const
+    {
+        return planes[i];
+    }
+
+    /*
+     * Where a box is with respect to this frustum. Boxes close to a corner of
+     * the frustum may be found to intersect it while they are just outside
+     * \param center the center of the box
+     * \param extent half the size of the box along each axis
+     */
+    Result test(const glm::vec3& center,const glm::vec3& extent) const
+    {
+        Result result = INSIDE;
+
+        for (int i=0;i<6;i++)
+        {
+            glm::vec3 normal(planes[i]);
+            float d = glm::dot(normal,center)+planes[i].w;
+            float r = glm::dot(glm::abs(normal),extent);
+
+            if (d+r<0)
+                return OUTSIDE;
+            if (d-r<0)
+                result = INTERSECTING;
+        }
+        return result;
+    }
+
+    /*
+     * The box around a box after a transformation
+     * \param m the transformation
+     * \param minimum,maximum the corners of the box
+     * \param center receives the center of the transformed box
+     * \param extent receives half the size of the transformed box along each
+     * axis
+     */
+    static void transformBox(const glm::mat4& m,
+                             const glm::vec3& minimum,const glm::vec3& maximum,
+                             glm::vec3& center,glm::vec3& extent)
+    {
+        glm::vec3 c = 0.5f*(minimum+maximum);
+        glm::vec3 e = 0.5f*(maximum-minimum);
+
+        center = glm::vec3(m*glm::vec4(c,1));
+        extent = glm::abs(glm::vec3(m[0]))*e.x
+                + glm::abs(glm::vec3(m[1]))*e.y
+                + glm::abs(glm::vec3(m[2]))*e.z;
+    }
+
+private:
+    glm::vec4 planes[6];
+};
+
+/*
+ * Many boxes, each given by its center and extent, that are tested against a
+ * frustum together. The coordinates are kept in separate arrays (one for the
+ * x of all the centers, and so on) so that four boxes are tested at once
+ * with SSE.
+ */
+class BoxBatch
+{
+public:
+    size_t size() const
+    {
+        return cx.size();
+    }
+
+    void clear()
+    {
+        cx.clear(); cy.clear(); cz.clear();
+        ex.clear(); ey.clear(); ez.clear();
+    }
+
+    void add(const glm::vec3& center,const glm::vec3& extent)
+    {
+        cx.push_back(center.x); cy.push_back(center.y); cz.push_back(center.z);
+        ex.push_back(extent.x); ey.push_back(extent.y); ez.push_back(extent.z);
+    }
+
+    /*
+     * Find the boxes that are not outside a frustum
+     * \param visible receives 1 for every box that is not outside, 0 for
+     * every box that is
+     * \return the number of boxes that are not outside
+     */
+    size_t cull(const Frustum& frustum,vector<unsigned char>& visible) const
+    {
+        size_t n = size();
+        size_t count = 0;
+        size_t i = 0;
+
+        visible.resize(n);
+#ifdef FRUSTUM_USE_SSE
+        __m128 nx[6],ny[6],nz[6],nw[6],ax[6],ay[6],az[6];
+        const __m128 sign = _mm_set1_ps(-0.0f);
+
+        for (int p=0;p<6;p++)
+        {
+            const glm::vec4& plane = frustum.getPlane(p);
+            nx[p] = _mm_set1_ps(plane.x);
+            ny[p] = _mm_set1_ps(plane.y);
+            nz[p] = _mm_set1_ps(plane.z);
+            nw[p] = _mm_set1_ps(plane.w);
+            ax[p] = _mm_andnot_ps(sign,nx[p]);
+            ay[p] = _mm_andnot_ps(sign,ny[p]);
+            az[p] = _mm_andnot_ps(sign,nz[p]);
+        }
+        for (;i+4<=n;i+=4)
+        {
+            __m128 x = _mm_loadu_ps(&cx[i]),y = _mm_loadu_ps(&cy[i]),z = _mm_loadu_ps(&cz[i]);
+            __m128 w = _mm_loadu_ps(&ex[i]),h = _mm_loadu_ps(&ey[i]),l = _mm_loadu_ps(&ez[i]);
+            __m128 outside = _mm_setzero_ps();
+
+            for (int p=0;p<6;p++)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p],x),_mm_mul_ps(ny[p],y)),
+                                      _mm_add_ps(_mm_mul_ps(nz[p],z),nw[p]));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p],w),_mm_mul_ps(ay[p],h)),
+                                      _mm_mul_ps(az[p],l));
+                outside = _mm_or_ps(outside,_mm_cmplt_ps(_mm_add_ps(d,r),_mm_setzero_ps()));
+            }
+
+            int mask = _mm_movemask_ps(outside);
+            for (int k=0;k<4;k++)
+            {
+                visible[i+k] = ((mask>>k)&1)?0:1;
+                count += visible[i+k];
+            }
+        }
+#endif
+        for (;i<n;i++)
+        {
+            bool outside = false;
+            for (int p=0;(p<6) && !outside;p++)
+            {
+                const glm::vec4& plane = frustum.getPlane(p);
+                float d = plane.x*cx[i]+plane.y*cy[i]+plane.z*cz[i]+plane.w;
+                float r = fabs(plane.x)*ex[i]+fabs(plane.y)*ey[i]+fabs(plane.z)*ez[i];
+                outside = (d+r<0);
+            }
+            visible[i] = outside?0:1;
+            count += visible[i];
+        }
+        return count;
+    }
+
+private:
+    vector<float> cx,cy,cz,ex,ey,ez;
+};
+}
+
+#endif
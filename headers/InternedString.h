@@ -0,0 +1,171 @@
+#ifndef _INTERNEDSTRING_H_
+#define _INTERNEDSTRING_H_
+
+#include <string>
+#include <ostream>
+#include <functional>
+#include <unordered_set>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A string kept once in a table shared by the whole program. Copies of it
+ * are one pointer, and two of them are equal if they point to the same
+ * string. Strings that are interned are never taken out of the table, which
+ * suits the names of nodes, meshes and textures: there are few distinct ones
+ * and they are used over and over.
+ *
+ * The table is not safe to use from more than one thread at a time.
+ */
+class InternedString
+{
+public:
+    /*
+     * The empty string
+     */
+    InternedString()
+    {
+        static const string *none = &intern(string());
+
+        value = none;
+    }
+
+    InternedString(const string& s)
+    {
+        value = &intern(s);
+    }
+
+    InternedString(const char *s)
+    {
+        value = &intern(string(s));
+    }
+
+    const string& str() const
+    {
+        return *value;
+    }
+
+    operator const string&() const
+    {
+        return *value;
+    }
+
+    size_t length() const
+    {
+        return value->length();
+    }
+
+    bool empty() const
+    {
+        return value->empty();
+    }
+
+    bool operator==(const InternedString& s) const
+    {
+        return value==s.value;
+    }
+
+    bool operator!=(const InternedString& s) const
+    {
+        return value!=s.value;
+    }
+
+    bool operator==(const string& s) const
+    {
+        return *value==s;
+    }
+
+    bool operator!=(const string& s) const
+    {
+        return *value!=s;
+    }
+
+    bool operator==(const char *s) const
+    {
+        return *value==s;
+    }
+
+    bool operator!=(const char *s) const
+    {
+        return *value!=s;
+    }
+
+    /*
+     * Finds the interned string equal to s without adding it to the table
+     * \param s the string
+     * \param found receives the interned string, if there is one
+     * \return false if s has never been interned
+     */
+    static bool find(const string& s,InternedString& found)
+    {
+        unordered_set<string>::const_iterator it = table().find(s);
+
+        if (it==table().end())
+            return false;
+        found.value = &(*it);
+        return true;
+    }
+
+    /*
+     * Hashes interned strings by the string they point to, which is as good
+     * as hashing the string itself since each string is kept once
+     */
+    struct Hash
+    {
+        size_t operator()(const InternedString& s) const
+        {
+            return std::hash<const string *>()(s.value);
+        }
+    };
+
+private:
+    /*
+     * The string in the table that is equal to s, which is added if there is
+     * none. Elements of an unordered_set do not move when it grows, so the
+     * pointers to them stay valid. The table is never destroyed, so that
+     * strings may still be used while the program exits
+     */
+    static const string& intern(const string& s)
+    {
+        return *table().insert(s).first;
+    }
+
+    static unordered_set<string>& table()
+    {
+        static unordered_set<string> *strings = new unordered_set<string>();
+
+        return *strings;
+    }
+
+    const string *value;
+};
+
+inline ostream& operator<<(ostream& out,const InternedString& s)
+{
+    return out << s.str();
+}
+
+inline string operator+(const string& a,const InternedString& b)
+{
+    return a+b.str();
+}
+
+inline string operator+(const InternedString& a,const string& b)
+{
+    return a.str()+b;
+}
+
+inline string operator+(const char *a,const InternedString& b)
+{
+    return a+b.str();
+}
+
+inline string operator+(const InternedString& a,const char *b)
+{
+    return a.str()+b;
+}
+}
+
+#endif
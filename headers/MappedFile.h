@@ -0,0 +1,140 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A read-only view of a whole file, mapped into memory by the operating
+ * system. The contents are available through begin() and end() for as long
+ * as this object is alive. The contents are NOT null-terminated.
+ *
+ * Objects of this class cannot be copied.
+ */
+class MappedFile
+{
+public:
+    /*
+     * Map the file with the given name into memory
+     * \param filename the path of the file to be mapped
+     * \throws runtime_error if the file cannot be opened or mapped
+     */
+    MappedFile(const string& filename) throw(runtime_error)
+    {
+        data = NULL;
+        length = 0;
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+
+        file = CreateFileA(filename.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,
+                           OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+        if (file==INVALID_HANDLE_VALUE)
+            throw runtime_error("Could not open file: "+filename);
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file,&fileSize))
+        {
+            release();
+            throw runtime_error("Could not read size of file: "+filename);
+        }
+        length = (size_t)fileSize.QuadPart;
+
+        if (length>0)
+        {
+            mapping = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+            if (mapping!=NULL)
+                data = (const char *)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+            if (data==NULL)
+            {
+                release();
+                throw runtime_error("Could not map file: "+filename);
+            }
+        }
+#else
+        fd = open(filename.c_str(),O_RDONLY);
+        if (fd<0)
+            throw runtime_error("Could not open file: "+filename);
+
+        struct stat info;
+        if (fstat(fd,&info)!=0)
+        {
+            release();
+            throw runtime_error("Could not read size of file: "+filename);
+        }
+        length = (size_t)info.st_size;
+
+        if (length>0)
+        {
+            void *addr = mmap(NULL,length,PROT_READ,MAP_PRIVATE,fd,0);
+            if (addr==MAP_FAILED)
+            {
+                release();
+                throw runtime_error("Could not map file: "+filename);
+            }
+            data = (const char *)addr;
+            //the importers read the file front to back exactly once
+            madvise(addr,length,MADV_SEQUENTIAL);
+        }
+#endif
+    }
+
+    ~MappedFile()
+    {
+        release();
+    }
+
+    const char *begin() const { return data;}
+    const char *end() const { return data+length;}
+    size_t size() const { return length;}
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void release()
+    {
+#ifdef _WIN32
+        if (data!=NULL)
+            UnmapViewOfFile(data);
+        if (mapping!=NULL)
+            CloseHandle(mapping);
+        if (file!=INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data!=NULL)
+            munmap((void *)data,length);
+        if (fd>=0)
+            close(fd);
+        fd = -1;
+#endif
+        data = NULL;
+        length = 0;
+    }
+
+    const char *data;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file,mapping;
+#else
+    int fd;
+#endif
+};
+}
+
+#endif
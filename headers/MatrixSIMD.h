@@ -0,0 +1,42 @@
+#ifndef _MATRIXSIMD_H_
+#define _MATRIXSIMD_H_
+
+#include <glm/glm.hpp>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MATRIXSIMD_USE_SSE
+#endif
+
+namespace util
+{
+
+/*
+ * Multiplies two matrices, a column of the result at a time with SSE where
+ * it is there. out may be either of a and b
+ * \param a the matrix on the left
+ * \param b the matrix on the right
+ * \param out receives a*b
+ */
+inline void multiplyMatrices(const glm::mat4& a,const glm::mat4& b,glm::mat4& out)
+{
+#ifdef MATRIXSIMD_USE_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+    for (int j=0;j<4;j++)
+    {
+        __m128 column = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0,_mm_set1_ps(b[j][0])),
+                                              _mm_mul_ps(a1,_mm_set1_ps(b[j][1]))),
+                                   _mm_add_ps(_mm_mul_ps(a2,_mm_set1_ps(b[j][2])),
+                                              _mm_mul_ps(a3,_mm_set1_ps(b[j][3]))));
+        _mm_storeu_ps(&out[j][0],column);
+    }
+#else
+    out = a*b;
+#endif
+}
+}
+
+#endif
@@ -0,0 +1,401 @@
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace util
+{
+
+/*
+ * An on-disk cache of imported meshes, so that a model does not have to be
+ * parsed from its text OBJ file every time it is loaded.
+ *
+ * Each cache entry is a binary file that stores the final vertex data of a
+ * PolygonMesh (all attributes of a vertex interleaved, in the order of the
+ * vertex layout) and its index array. An entry is keyed by the path
+ * of the OBJ file, the import options, and the size and modification time
+ * of the OBJ file, so editing or replacing the OBJ file invalidates its entry.
+ *
+ * Paths are compared as given, so the same model should always be referred
+ * to by the same (relative) path.
+ */
+template <class K>
+class MeshCache
+{
+public:
+    /*
+     * Import a PolygonMesh from an OBJ file, using the cached copy if it is
+     * up to date. On a miss the OBJ file is imported and a new cache entry is
+     * written. Failure to write the cache entry is not an error.
+     * \param filename the path of the OBJ file
+     * \param options passed on to ObjImporter. Entries made with different
+     *        options (other than the number of threads) are kept separately
+     * \param directory the directory in which cache entries are kept
+     * \throws string if the OBJ file cannot be imported
+     */
+    static PolygonMesh<K> importFile(const string& filename,
+                                     const ObjImportOptions& options,
+                                     const string& directory="meshcache") throw(string)
+    {
+        PolygonMesh<K> mesh;
+        SourceInfo source;
+
+        if (!getSourceInfo(filename,source))
+            throw string("Could not open file: "+filename);
+
+        string entry = entryName(filename,options,directory);
+        if (readEntry(entry,filename,source,options,mesh))
+            return mesh;
+
+        mesh = ObjImporter<K>::importFile(filename,options);
+        writeEntry(entry,filename,source,options,mesh,directory);
+        return mesh;
+    }
+
+    static PolygonMesh<K> importFile(const string& filename,
+                                     bool scaleAndCenter,
+                                     unsigned int numThreads=0,
+                                     const string& directory="meshcache") throw(string)
+    {
+        ObjImportOptions options;
+
+        options.scaleAndCenter = scaleAndCenter;
+        options.numThreads = numThreads;
+        return importFile(filename,options,directory);
+    }
+
+    /*
+     * Make sure that the cache has an up-to-date entry for the given OBJ file
+     * \return true if a new entry had to be made, false if it was up to date
+     * \throws string if the OBJ file cannot be imported
+     */
+    static bool warm(const string& filename,
+                     const ObjImportOptions& options,
+                     const string& directory="meshcache") throw(string)
+    {
+        PolygonMesh<K> mesh;
+        SourceInfo source;
+
+        if (!getSourceInfo(filename,source))
+            throw string("Could not open file: "+filename);
+
+        string entry = entryName(filename,options,directory);
+        if (readEntry(entry,filename,source,options,mesh))
+            return false;
+
+        mesh = ObjImporter<K>::importFile(filename,options);
+        if (!writeEntry(entry,filename,source,options,mesh,directory))
+            throw string("Could not write cache entry for "+filename);
+        return true;
+    }
+
+    /*
+     * Returns the name of the cache entry for the given OBJ file
+     */
+    static string entryName(const string& filename,
+                            const ObjImportOptions& options,
+                            const string& directory)
+    {
+        //64-bit FNV-1a hash of the path
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i=0;i<filename.length();i++)
+        {
+            hash ^= (unsigned char)filename[i];
+            hash *= 1099511628211ULL;
+        }
+
+        char name[40];
+        sprintf(name,"%08x%08x-%x.mesh",
+                (unsigned int)(hash>>32),(unsigned int)hash,optionFlags(options));
+        return directory+"/"+name;
+    }
+
+private:
+    typedef typename PolygonMesh<K>::Layout Layout;
+
+    struct SourceInfo
+    {
+        uint64_t size;
+        int64_t mtime;
+    };
+
+    /*
+     * The fixed-size part of a cache entry. It is followed by the source
+     * path, the attribute table (name length, name, number of components for
+     * each attribute), the vertex data and finally the indices. The vertex
+     * data and indices are 4-byte aligned.
+     */
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint32_t optionFlags;
+        float weldEpsilon;
+        uint32_t pathLength;
+        uint32_t attributeCount;
+        uint32_t floatsPerVertex;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        int32_t primitiveType;
+        int32_t primitiveSize;
+    };
+
+    /*
+     * Must be changed whenever the import makes different meshes from the
+     * same file, so that entries made before are not used (3: normals are
+     * computed after the primitives are set, by MeshKernels; 4: vertices of
+     * faces without normals get computed ones in files that have some)
+     */
+    static const uint32_t VERSION = 4;
+
+    /*
+     * The import options that change the resulting mesh, as bits
+     */
+    static uint32_t optionFlags(const ObjImportOptions& options)
+    {
+        return (options.scaleAndCenter?1u:0u)
+                | (options.indexed?2u:0u)
+                | ((options.indexed && (options.weldEpsilon>0.0f))?4u:0u)
+                | (options.optimize?8u:0u);
+    }
+
+    static float weldEpsilon(const ObjImportOptions& options)
+    {
+        return (optionFlags(options) & 4u)?options.weldEpsilon:0.0f;
+    }
+
+    static bool getSourceInfo(const string& filename,SourceInfo& info)
+    {
+        struct stat s;
+
+        if (stat(filename.c_str(),&s)!=0)
+            return false;
+        info.size = (uint64_t)s.st_size;
+        info.mtime = (int64_t)s.st_mtime;
+        return true;
+    }
+
+    static size_t align4(size_t n)
+    {
+        return (n+3) & ~((size_t)3);
+    }
+
+    static bool readEntry(const string& entry,
+                          const string& filename,
+                          const SourceInfo& source,
+                          const ObjImportOptions& options,
+                          PolygonMesh<K>& mesh)
+    {
+        try
+        {
+            MappedFile file(entry);
+            const char *p = file.begin();
+            const char *end = file.end();
+            Header header;
+
+            if (file.size()<sizeof(Header))
+                return false;
+            memcpy(&header,p,sizeof(Header));
+            p += sizeof(Header);
+
+            if ((memcmp(header.magic,"SKMC",4)!=0)
+                    || (header.version!=VERSION)
+                    || (header.sourceSize!=source.size)
+                    || (header.sourceMtime!=source.mtime)
+                    || (header.optionFlags!=optionFlags(options))
+                    || (header.weldEpsilon!=weldEpsilon(options))
+                    || (header.pathLength!=filename.length())
+                    || ((size_t)(end-p)<header.pathLength)
+                    || (memcmp(p,filename.c_str(),header.pathLength)!=0))
+                return false;
+            p += header.pathLength;
+
+            //the attribute table must describe exactly the current layout
+            uint32_t total = 0;
+            if (header.attributeCount!=(uint32_t)Layout::attributeCount)
+                return false;
+            for (uint32_t a=0;a<header.attributeCount;a++)
+            {
+                uint32_t length,count;
+
+                if ((size_t)(end-p)<sizeof(uint32_t))
+                    return false;
+                memcpy(&length,p,sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                if ((size_t)(end-p)<length+sizeof(uint32_t))
+                    return false;
+                if (string(p,length)!=Layout::name(a))
+                    return false;
+                p += length;
+                memcpy(&count,p,sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                if (count!=(uint32_t)Layout::components(a))
+                    return false;
+                total += count;
+            }
+            p = file.begin() + align4(p-file.begin());
+
+            size_t vertexBytes = (size_t)header.vertexCount*header.floatsPerVertex*sizeof(float);
+            size_t indexBytes = (size_t)header.indexCount*sizeof(unsigned int);
+            if ((total!=header.floatsPerVertex)
+                    || (p>end)
+                    || ((size_t)(end-p)!=vertexBytes+indexBytes))
+                return false;
+
+            vector<unsigned int> primitives(header.indexCount);
+            if (indexBytes>0)
+                memcpy(&primitives[0],p+vertexBytes,indexBytes);
+
+            //de-interleave straight into the arrays of the mesh
+            VertexArrays<Layout> vertexData(header.vertexCount);
+            for (int a=0;a<Layout::attributeCount;a++)
+            {
+                size_t c = Layout::components(a);
+                const char *src = p + Layout::offset(a)*sizeof(float);
+                float *dest = vertexData.data(a);
+
+                for (uint32_t i=0;i<header.vertexCount;i++)
+                {
+                    memcpy(dest,src,c*sizeof(float));
+                    dest += c;
+                    src += Layout::stride*sizeof(float);
+                }
+            }
+
+            mesh.swapVertexArrays(vertexData);
+            mesh.swapPrimitives(primitives);
+            mesh.setPrimitiveType(header.primitiveType);
+            mesh.setPrimitiveSize(header.primitiveSize);
+            return true;
+        }
+        catch (runtime_error& e)
+        {
+            //a missing or unreadable entry is simply a miss
+            return false;
+        }
+    }
+
+    static bool writeEntry(const string& entry,
+                           const string& filename,
+                           const SourceInfo& source,
+                           const ObjImportOptions& options,
+                           const PolygonMesh<K>& mesh,
+                           const string& directory)
+    {
+        const VertexArrays<Layout>& vertexData = mesh.getVertexArrays();
+        ArrayView<unsigned int> primitives = mesh.getPrimitivesView();
+        Header header;
+        int a;
+
+        //the padding is written too, so it must not be left uninitialized or
+        //identical imports would make different entries
+        memset(&header,0,sizeof(Header));
+        memcpy(header.magic,"SKMC",4);
+        header.version = VERSION;
+        header.sourceSize = source.size;
+        header.sourceMtime = source.mtime;
+        header.optionFlags = optionFlags(options);
+        header.weldEpsilon = weldEpsilon(options);
+        header.pathLength = filename.length();
+        header.floatsPerVertex = Layout::stride;
+        header.attributeCount = Layout::attributeCount;
+        header.vertexCount = vertexData.size();
+        header.indexCount = primitives.size();
+        header.primitiveType = mesh.getPrimitiveType();
+        header.primitiveSize = mesh.getPrimitiveSize();
+
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(),0755);
+#endif
+
+        //write to a temporary file first, so a reader never sees half an entry.
+        //It is named after this process, so that processes warming the same
+        //model at once do not write into each other's file
+        ostringstream tempName;
+#ifdef _WIN32
+        tempName << entry << "." << _getpid() << ".tmp";
+#else
+        tempName << entry << "." << getpid() << ".tmp";
+#endif
+        string temp = tempName.str();
+        ofstream out(temp.c_str(),ios::out | ios::binary | ios::trunc);
+        if (!out.is_open())
+            return false;
+
+        size_t offset = 0;
+        out.write((const char *)&header,sizeof(Header));
+        out.write(filename.c_str(),filename.length());
+        offset += sizeof(Header)+filename.length();
+        for (a=0;a<Layout::attributeCount;a++)
+        {
+            uint32_t length = strlen(Layout::name(a));
+            uint32_t components = Layout::components(a);
+            out.write((const char *)&length,sizeof(uint32_t));
+            out.write(Layout::name(a),length);
+            out.write((const char *)&components,sizeof(uint32_t));
+            offset += 2*sizeof(uint32_t)+length;
+        }
+        static const char padding[4] = {0,0,0,0};
+        out.write(padding,align4(offset)-offset);
+
+        //interleave the attributes of each vertex
+        vector<float> floats((size_t)header.vertexCount*header.floatsPerVertex);
+        for (a=0;a<Layout::attributeCount;a++)
+        {
+            size_t c = Layout::components(a);
+            const float *src = vertexData.data(a);
+            float *dest = floats.empty()?NULL:&floats[Layout::offset(a)];
+
+            for (size_t i=0;i<vertexData.size();i++)
+            {
+                memcpy(dest,src,c*sizeof(float));
+                src += c;
+                dest += Layout::stride;
+            }
+        }
+        if (floats.size()>0)
+            out.write((const char *)&floats[0],floats.size()*sizeof(float));
+        if (primitives.size()>0)
+            out.write((const char *)primitives.data(),primitives.size()*sizeof(unsigned int));
+        out.close();
+
+        if (out.fail())
+        {
+            remove(temp.c_str());
+            return false;
+        }
+
+        remove(entry.c_str());
+        if (rename(temp.c_str(),entry.c_str())!=0)
+        {
+            remove(temp.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,300 @@
+#ifndef _MESHKERNELS_H_
+#define _MESHKERNELS_H_
+
+#include <glm/glm.hpp>
+#if (GLM_ARCH & GLM_ARCH_SSE2)
+#include <glm/gtx/simd_vec4.hpp>
+#endif
+#include "Parallel.h"
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Loops over the vertex arrays of a mesh that are too slow to write with
+ * glm::vec4 gets and sets: the bounding box of the positions and the vertex
+ * normals of a polygon mesh.
+ *
+ * Every function works on plain arrays of floats with the given number of
+ * floats (at least 3) per element. Arrays of 4 floats per element are
+ * processed 4 floats at a time with SSE2, through glm's simdVec4, if the
+ * compiler supports it (define GLM_FORCE_PURE to turn this off). Everything
+ * else goes through an equivalent scalar loop.
+ *
+ * Large arrays are split among several threads. numThreads is the number of
+ * threads to use at most; 0 means one per core.
+ */
+class MeshKernels
+{
+public:
+    //not worth starting a thread for fewer vertices or primitives than this
+    static const size_t GRAIN = 65536;
+
+    /*
+     * Find the smallest and largest x, y and z of the given positions. The w
+     * of both bounds is the w of the first position.
+     * \param positions count positions, stride floats each
+     * \return false if there are no positions
+     */
+    static bool bounds(const float *positions,size_t count,int stride,
+                       glm::vec4& minimum,glm::vec4& maximum,
+                       unsigned int numThreads=0)
+    {
+        if (count==0)
+            return false;
+
+        unsigned int threads = threadCount(count,numThreads,GRAIN);
+        vector<glm::vec4> minima(threads),maxima(threads);
+
+        parallelFor(threads,threads,[&](size_t first,size_t last)
+        {
+            for (size_t t=first;t<last;t++)
+                boundsOfRange(positions,count*t/threads,count*(t+1)/threads,
+                              stride,minima[t],maxima[t]);
+        });
+
+        minimum = minima[0];
+        maximum = maxima[0];
+        for (unsigned int t=1;t<threads;t++)
+        {
+            minimum = glm::min(minimum,minima[t]);
+            maximum = glm::max(maximum,maxima[t]);
+        }
+        minimum.w = maximum.w = (stride>=4)?positions[3]:1.0f;
+        return true;
+    }
+
+    /*
+     * Compute the normal of every vertex as the average of the unit normals
+     * of the polygons that share it (by Newell's method). Polygons of zero
+     * area, or that refer to vertices that do not exist, are ignored.
+     * Vertices that no polygon refers to get a zero normal.
+     * \param positions vertexCount positions, stride floats each
+     * \param indices indexCount indices, primitiveSize per polygon
+     * \param normals vertexCount normals, stride floats each, overwritten
+     */
+    static void normals(const float *positions,size_t vertexCount,
+                        const unsigned int *indices,size_t indexCount,
+                        int primitiveSize,
+                        float *normals,int stride,
+                        unsigned int numThreads=0)
+    {
+        if (vertexCount==0)
+            return;
+
+        size_t polygons = (primitiveSize>0)?indexCount/primitiveSize:0;
+        unsigned int threads = threadCount(polygons,numThreads,GRAIN);
+
+        //every thread but the first adds up its polygons in its own copy of
+        //the normals, so no two threads ever write to the same place
+        vector< vector<float> > partial(threads-1);
+
+        parallelFor(threads,threads,[&](size_t first,size_t last)
+        {
+            for (size_t t=first;t<last;t++)
+            {
+                float *sums = normals;
+
+                if (t==0)
+                    memset(normals,0,vertexCount*stride*sizeof(float));
+                else
+                {
+                    partial[t-1].assign(vertexCount*stride,0.0f);
+                    sums = &partial[t-1][0];
+                }
+                accumulate(positions,vertexCount,indices,
+                           polygons*t/threads,polygons*(t+1)/threads,
+                           primitiveSize,sums,stride);
+            }
+        });
+
+        parallelFor(vertexCount,threads,[&](size_t first,size_t last)
+        {
+            for (size_t t=0;t<partial.size();t++)
+                add(&partial[t][0],first,last,stride,normals);
+            normalize(first,last,stride,normals);
+        });
+    }
+
+private:
+    static glm::vec3 load3(const float *f)
+    {
+        return glm::vec3(f[0],f[1],f[2]);
+    }
+
+    static void boundsOfRange(const float *positions,size_t first,size_t last,int stride,
+                              glm::vec4& minimum,glm::vec4& maximum)
+    {
+        const float *p = positions + first*stride;
+        size_t i = first;
+
+#if (GLM_ARCH & GLM_ARCH_SSE2)
+        if (stride==4)
+        {
+            //two independent pairs of bounds, to keep two loads in flight
+            glm::simdVec4 lo0(_mm_loadu_ps(p)),hi0(lo0),lo1(lo0),hi1(lo0);
+
+            for (;i+2<=last;i+=2,p+=8)
+            {
+                glm::simdVec4 a(_mm_loadu_ps(p)),b(_mm_loadu_ps(p+4));
+
+                lo0 = glm::min(lo0,a);
+                hi0 = glm::max(hi0,a);
+                lo1 = glm::min(lo1,b);
+                hi1 = glm::max(hi1,b);
+            }
+            if (i<last)
+            {
+                glm::simdVec4 a(_mm_loadu_ps(p));
+
+                lo0 = glm::min(lo0,a);
+                hi0 = glm::max(hi0,a);
+            }
+            minimum = glm::vec4_cast(glm::min(lo0,lo1));
+            maximum = glm::vec4_cast(glm::max(hi0,hi1));
+            return;
+        }
+#endif
+        glm::vec3 lo = load3(p),hi = lo;
+
+        for (;i<last;i++,p+=stride)
+        {
+            glm::vec3 a = load3(p);
+
+            lo = glm::min(lo,a);
+            hi = glm::max(hi,a);
+        }
+        minimum = glm::vec4(lo,0.0f);
+        maximum = glm::vec4(hi,0.0f);
+    }
+
+    /*
+     * Add the unit normals of polygons [first,last) to the normals of their
+     * vertices
+     */
+    static void accumulate(const float *positions,size_t vertexCount,
+                           const unsigned int *indices,size_t first,size_t last,
+                           int primitiveSize,float *sums,int stride)
+    {
+        const unsigned int *polygon = indices + first*primitiveSize;
+        int k;
+
+        //for a triangle, Newell's method comes down to a cross product, which
+        //is exactly zero when two corners are the same point
+        for (size_t i=first;i<last;i++,polygon+=primitiveSize)
+        {
+            for (k=0;k<primitiveSize;k++)
+            {
+                if (polygon[k]>=vertexCount)
+                    break;
+            }
+            if (k<primitiveSize)
+                continue;
+
+#if (GLM_ARCH & GLM_ARCH_SSE2)
+            if ((primitiveSize==3) && (stride==4))
+            {
+                glm::simdVec4 a(_mm_loadu_ps(positions+4*polygon[0]));
+                glm::simdVec4 b(_mm_loadu_ps(positions+4*polygon[1]));
+                glm::simdVec4 c(_mm_loadu_ps(positions+4*polygon[2]));
+                glm::simdVec4 norm = glm::cross(b-a,c-a);
+                glm::simdVec4 lengthSquared = glm::dot4(norm,norm);
+
+                if (_mm_cvtss_f32(lengthSquared.Data)<=0.0f)
+                    continue;
+                norm = norm / glm::niceSqrt(lengthSquared);
+
+                for (k=0;k<3;k++)
+                {
+                    float *n = sums+4*polygon[k];
+                    _mm_storeu_ps(n,_mm_add_ps(_mm_loadu_ps(n),norm.Data));
+                }
+                continue;
+            }
+#endif
+            glm::vec3 norm(0.0f,0.0f,0.0f);
+
+            if (primitiveSize==3)
+            {
+                glm::vec3 a = load3(positions+stride*polygon[0]);
+                glm::vec3 b = load3(positions+stride*polygon[1]);
+                glm::vec3 c = load3(positions+stride*polygon[2]);
+
+                norm = glm::cross(b-a,c-a);
+            }
+            else
+            {
+                //the newell's method to calculate normal
+                for (k=0;k<primitiveSize;k++)
+                {
+                    glm::vec3 a = load3(positions+stride*polygon[k]);
+                    glm::vec3 b = load3(positions+stride*polygon[(k+1)%primitiveSize]);
+
+                    norm.x += (a.y-b.y)*(a.z+b.z);
+                    norm.y += (a.z-b.z)*(a.x+b.x);
+                    norm.z += (a.x-b.x)*(a.y+b.y);
+                }
+            }
+            float lengthSquared = glm::dot(norm,norm);
+            if (lengthSquared<=0.0f)
+                continue;
+            norm = norm / sqrtf(lengthSquared);
+
+            for (k=0;k<primitiveSize;k++)
+            {
+                float *n = sums+stride*polygon[k];
+                n[0] += norm.x;
+                n[1] += norm.y;
+                n[2] += norm.z;
+            }
+        }
+    }
+
+    static void add(const float *partial,size_t first,size_t last,int stride,float *normals)
+    {
+        for (size_t i=first*stride;i<last*stride;i++)
+            normals[i] += partial[i];
+    }
+
+    static void normalize(size_t first,size_t last,int stride,float *normals)
+    {
+        float *n = normals + first*stride;
+        size_t i = first;
+
+#if (GLM_ARCH & GLM_ARCH_SSE2)
+        if (stride==4)
+        {
+            for (;i<last;i++,n+=4)
+            {
+                glm::simdVec4 norm(_mm_loadu_ps(n));
+                glm::simdVec4 lengthSquared = glm::dot4(norm,norm);
+
+                if (_mm_cvtss_f32(lengthSquared.Data)>0.0f)
+                    _mm_storeu_ps(n,(norm / glm::niceSqrt(lengthSquared)).Data);
+            }
+            return;
+        }
+#endif
+        for (;i<last;i++,n+=stride)
+        {
+            glm::vec3 norm = load3(n);
+            float lengthSquared = glm::dot(norm,norm);
+
+            if (lengthSquared>0.0f)
+            {
+                norm = norm / sqrtf(lengthSquared);
+                n[0] = norm.x;
+                n[1] = norm.y;
+                n[2] = norm.z;
+            }
+        }
+    }
+};
+}
+
+#endif
@@ -0,0 +1,498 @@
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include "PolygonMesh.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * How well an index buffer uses a FIFO post-transform vertex cache.
+ * ACMR (average cache miss ratio) is the number of vertices transformed per
+ * triangle: 3 without any reuse, 0.5 at best for a large regular mesh.
+ * ATVR (average transform to vertex ratio) is the number of vertices
+ * transformed per vertex used: 1 is the best possible.
+ */
+struct VertexCacheStats
+{
+    size_t triangles;
+    size_t vertices; //distinct vertices used by the triangles
+    size_t misses;
+
+    VertexCacheStats()
+    {
+        triangles = vertices = misses = 0;
+    }
+
+    double acmr() const
+    {
+        return (triangles>0)?(double)misses/triangles:0.0;
+    }
+
+    double atvr() const
+    {
+        return (vertices>0)?(double)misses/vertices:0.0;
+    }
+};
+
+/*
+ * Reorders the triangles and vertices of a triangle mesh so that the GPU
+ * draws it faster, without changing what is drawn. This is done in three
+ * passes, after Sander, Nehab and Barczak, "Fast triangle reordering for
+ * vertex locality and reduced overdraw" (2007):
+ *
+ * 1. Tipsify: triangles are emitted as fans around vertices that are still
+ *    in the post-transform vertex cache, so that most vertices are
+ *    transformed only once.
+ * 2. Overdraw: the Tipsify order is cut into clusters at the points where
+ *    the cache gains little from keeping triangles together, and the
+ *    clusters are sorted so that those that face away from the center of the
+ *    mesh (and so tend to hide the others) are drawn first.
+ * 3. Vertex fetch: vertices are renumbered in the order in which the
+ *    triangles first use them, so that vertex data is read sequentially.
+ *    Vertices that no triangle uses are moved to the end.
+ *
+ * Only meshes of GL_TRIANGLES-style triangles (3 indices a primitive) are
+ * changed.
+ */
+template <class K>
+class MeshOptimizer
+{
+public:
+    //the vertex cache size to optimize for. Tipsify is not very sensitive to
+    //it, and 16 is smaller than the cache of any current GPU
+    static const unsigned int CACHE_SIZE = 16;
+
+    /*
+     * Reorder the triangles and vertices of the given mesh
+     * \param cacheSize the vertex cache size to optimize for
+     * \param overdrawThreshold how much worse than the Tipsify order (as a
+     *        factor of its ACMR) the vertex cache may get in exchange for
+     *        less overdraw. 1 keeps the Tipsify order within each cluster
+     *        boundary that Tipsify itself made
+     */
+    static void optimize(PolygonMesh<K>& mesh,
+                         unsigned int cacheSize=CACHE_SIZE,
+                         float overdrawThreshold=1.05f)
+    {
+        if ((mesh.getPrimitiveSize()!=3) || (mesh.getVertexCount()<=0))
+            return;
+
+        vector<unsigned int> indices = mesh.getPrimitives();
+        size_t vertexCount = mesh.getVertexCount();
+
+        indices.resize(indices.size()-indices.size()%3);
+        for (size_t i=0;i<indices.size();i++)
+        {
+            //leave a broken mesh alone
+            if (indices[i]>=vertexCount)
+                return;
+        }
+
+        vector<unsigned int> clusters;
+        tipsify(indices,vertexCount,cacheSize,clusters);
+
+        const float *positions = positionData(mesh);
+        if (positions!=NULL)
+            optimizeOverdraw(indices,clusters,vertexCount,
+                             positions,Layout::components(position()),
+                             cacheSize,overdrawThreshold);
+
+        reorderVertices(mesh,indices);
+    }
+
+    /*
+     * Simulate a FIFO vertex cache of the given size on the triangles of a
+     * mesh
+     */
+    static VertexCacheStats analyzeVertexCache(const PolygonMesh<K>& mesh,
+                                               unsigned int cacheSize=CACHE_SIZE)
+    {
+        ArrayView<unsigned int> indices = mesh.getPrimitivesView();
+        VertexCacheStats stats;
+
+        if ((mesh.getPrimitiveSize()!=3) || (indices.size()<3))
+            return stats;
+        return analyzeVertexCache(indices.data(),indices.size(),mesh.getVertexCount(),cacheSize);
+    }
+
+    static VertexCacheStats analyzeVertexCache(const unsigned int *indices,size_t indexCount,
+                                               size_t vertexCount,
+                                               unsigned int cacheSize=CACHE_SIZE)
+    {
+        VertexCacheStats stats;
+        FifoCache cache(vertexCount,cacheSize);
+        vector<bool> used(vertexCount,false);
+
+        stats.triangles = indexCount/3;
+        for (size_t i=0;i<stats.triangles*3;i++)
+        {
+            unsigned int v = indices[i];
+
+            if (v>=vertexCount)
+                continue;
+            if (!used[v])
+            {
+                used[v] = true;
+                stats.vertices++;
+            }
+            stats.misses += cache.access(v);
+        }
+        return stats;
+    }
+
+private:
+    typedef typename PolygonMesh<K>::Layout Layout;
+
+    static int position()
+    {
+        return Layout::find("position");
+    }
+
+    static const float *positionData(const PolygonMesh<K>& mesh)
+    {
+        int p = position();
+
+        if ((p<0) || (Layout::components(p)<3))
+            return NULL;
+        return mesh.getVertexArrays().data(p);
+    }
+
+    /*
+     * A FIFO vertex cache, as used for the statistics and to find cluster
+     * boundaries. A vertex is in the cache if it was missed fewer than size
+     * misses ago.
+     */
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount,unsigned int size)
+            :time(vertexCount,0),size(size),now(size+1)
+        {
+        }
+
+        //returns 1 on a miss, 0 on a hit
+        unsigned int access(unsigned int v)
+        {
+            if (now-time[v]<=size)
+                return 0;
+            time[v] = now++;
+            return 1;
+        }
+
+        void flush()
+        {
+            now += size+1;
+        }
+
+    private:
+        vector<size_t> time;
+        size_t size;
+        size_t now;
+    };
+
+    /*
+     * Reorder the given triangles by Tipsify.
+     * \param clusters receives the index of the first triangle of every run
+     *        that Tipsify started from a vertex that was no longer in the
+     *        cache
+     */
+    static void tipsify(vector<unsigned int>& indices,size_t vertexCount,
+                        unsigned int cacheSize,vector<unsigned int>& clusters)
+    {
+        size_t triangleCount = indices.size()/3;
+        size_t v;
+
+        //the triangles around every vertex, as offsets into one array
+        vector<unsigned int> firstTriangle(vertexCount+1,0);
+        vector<unsigned int> triangles(indices.size());
+        for (size_t i=0;i<indices.size();i++)
+            firstTriangle[indices[i]+1]++;
+        for (v=0;v<vertexCount;v++)
+            firstTriangle[v+1] += firstTriangle[v];
+        vector<unsigned int> fill(firstTriangle.begin(),firstTriangle.end()-1);
+        for (size_t i=0;i<indices.size();i++)
+            triangles[fill[indices[i]]++] = (unsigned int)(i/3);
+
+        //live triangles of every vertex, time each vertex entered the cache
+        vector<unsigned int> live(vertexCount);
+        for (v=0;v<vertexCount;v++)
+            live[v] = firstTriangle[v+1]-firstTriangle[v];
+        vector<size_t> cacheTime(vertexCount,0);
+        vector<bool> emitted(triangleCount,false);
+        vector<unsigned int> deadEnd;
+        vector<unsigned int> candidates;
+        vector<unsigned int> result;
+        size_t now = cacheSize+1;
+        size_t cursor = 0;
+
+        result.reserve(indices.size());
+        clusters.clear();
+
+        long fan = (vertexCount>0)?nextUnfinished(live,cursor):-1;
+        bool restarted = true;
+        while (fan>=0)
+        {
+            if (restarted)
+                clusters.push_back((unsigned int)(result.size()/3));
+
+            candidates.clear();
+            for (unsigned int k=firstTriangle[fan];k<firstTriangle[fan+1];k++)
+            {
+                unsigned int t = triangles[k];
+
+                if (emitted[t])
+                    continue;
+                emitted[t] = true;
+                for (int c=0;c<3;c++)
+                {
+                    unsigned int u = indices[3*t+c];
+
+                    result.push_back(u);
+                    deadEnd.push_back(u);
+                    candidates.push_back(u);
+                    live[u]--;
+                    if (now-cacheTime[u]>cacheSize)
+                        cacheTime[u] = now++;
+                }
+            }
+
+            //prefer the candidate that entered the cache earliest, as long as
+            //its remaining triangles would not push it out before its turn
+            fan = -1;
+            long best = -1;
+            for (size_t i=0;i<candidates.size();i++)
+            {
+                unsigned int u = candidates[i];
+
+                if (live[u]==0)
+                    continue;
+
+                long priority = 0;
+                if (now-cacheTime[u]+2*live[u]<=cacheSize)
+                    priority = (long)(now-cacheTime[u]);
+                if (priority>best)
+                {
+                    best = priority;
+                    fan = u;
+                }
+            }
+
+            restarted = false;
+            if (fan<0)
+            {
+                fan = skipDeadEnd(live,deadEnd,cursor);
+                restarted = (fan>=0) && (now-cacheTime[fan]>cacheSize);
+            }
+        }
+        indices.swap(result);
+    }
+
+    static long nextUnfinished(const vector<unsigned int>& live,size_t& cursor)
+    {
+        for (;cursor<live.size();cursor++)
+        {
+            if (live[cursor]>0)
+                return (long)cursor;
+        }
+        return -1;
+    }
+
+    //a recently used vertex with triangles left, or else the next one in order
+    static long skipDeadEnd(const vector<unsigned int>& live,
+                            vector<unsigned int>& deadEnd,
+                            size_t& cursor)
+    {
+        while (!deadEnd.empty())
+        {
+            unsigned int d = deadEnd.back();
+
+            deadEnd.pop_back();
+            if (live[d]>0)
+                return d;
+        }
+        return nextUnfinished(live,cursor);
+    }
+
+    /*
+     * Split every run of the Tipsify order into clusters that each keep the
+     * cache about as busy as the whole run, then draw the clusters that face
+     * outwards first.
+     */
+    static void optimizeOverdraw(vector<unsigned int>& indices,
+                                 const vector<unsigned int>& hardBoundaries,
+                                 size_t vertexCount,
+                                 const float *positions,int stride,
+                                 unsigned int cacheSize,float threshold)
+    {
+        size_t triangleCount = indices.size()/3;
+        size_t t;
+
+        vector<unsigned int> boundaries;
+        FifoCache cache(vertexCount,cacheSize);
+        for (size_t h=0;h<hardBoundaries.size();h++)
+        {
+            size_t first = hardBoundaries[h];
+            size_t last = (h+1<hardBoundaries.size())?hardBoundaries[h+1]:triangleCount;
+            size_t misses = 0;
+
+            cache.flush();
+            for (t=first;t<last;t++)
+                misses += trianglesMisses(cache,&indices[3*t]);
+
+            //end a cluster as soon as it does as well as the run does
+            double target = threshold*(double)misses/(last-first);
+            size_t start = first,running = 0;
+            cache.flush();
+            boundaries.push_back((unsigned int)first);
+            for (t=first;t<last;t++)
+            {
+                running += trianglesMisses(cache,&indices[3*t]);
+                if ((t+1<last) && (running<=target*(t+1-start)))
+                {
+                    boundaries.push_back((unsigned int)(t+1));
+                    start = t+1;
+                    running = 0;
+                    cache.flush();
+                }
+            }
+        }
+
+        //the area-weighted center of the whole mesh, and of every cluster
+        //with its average normal
+        vector<Cluster> clusters(boundaries.size());
+        glm::dvec3 meshCenter(0.0);
+        double meshArea = 0.0;
+        for (size_t c=0;c<clusters.size();c++)
+        {
+            Cluster& cluster = clusters[c];
+            glm::dvec3 center(0.0),normal(0.0);
+            double area = 0.0;
+
+            cluster.first = boundaries[c];
+            cluster.last = (c+1<boundaries.size())?boundaries[c+1]:(unsigned int)triangleCount;
+            for (t=cluster.first;t<cluster.last;t++)
+            {
+                glm::dvec3 a = load3(positions+(size_t)stride*indices[3*t]);
+                glm::dvec3 b = load3(positions+(size_t)stride*indices[3*t+1]);
+                glm::dvec3 d = load3(positions+(size_t)stride*indices[3*t+2]);
+                glm::dvec3 n = glm::cross(b-a,d-a);
+                double w = glm::length(n);
+
+                center += (a+b+d)*(w/3.0);
+                normal += n;
+                area += w;
+            }
+            meshCenter += center;
+            meshArea += area;
+            cluster.center = (area>0.0)?center/area:glm::dvec3(0.0);
+            cluster.normal = normal;
+        }
+        if (meshArea>0.0)
+            meshCenter /= meshArea;
+
+        for (size_t c=0;c<clusters.size();c++)
+        {
+            Cluster& cluster = clusters[c];
+            double length = glm::length(cluster.normal);
+
+            cluster.sortKey = (length>0.0)?glm::dot(cluster.center-meshCenter,cluster.normal)/length:0.0;
+        }
+        std::stable_sort(clusters.begin(),clusters.end());
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t c=0;c<clusters.size();c++)
+            result.insert(result.end(),
+                          indices.begin()+3*clusters[c].first,
+                          indices.begin()+3*clusters[c].last);
+        indices.swap(result);
+    }
+
+    struct Cluster
+    {
+        unsigned int first,last; //range of triangles
+        glm::dvec3 center,normal;
+        double sortKey;
+
+        //the most outward-facing cluster first
+        bool operator<(const Cluster& other) const
+        {
+            return sortKey>other.sortKey;
+        }
+    };
+
+    static unsigned int trianglesMisses(FifoCache& cache,const unsigned int *triangle)
+    {
+        return cache.access(triangle[0])+cache.access(triangle[1])+cache.access(triangle[2]);
+    }
+
+    static glm::dvec3 load3(const float *f)
+    {
+        return glm::dvec3(f[0],f[1],f[2]);
+    }
+
+    /*
+     * Renumber the vertices of the mesh in order of first use by the given
+     * indices, and make them the primitives of the mesh
+     */
+    static void reorderVertices(PolygonMesh<K>& mesh,vector<unsigned int>& indices)
+    {
+        const VertexArrays<Layout>& old = mesh.getVertexArrays();
+        size_t vertexCount = old.size();
+        vector<unsigned int> newIndex(vertexCount,NONE);
+        vector<unsigned int> oldIndex;
+        size_t i;
+
+        oldIndex.reserve(vertexCount);
+        for (i=0;i<indices.size();i++)
+        {
+            unsigned int& n = newIndex[indices[i]];
+
+            if (n==NONE)
+            {
+                n = (unsigned int)oldIndex.size();
+                oldIndex.push_back(indices[i]);
+            }
+            indices[i] = n;
+        }
+        for (i=0;i<vertexCount;i++)
+        {
+            if (newIndex[i]==NONE)
+            {
+                newIndex[i] = (unsigned int)oldIndex.size();
+                oldIndex.push_back((unsigned int)i);
+            }
+        }
+
+        VertexArrays<Layout> reordered(vertexCount);
+        for (int a=0;a<Layout::attributeCount;a++)
+        {
+            size_t c = Layout::components(a);
+            const float *src = old.data(a);
+            float *dest = reordered.data(a);
+
+            for (i=0;i<vertexCount;i++,dest+=c)
+                memcpy(dest,src+c*oldIndex[i],c*sizeof(float));
+        }
+        mesh.swapVertexArrays(reordered);
+        mesh.swapPrimitives(indices);
+    }
+
+    static const unsigned int NONE = 0xFFFFFFFFu;
+};
+
+template <class K>
+const unsigned int MeshOptimizer<K>::CACHE_SIZE;
+
+template <class K>
+const unsigned int MeshOptimizer<K>::NONE;
+}
+
+#endif
@@ -0,0 +1,513 @@
+#ifndef _MESHSIMPLIFIER_H_
+#define _MESHSIMPLIFIER_H_
+
+#include "PolygonMesh.h"
+#include <glm/glm.hpp>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <iterator>
+#include <cmath>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Simplifies triangle meshes by edge collapse, ordered by the quadric error
+ * metric of Garland and Heckbert: every vertex keeps the sum of the squared
+ * distances to the planes of the triangles around it in the original mesh,
+ * and the edge whose collapse adds the least such error goes first.
+ *
+ * Edges that belong to only one triangle (the border of an open mesh, or a
+ * seam where vertices were split for different normals or texture
+ * coordinates) get extra planes perpendicular to their triangle, so that
+ * borders and seams keep their shape. A collapse is rejected if it would
+ * flip a triangle or make the mesh non-manifold.
+ *
+ * The vertex that survives a collapse keeps all its attributes other than
+ * the position.
+ */
+template <class K>
+class MeshSimplifier
+{
+public:
+    //a level of detail chain stops before a level would have fewer triangles
+    static const size_t MIN_TRIANGLES = 64;
+
+    /*
+     * Returns a copy of the given mesh with at most targetTriangles
+     * triangles, or as close to it as possible without flipping triangles.
+     * Meshes that are not made of GL_TRIANGLES-style triangles (3 indices a
+     * primitive) or that have no positions are returned unchanged.
+     */
+    static PolygonMesh<K> simplify(const PolygonMesh<K>& mesh,size_t targetTriangles)
+    {
+        Simplifier s(mesh);
+
+        if (!s.valid())
+            return mesh;
+        s.run(targetTriangles);
+        return s.result(mesh);
+    }
+
+    /*
+     * Make successively coarser versions of the given mesh, each with about
+     * ratio times the triangles of the one before it. The given mesh itself is
+     * not part of the chain.
+     * \param levels the most levels to make
+     * \param ratio between 0 and 1
+     */
+    static vector< PolygonMesh<K> > lodChain(const PolygonMesh<K>& mesh,
+                                              unsigned int levels,
+                                              float ratio=0.5f)
+    {
+        vector< PolygonMesh<K> > chain;
+        const PolygonMesh<K> *previous = &mesh;
+
+        for (unsigned int i=0;i<levels;i++)
+        {
+            size_t triangles = previous->getPrimitiveCount()/3;
+            size_t target = (size_t)(triangles*ratio);
+
+            if ((previous->getPrimitiveSize()!=3) || (target<MIN_TRIANGLES))
+                break;
+
+            PolygonMesh<K> level = simplify(*previous,target);
+            //stop if the mesh cannot be made much simpler
+            if ((size_t)level.getPrimitiveCount()/3>triangles-(triangles-target)/4)
+                break;
+            chain.push_back(std::move(level));
+            previous = &chain.back();
+        }
+        return chain;
+    }
+
+private:
+    typedef typename PolygonMesh<K>::Layout Layout;
+
+    static const unsigned int NONE = 0xFFFFFFFFu;
+
+    //a symmetric 4x4 matrix, stored as its upper triangle
+    struct Quadric
+    {
+        double a[10];
+
+        Quadric()
+        {
+            for (int i=0;i<10;i++)
+                a[i] = 0.0;
+        }
+
+        //the squared distance to the plane n.p+d=0, times weight
+        Quadric(const glm::dvec3& n,double d,double weight)
+        {
+            a[0] = weight*n.x*n.x; a[1] = weight*n.x*n.y; a[2] = weight*n.x*n.z; a[3] = weight*n.x*d;
+            a[4] = weight*n.y*n.y; a[5] = weight*n.y*n.z; a[6] = weight*n.y*d;
+            a[7] = weight*n.z*n.z; a[8] = weight*n.z*d;
+            a[9] = weight*d*d;
+        }
+
+        Quadric& operator+=(const Quadric& q)
+        {
+            for (int i=0;i<10;i++)
+                a[i] += q.a[i];
+            return *this;
+        }
+
+        double error(const glm::dvec3& p) const
+        {
+            return a[0]*p.x*p.x + 2*a[1]*p.x*p.y + 2*a[2]*p.x*p.z + 2*a[3]*p.x
+                    + a[4]*p.y*p.y + 2*a[5]*p.y*p.z + 2*a[6]*p.y
+                    + a[7]*p.z*p.z + 2*a[8]*p.z
+                    + a[9];
+        }
+
+        //the point of least error, if there is a single one
+        bool minimum(glm::dvec3& p) const
+        {
+            glm::dmat3 m(a[0],a[1],a[2],
+                         a[1],a[4],a[5],
+                         a[2],a[5],a[7]);
+            double det = glm::determinant(m);
+
+            if (fabs(det)<1e-12)
+                return false;
+            p = glm::inverse(m) * glm::dvec3(-a[3],-a[6],-a[8]);
+            return true;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        unsigned int u,v; //v goes into u
+        unsigned int stampU,stampV;
+        glm::dvec3 target;
+
+        bool operator>(const Collapse& other) const
+        {
+            return cost>other.cost;
+        }
+    };
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const PolygonMesh<K>& mesh)
+        {
+            position = Layout::find("position");
+            if ((position<0) || (Layout::components(position)<3)
+                    || (mesh.getPrimitiveSize()!=3))
+            {
+                position = -1;
+                return;
+            }
+
+            const VertexArrays<Layout>& arrays = mesh.getVertexArrays();
+            ArrayView<unsigned int> primitives = mesh.getPrimitivesView();
+            size_t i;
+
+            positions.resize(arrays.size());
+            for (i=0;i<arrays.size();i++)
+                positions[i] = glm::dvec3(glm::vec3(arrays.get(position,i)));
+
+            triangles.assign(primitives.begin(),primitives.end());
+            triangles.resize(triangles.size()-triangles.size()%3);
+            for (i=0;i<triangles.size();i++)
+            {
+                if (triangles[i]>=arrays.size())
+                {
+                    position = -1;
+                    return;
+                }
+            }
+
+            removed.assign(triangles.size()/3,false);
+            liveTriangles = triangles.size()/3;
+            stamps.assign(positions.size(),0);
+            quadrics.assign(positions.size(),Quadric());
+            trianglesOf.resize(positions.size());
+            for (i=0;i<triangles.size();i++)
+                trianglesOf[triangles[i]].push_back((unsigned int)(i/3));
+
+            makeQuadrics();
+        }
+
+        bool valid() const
+        {
+            return position>=0;
+        }
+
+        void run(size_t targetTriangles)
+        {
+            priority_queue<Collapse,vector<Collapse>,greater<Collapse> > queue;
+
+            vector< pair<unsigned int,unsigned int> > edges;
+            size_t i;
+
+            edges.reserve(triangles.size());
+            for (i=0;i<triangles.size();i+=3)
+            {
+                for (int k=0;k<3;k++)
+                {
+                    unsigned int a = triangles[i+k],b = triangles[i+(k+1)%3];
+                    edges.push_back(make_pair(std::min(a,b),std::max(a,b)));
+                }
+            }
+            sort(edges.begin(),edges.end());
+            edges.erase(unique(edges.begin(),edges.end()),edges.end());
+            for (i=0;i<edges.size();i++)
+                queue.push(collapseOf(edges[i].first,edges[i].second));
+
+            while ((liveTriangles>targetTriangles) && !queue.empty())
+            {
+                Collapse c = queue.top();
+                queue.pop();
+
+                if ((stamps[c.u]!=c.stampU) || (stamps[c.v]!=c.stampV))
+                    continue;
+                if (!canCollapse(c))
+                    continue;
+                collapse(c);
+
+                vector<unsigned int> around;
+                neighbors(c.u,around);
+                for (i=0;i<around.size();i++)
+                    queue.push(collapseOf(c.u,around[i]));
+            }
+        }
+
+        PolygonMesh<K> result(const PolygonMesh<K>& mesh) const
+        {
+            const VertexArrays<Layout>& arrays = mesh.getVertexArrays();
+            vector<unsigned int> newIndex(positions.size(),NONE);
+            vector<unsigned int> primitives;
+            vector<unsigned int> kept;
+            size_t t;
+            int k;
+
+            primitives.reserve(liveTriangles*3);
+            for (t=0;t<removed.size();t++)
+            {
+                if (removed[t])
+                    continue;
+                for (k=0;k<3;k++)
+                {
+                    unsigned int v = triangles[3*t+k];
+                    if (newIndex[v]==NONE)
+                    {
+                        newIndex[v] = (unsigned int)kept.size();
+                        kept.push_back(v);
+                    }
+                    primitives.push_back(newIndex[v]);
+                }
+            }
+
+            VertexArrays<Layout> simplified(kept.size());
+            for (int a=0;a<Layout::attributeCount;a++)
+            {
+                size_t c = Layout::components(a);
+                const float *src = arrays.data(a);
+                float *dest = simplified.data(a);
+
+                for (size_t i=0;i<kept.size();i++)
+                    std::copy(src+kept[i]*c,src+kept[i]*c+c,dest+i*c);
+            }
+            for (size_t i=0;i<kept.size();i++)
+            {
+                glm::vec4 p = simplified.get(position,i);
+                const glm::dvec3& q = positions[kept[i]];
+                simplified.set(position,i,glm::vec4((float)q.x,(float)q.y,(float)q.z,p.w));
+            }
+
+            PolygonMesh<K> out;
+            out.setPrimitiveType(mesh.getPrimitiveType());
+            out.setPrimitiveSize(3);
+            out.swapVertexArrays(simplified);
+            out.swapPrimitives(primitives);
+            return out;
+        }
+
+    private:
+        //how much more a border or seam resists being moved than a surface
+        static constexpr double BORDER_WEIGHT = 1000.0;
+
+        int position;
+        vector<glm::dvec3> positions;
+        vector<unsigned int> triangles;
+        vector<bool> removed;
+        size_t liveTriangles;
+        vector<unsigned int> stamps;
+        vector<Quadric> quadrics;
+        vector< vector<unsigned int> > trianglesOf;
+
+        glm::dvec3 normalOf(unsigned int t,unsigned int moved,const glm::dvec3& to) const
+        {
+            glm::dvec3 p[3];
+
+            for (int k=0;k<3;k++)
+            {
+                unsigned int v = triangles[3*t+k];
+                p[k] = (v==moved)?to:positions[v];
+            }
+            return glm::cross(p[1]-p[0],p[2]-p[0]);
+        }
+
+        void makeQuadrics()
+        {
+            for (size_t t=0;t<removed.size();t++)
+            {
+                glm::dvec3 n = normalOf((unsigned int)t,NONE,glm::dvec3());
+                double area = glm::length(n);
+                int k;
+
+                if (area<=0.0)
+                    continue;
+                n = n/area;
+
+                Quadric q(n,-glm::dot(n,positions[triangles[3*t]]),area*0.5);
+                for (k=0;k<3;k++)
+                    quadrics[triangles[3*t+k]] += q;
+
+                //an edge that no other triangle has in the opposite direction
+                //is a border or seam
+                for (k=0;k<3;k++)
+                {
+                    unsigned int a = triangles[3*t+k],b = triangles[3*t+(k+1)%3];
+
+                    if (sharedTriangles(a,b)>1)
+                        continue;
+
+                    glm::dvec3 edge = positions[b]-positions[a];
+                    glm::dvec3 side = glm::cross(edge,n);
+                    double length = glm::length(side);
+                    if (length<=0.0)
+                        continue;
+                    side = side/length;
+
+                    Quadric border(side,-glm::dot(side,positions[a]),
+                                   BORDER_WEIGHT*glm::dot(edge,edge));
+                    quadrics[a] += border;
+                    quadrics[b] += border;
+                }
+            }
+        }
+
+        int sharedTriangles(unsigned int a,unsigned int b) const
+        {
+            int count = 0;
+
+            for (size_t i=0;i<trianglesOf[a].size();i++)
+            {
+                unsigned int t = trianglesOf[a][i];
+                if (removed[t])
+                    continue;
+                for (int k=0;k<3;k++)
+                {
+                    if (triangles[3*t+k]==b)
+                        count++;
+                }
+            }
+            return count;
+        }
+
+        void neighbors(unsigned int v,vector<unsigned int>& around) const
+        {
+            around.clear();
+            for (size_t i=0;i<trianglesOf[v].size();i++)
+            {
+                unsigned int t = trianglesOf[v][i];
+                if (removed[t])
+                    continue;
+                for (int k=0;k<3;k++)
+                {
+                    if (triangles[3*t+k]!=v)
+                        around.push_back(triangles[3*t+k]);
+                }
+            }
+            sort(around.begin(),around.end());
+            around.erase(unique(around.begin(),around.end()),around.end());
+        }
+
+        Collapse collapseOf(unsigned int a,unsigned int b) const
+        {
+            Quadric q = quadrics[a];
+            Collapse c;
+
+            q += quadrics[b];
+            c.u = a;
+            c.v = b;
+            c.stampU = stamps[a];
+            c.stampV = stamps[b];
+
+            glm::dvec3 mid = (positions[a]+positions[b])*0.5;
+            double length = glm::length(positions[b]-positions[a]);
+
+            //a nearly singular quadric can put its minimum far from the edge
+            if (!q.minimum(c.target) || (glm::length(c.target-mid)>length))
+            {
+                c.target = mid;
+                if (q.error(positions[a])<q.error(c.target))
+                    c.target = positions[a];
+                if (q.error(positions[b])<q.error(c.target))
+                    c.target = positions[b];
+            }
+            c.cost = q.error(c.target);
+            return c;
+        }
+
+        /*
+         * A collapse is allowed if the vertices the two ends share are exactly
+         * the third corners of the triangles on the edge, and no remaining
+         * triangle turns over
+         */
+        bool canCollapse(const Collapse& c) const
+        {
+            vector<unsigned int> aroundU,aroundV,common;
+
+            neighbors(c.u,aroundU);
+            neighbors(c.v,aroundV);
+            set_intersection(aroundU.begin(),aroundU.end(),
+                             aroundV.begin(),aroundV.end(),
+                             back_inserter(common));
+            if ((int)common.size()!=sharedTriangles(c.u,c.v))
+                return false;
+
+            unsigned int ends[2] = {c.u,c.v};
+            for (int e=0;e<2;e++)
+            {
+                const vector<unsigned int>& around = trianglesOf[ends[e]];
+
+                for (size_t i=0;i<around.size();i++)
+                {
+                    unsigned int t = around[i];
+                    if (removed[t] || (hasCorner(t,c.u) && hasCorner(t,c.v)))
+                        continue;
+
+                    //a triangle of no area has no side to flip to
+                    glm::dvec3 before = normalOf(t,NONE,glm::dvec3());
+                    glm::dvec3 after = normalOf(t,ends[e],c.target);
+                    if ((glm::dot(before,before)>0.0) && (glm::dot(before,after)<=0.0))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        bool hasCorner(unsigned int t,unsigned int v) const
+        {
+            return (triangles[3*t]==v) || (triangles[3*t+1]==v) || (triangles[3*t+2]==v);
+        }
+
+        void collapse(const Collapse& c)
+        {
+            positions[c.u] = c.target;
+            quadrics[c.u] += quadrics[c.v];
+
+            for (size_t i=0;i<trianglesOf[c.v].size();i++)
+            {
+                unsigned int t = trianglesOf[c.v][i];
+                if (removed[t])
+                    continue;
+                if (hasCorner(t,c.u))
+                {
+                    removed[t] = true;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int k=0;k<3;k++)
+                {
+                    if (triangles[3*t+k]==c.v)
+                        triangles[3*t+k] = c.u;
+                }
+                trianglesOf[c.u].push_back(t);
+            }
+            vector<unsigned int>().swap(trianglesOf[c.v]);
+
+            //drop the removed triangles from the list of the survivor
+            vector<unsigned int>& around = trianglesOf[c.u];
+            size_t kept = 0;
+            for (size_t i=0;i<around.size();i++)
+            {
+                if (!removed[around[i]])
+                    around[kept++] = around[i];
+            }
+            around.resize(kept);
+
+            stamps[c.u]++;
+            stamps[c.v] = NONE;
+        }
+    };
+};
+
+template <class K>
+const size_t MeshSimplifier<K>::MIN_TRIANGLES;
+
+template <class K>
+const unsigned int MeshSimplifier<K>::NONE;
+}
+
+#endif
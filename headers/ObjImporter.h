@@ -2,8 +2,19 @@
 #define _OBJIMPORTER_H_
 
 #include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "MeshOptimizer.h"
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <cmath>
+#include <stdint.h>
 using namespace std;
 
 namespace util
@@ -11,6 +22,70 @@ namespace util
 
 
 
+/*
+ * Options that control how ObjImporter turns an OBJ file into a PolygonMesh
+ */
+struct ObjImportOptions
+{
+    //center the mesh at the origin and scale it to fit within a cube of side 1
+    bool scaleAndCenter;
+    //make one vertex for every distinct (position,texture coordinate,normal)
+    //combination used by the faces, instead of one vertex per position
+    bool indexed;
+    //if positive, an indexed import first merges positions that are closer
+    //than this to each other
+    float weldEpsilon;
+    //the number of threads to parse with. 0 means one per core
+    unsigned int numThreads;
+    //reorder the triangles and vertices for the GPU vertex caches and for
+    //less overdraw (see MeshOptimizer)
+    bool optimize;
+
+    ObjImportOptions()
+    {
+        scaleAndCenter = false;
+        indexed = false;
+        weldEpsilon = 0.0f;
+        numThreads = 1;
+        optimize = false;
+    }
+};
+
+/*
+ * Counts gathered during an import, to report how much smaller the indexed
+ * build made a mesh
+ */
+struct ObjImportStats
+{
+    size_t positions; //position records in the file
+    size_t weldedPositions; //positions merged into a nearby one
+    size_t corners; //triangle corners, i.e. entries in the index buffer
+    size_t vertices; //vertices in the resulting mesh
+
+    ObjImportStats()
+    {
+        positions = weldedPositions = corners = vertices = 0;
+    }
+
+    /*
+     * Vertices in the resulting mesh per position record. The non-indexed
+     * import always makes exactly one vertex per position record
+     */
+    float vertexRatio() const
+    {
+        return (positions>0)?(float)vertices/positions:1.0f;
+    }
+
+    /*
+     * Vertices in the resulting mesh per triangle corner, i.e. compared to a
+     * mesh that does not share vertices at all
+     */
+    float cornerRatio() const
+    {
+        return (corners>0)?(float)vertices/corners:1.0f;
+    }
+};
+
 /*
  * A helper class to import a PolygonMesh object from an OBJ file.
  * It imports only position, normal and texture coordinate data (if present)
@@ -25,7 +100,6 @@ public:
         vector<unsigned int> triangles, triangle_texture_indices, triangle_normal_indices;
         int i,j;
         int lineno;
-        PolygonMesh<K> mesh;
 
 
         lineno = 0;
@@ -245,91 +319,1243 @@ public:
             }
         }
 
-        if (scaleAndCenter)
+        return buildMesh(vertices,normals,texcoords,triangles,scaleAndCenter);
+    }
+
+    /*
+     * Import a PolygonMesh from the OBJ file with the given name. The file is
+     * memory-mapped and parsed in place, without building any intermediate
+     * strings. It produces the same mesh as the stream-based version.
+     *
+     * If more than one thread is requested, the file is split at line
+     * boundaries into one chunk per thread, the chunks are parsed
+     * concurrently and the results are stitched together in file order.
+     * The resulting mesh is identical to the single-threaded one, except
+     * that normals computed for a file that has none may differ in the last
+     * bits, as they are added up in a different order.
+     * \param filename the path of the OBJ file
+     * \param scaleAndCenter if true, the mesh is centered at the origin and
+     *        scaled to fit within a cube of side 1
+     * \param numThreads the number of threads to use. 0 means one per core.
+     *        Small files are always parsed by fewer threads.
+     * \throws string with the offending line number if the file is malformed
+     */
+    static PolygonMesh<K> importFile(const string& filename,
+                                     bool scaleAndCenter,
+                                     unsigned int numThreads=1) throw(string)
+    {
+        ObjImportOptions options;
+
+        options.scaleAndCenter = scaleAndCenter;
+        options.numThreads = numThreads;
+        return importFile(filename,options);
+    }
+
+    /*
+     * Import a PolygonMesh from the OBJ file with the given name, as
+     * controlled by the given options.
+     *
+     * An indexed import hashes the (position,texture coordinate,normal) index
+     * triplet of every triangle corner and makes one vertex per distinct
+     * triplet, in order of first use. Positions that no face uses are
+     * dropped. With a positive weld epsilon, positions within epsilon of an
+     * earlier position are replaced by it before hashing.
+     *
+     * If asked to optimize, the triangles are reordered and the vertices
+     * renumbered afterwards by MeshOptimizer. The mesh looks the same, but
+     * its vertices are no longer in order of first use in the file.
+     * \param filename the path of the OBJ file
+     * \param options how to import the file
+     * \param stats if not NULL, receives counts about the import
+     * \throws string with the offending line number if the file is malformed
+     */
+    static PolygonMesh<K> importFile(const string& filename,
+                                     const ObjImportOptions& options,
+                                     ObjImportStats *stats=NULL) throw(string)
+    {
+        ObjRecords records;
+        unsigned int numThreads = options.numThreads;
+
+        try
         {
-            //center about the origin and within a cube of side 1 centered at the origin
-            //find the centroid
-            glm::vec4 center = vertices[0];
+            MappedFile file(filename);
 
-            glm::vec4 minimum = center;
-            glm::vec4 maximum = center;
+            //not worth starting a thread for less than 256KB
+            numThreads = threadCount(file.size(),numThreads,256*1024);
 
-            for (i=1;i<vertices.size();i++)
+            if (numThreads<=1)
             {
-                //center = center.add(vertices.get(i).x,vertices.get(i).y,vertices.get(i).z,0.0f);
-                minimum = glm::min(minimum,vertices[i]);
-                maximum = glm::max(maximum,vertices[i]);
+                parseRecords(file.begin(),file.end(),records);
             }
+            else
+                parseChunks(file.begin(),file.end(),numThreads,records);
+        }
+        catch (runtime_error& e)
+        {
+            throw string(e.what());
+        }
 
-            center = (minimum + maximum)*0.5f;
+        if (records.error!=NULL)
+        {
+            stringstream str;
+            str << "Line " << records.errorLine << ": " << records.error;
+            throw str.str();
+        }
+
+        if (stats!=NULL)
+        {
+            *stats = ObjImportStats();
+            stats->positions = records.vertices.size();
+            stats->corners = records.triangles.size();
+            stats->vertices = records.vertices.size();
+        }
+
+        PolygonMesh<K> mesh;
+        if (options.indexed)
+            mesh = buildIndexedMesh(records,options,numThreads,stats);
+        else
+            mesh = buildMesh(records.vertices,records.normals,records.texcoords,
+                             records.triangles,options.scaleAndCenter,numThreads);
+
+        if (options.optimize)
+            MeshOptimizer<K>::optimize(mesh);
+        return mesh;
+    }
+
+    /*
+     * The index stored for a triangle corner that has no texture coordinate
+     * or normal
+     */
+    static const unsigned int NO_INDEX = 0xFFFFFFFFu;
+
+    /*
+     * Import the OBJ file with the given name into the given mesh, keeping
+     * peak memory close to the size of the resulting mesh. This is meant for
+     * very large (e.g. scanned) models.
+     *
+     * The file is read twice through a fixed-size buffer instead of being
+     * mapped as a whole. The first pass only counts the records, so that the
+     * vertex and index arrays can be allocated at their final size. The
+     * second pass writes every record straight into them, and they are then
+     * swapped into the mesh without copying. No intermediate arrays of
+     * positions, normals, texture coordinates or indices are built.
+     *
+     * The resulting mesh is the same as the one made by the non-indexed
+     * importFile.
+     * \param filename the path of the OBJ file
+     * \param scaleAndCenter if true, the mesh is centered at the origin and
+     *        scaled to fit within a cube of side 1
+     * \param mesh receives the imported mesh. Its old contents are released
+     * \throws string with the offending line number if the file is malformed
+     */
+    static void streamFile(const string& filename,
+                           bool scaleAndCenter,
+                           PolygonMesh<K>& mesh) throw(string)
+    {
+        RecordCounts counts;
 
+        //first pass: count the records and stop at the first malformed one
+        forEachBlock(filename,[&](const char *begin,const char *end)
+        {
+            parseLines(begin,end,counts);
+            return counts.error==NULL;
+        });
+        if (counts.error!=NULL)
+        {
+            stringstream str;
+            str << "Line " << counts.errorLine << ": " << counts.error;
+            throw str.str();
+        }
 
-            float longest;
+        //release the old contents of the mesh before allocating the new ones
+        {
+            VertexArrays<Layout> noVertices;
+            vector<unsigned int> noPrimitives;
+            mesh.swapVertexArrays(noVertices);
+            mesh.swapPrimitives(noPrimitives);
+        }
 
+        VertexArrays<Layout> vertexData(counts.vertices);
+        vector<unsigned int> primitives(counts.corners);
+        StreamedRecords records(vertexData,primitives,
+                                counts.texcoords==counts.vertices,
+                                counts.normals==counts.vertices);
 
-            longest = std::max(maximum.x-minimum.x,std::max(maximum.y-minimum.y,maximum.z-minimum.z));
+        //second pass: write the records into their final place
+        forEachBlock(filename,[&](const char *begin,const char *end)
+        {
+            parseLines(begin,end,records);
+            return records.error==NULL;
+        });
+        if ((records.error==NULL)
+                && ((records.vertices!=counts.vertices)
+                    || (records.corners!=counts.corners)))
+        {
+            records.error = "File changed while it was being read";
+            records.errorLine = records.lines;
+        }
+        if (records.error!=NULL)
+        {
+            stringstream str;
+            str << "Line " << records.errorLine << ": " << records.error;
+            throw str.str();
+        }
 
-            //first translate and then scale
-            glm::mat4 transformMatrix = glm::scale(glm::mat4(1.0),
-                                                    glm::vec3(1.0f/longest,
-                                                              1.0f/longest,
-                                                              1.0f/longest))
-                                                  * glm::translate(glm::mat4(1.0),
-                                                        glm::vec3(-center.x,
-                                                                 -center.y,
-                                                                 -center.z));
+        if (scaleAndCenter && (records.vertices>0))
+        {
+            glm::mat4 transformMatrix = scaleAndCenterTransform(records.minimum,
+                                                                records.maximum);
+            int position = Layout::find("position");
 
-            //scale down each other
-            for (i=0;i<vertices.size();i++)
+            for (size_t i=0;(position>=0) && (i<vertexData.size());i++)
             {
-                vertices[i] = transformMatrix * vertices[i];
+                vertexData.set(position,i,transformMatrix * vertexData.get(position,i));
             }
         }
 
-        vector<K> vertexData;
-        vector<float> data;
-        for (i=0;i<vertices.size();i++) {
-            K v;
-			
-			data.clear();
-			data.push_back(vertices[i].x);
-			data.push_back(vertices[i].y);
-			data.push_back(vertices[i].z);
-			data.push_back(vertices[i].w);
-			
-            v.setData("position",data);
-            if (texcoords.size()==vertices.size())
-            {
-				data.clear();
-				data.push_back(texcoords[i].x);
-				data.push_back(texcoords[i].y);
-				data.push_back(texcoords[i].z);
-				data.push_back(texcoords[i].w);
-				v.setData("texcoord",data);
-			}    
-            if (normals.size()==vertices.size())
-			{
-				data.clear();
-				data.push_back(normals[i].x);
-				data.push_back(normals[i].y);
-				data.push_back(normals[i].z);
-				data.push_back(normals[i].w);
-				v.setData("normal",data);
-			}
-
-            vertexData.push_back(v);
+        mesh.swapVertexArrays(vertexData);
+        mesh.swapPrimitives(primitives);
+        mesh.setPrimitiveType(GL_TRIANGLES);
+        mesh.setPrimitiveSize(3);
+
+        //one thread, as more would need a copy of the normals per thread
+        if (counts.normals!=counts.vertices)
+            mesh.computeNormals(1);
+    }
+
+private:
+    typedef typename PolygonMesh<K>::Layout Layout;
+
+    /*
+     * Center the given positions about the origin and scale them to fit
+     * within a cube of side 1 centered at the origin
+     */
+    static void scaleAndCenterVertices(vector<glm::vec4>& vertices)
+    {
+        int i;
+
+        //center about the origin and within a cube of side 1 centered at the origin
+        //find the centroid
+        glm::vec4 center = vertices[0];
+
+        glm::vec4 minimum = center;
+        glm::vec4 maximum = center;
+
+        for (i=1;i<vertices.size();i++)
+        {
+            //center = center.add(vertices.get(i).x,vertices.get(i).y,vertices.get(i).z,0.0f);
+            minimum = glm::min(minimum,vertices[i]);
+            maximum = glm::max(maximum,vertices[i]);
         }
 
-        if ((normals.size()==0) || (normals.size()!=vertices.size()))
-            mesh.computeNormals();
+        glm::mat4 transformMatrix = scaleAndCenterTransform(minimum,maximum);
+
+        //scale down each other
+        for (i=0;i<vertices.size();i++)
+        {
+            vertices[i] = transformMatrix * vertices[i];
+        }
+    }
+
+    /*
+     * Returns the transformation that centers a box with the given corners
+     * about the origin and scales it to fit within a cube of side 1
+     */
+    static glm::mat4 scaleAndCenterTransform(const glm::vec4& minimum,
+                                             const glm::vec4& maximum)
+    {
+        glm::vec4 center = (minimum + maximum)*0.5f;
+
+
+        float longest;
+
 
-        mesh.setVertexData(vertexData);
+        longest = std::max(maximum.x-minimum.x,std::max(maximum.y-minimum.y,maximum.z-minimum.z));
+
+        //first translate and then scale
+        return glm::scale(glm::mat4(1.0),
+                          glm::vec3(1.0f/longest,
+                                    1.0f/longest,
+                                    1.0f/longest))
+                * glm::translate(glm::mat4(1.0),
+                                 glm::vec3(-center.x,
+                                           -center.y,
+                                           -center.z));
+    }
+
+    /*
+     * Assemble the final PolygonMesh from the raw OBJ records. This is shared
+     * by all the import paths so that they produce identical meshes.
+     */
+    static PolygonMesh<K> buildMesh(vector<glm::vec4>& vertices,
+                                    const vector<glm::vec4>& normals,
+                                    const vector<glm::vec4>& texcoords,
+                                    const vector<unsigned int>& triangles,
+                                    bool scaleAndCenter,
+                                    unsigned int numThreads=1)
+    {
+        PolygonMesh<K> mesh;
+
+        if (scaleAndCenter)
+            scaleAndCenterVertices(vertices);
+
+        VertexArrays<Layout> vertexData(vertices.size());
+        int position = Layout::find("position");
+        int texcoord = (texcoords.size()==vertices.size())?Layout::find("texcoord"):-1;
+        int normal = (normals.size()==vertices.size())?Layout::find("normal"):-1;
+
+        parallelFor(vertices.size(),numThreads,[&](size_t first,size_t last)
+        {
+            for (size_t i=first;i<last;i++) {
+                if (position>=0)
+                    vertexData.set(position,i,vertices[i]);
+                if (texcoord>=0)
+                    vertexData.set(texcoord,i,texcoords[i]);
+                if (normal>=0)
+                    vertexData.set(normal,i,normals[i]);
+            }
+        });
+
+        mesh.swapVertexArrays(vertexData);
         mesh.setPrimitives(triangles);
         mesh.setPrimitiveType(GL_TRIANGLES);
         mesh.setPrimitiveSize(3);
+
+        if ((normals.size()==0) || (normals.size()!=vertices.size()))
+            mesh.computeNormals(numThreads);
         return mesh;
     }
+
+    /*
+     * The raw records read from (a part of) an OBJ file. If parsing stops
+     * because of a malformed record, error points to a description of the
+     * problem and errorLine is its line number.
+     */
+    struct ObjRecords
+    {
+        vector<glm::vec4> vertices,normals,texcoords;
+        //one entry per triangle corner in all three lists. A corner without a
+        //texture coordinate or normal has NO_INDEX in that list
+        vector<unsigned int> triangles, triangle_texture_indices, triangle_normal_indices;
+        //positions of the relative OBJ indices within the three index lists
+        vector<size_t> relativeTriangles, relativeTextureIndices, relativeNormalIndices;
+        //the line of the face of every triangle, for reporting bad indices
+        vector<int> triangleLines;
+        int lines;
+        int errorLine;
+        const char *error;
+
+        ObjRecords()
+        {
+            lines = 0;
+            errorLine = 0;
+            error = NULL;
+        }
+
+        void addVertex(const glm::vec4& v) { vertices.push_back(v);}
+        void addTexcoord(const glm::vec4& t) { texcoords.push_back(t);}
+        void addNormal(const glm::vec4& n) { normals.push_back(n);}
+
+        /*
+         * Add a triangle corner, given its raw OBJ indices
+         */
+        void addCorner(int v,int t,int n)
+        {
+            if (triangles.size()%3==0)
+                triangleLines.push_back(lines);
+            emitIndex(v,vertices.size(),triangles,relativeTriangles);
+            emitIndex(t,texcoords.size(),triangle_texture_indices,relativeTextureIndices);
+            emitIndex(n,normals.size(),triangle_normal_indices,relativeNormalIndices);
+        }
+    };
+
+    /*
+     * The (position,texture coordinate,normal) indices of a triangle corner
+     */
+    struct Triplet
+    {
+        unsigned int position,texcoord,normal;
+
+        bool operator==(const Triplet& t) const
+        {
+            return (position==t.position)
+                    && (texcoord==t.texcoord)
+                    && (normal==t.normal);
+        }
+    };
+
+    struct TripletHash
+    {
+        size_t operator()(const Triplet& t) const
+        {
+            uint64_t h = t.position;
+            h = h*0x9E3779B97F4A7C15ULL + t.texcoord;
+            h = h*0x9E3779B97F4A7C15ULL + t.normal;
+            return (size_t)(h ^ (h>>29));
+        }
+    };
+
+    /*
+     * Replace every position that lies within epsilon of an earlier position
+     * by the index of that earlier position. Positions are binned into a grid
+     * of cells of side epsilon, so only the 27 cells around a position have
+     * to be searched.
+     * \return the number of positions that were merged into another
+     */
+    static size_t weldPositions(const vector<glm::vec4>& vertices,
+                                float epsilon,
+                                vector<unsigned int>& representative)
+    {
+        //head of the list of positions in each (hashed) cell, and the next
+        //position in the same cell
+        unordered_map<uint64_t,unsigned int> heads;
+        vector<unsigned int> next;
+        float epsilonSquared = epsilon*epsilon;
+        size_t welded = 0;
+
+        representative.resize(vertices.size());
+        next.resize(vertices.size(),NO_INDEX);
+        heads.reserve(vertices.size());
+
+        for (size_t i=0;i<vertices.size();i++)
+        {
+            glm::vec3 p = glm::vec3(vertices[i]);
+            int64_t cell[3];
+            unsigned int found = NO_INDEX;
+
+            for (int k=0;k<3;k++)
+                cell[k] = (int64_t)floor(p[k]/epsilon);
+
+            for (int dx=-1;(dx<=1) && (found==NO_INDEX);dx++)
+            {
+                for (int dy=-1;(dy<=1) && (found==NO_INDEX);dy++)
+                {
+                    for (int dz=-1;(dz<=1) && (found==NO_INDEX);dz++)
+                    {
+                        unordered_map<uint64_t,unsigned int>::const_iterator it =
+                                heads.find(cellKey(cell[0]+dx,cell[1]+dy,cell[2]+dz));
+                        if (it==heads.end())
+                            continue;
+                        //different cells may share a key, so check the distance
+                        //to every position in the list
+                        for (unsigned int j=it->second;j!=NO_INDEX;j=next[j])
+                        {
+                            glm::vec3 d = glm::vec3(vertices[j]) - p;
+                            if (glm::dot(d,d)<=epsilonSquared)
+                            {
+                                found = j;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            if (found!=NO_INDEX)
+            {
+                representative[i] = found;
+                welded++;
+            }
+            else
+            {
+                //only representatives go into the grid, so that welding does
+                //not creep along a chain of close positions
+                representative[i] = (unsigned int)i;
+                uint64_t key = cellKey(cell[0],cell[1],cell[2]);
+                unordered_map<uint64_t,unsigned int>::iterator it = heads.find(key);
+                if (it!=heads.end())
+                {
+                    next[i] = it->second;
+                    it->second = (unsigned int)i;
+                }
+                else
+                    heads[key] = (unsigned int)i;
+            }
+        }
+        return welded;
+    }
+
+    static uint64_t cellKey(int64_t x,int64_t y,int64_t z)
+    {
+        uint64_t h = (uint64_t)x;
+        h = h*0x9E3779B97F4A7C15ULL + (uint64_t)y;
+        h = h*0x9E3779B97F4A7C15ULL + (uint64_t)z;
+        return h;
+    }
+
+    /*
+     * Assemble a PolygonMesh with one vertex for every distinct
+     * (position,texture coordinate,normal) triplet used by the faces. A vertex
+     * gets a texture coordinate or normal only if its corner specified one.
+     */
+    static PolygonMesh<K> buildIndexedMesh(ObjRecords& records,
+                                           const ObjImportOptions& options,
+                                           unsigned int numThreads,
+                                           ObjImportStats *stats) throw(string)
+    {
+        PolygonMesh<K> mesh;
+        vector<unsigned int> representative;
+        size_t welded = 0;
+
+        if (options.scaleAndCenter && (records.vertices.size()>0))
+            scaleAndCenterVertices(records.vertices);
+
+        if (options.weldEpsilon>0.0f)
+            welded = weldPositions(records.vertices,options.weldEpsilon,representative);
+
+        unordered_map<Triplet,unsigned int,TripletHash> vertexIndices;
+        vector<Triplet> unique;
+        vector<unsigned int> primitives(records.triangles.size());
+
+        vertexIndices.reserve(records.triangles.size());
+        for (size_t i=0;i<records.triangles.size();i++)
+        {
+            Triplet t;
+
+            unsigned int position = records.triangles[i];
+            if (position>=records.vertices.size())
+                throw badIndex(records,i,"Face refers to a vertex that does not exist");
+            t.position = representative.empty()?position:representative[position];
+
+            //like buildMesh, a file with exactly one texture coordinate or
+            //normal per position pairs them up with the positions when the
+            //faces do not index them
+            t.texcoord = records.triangle_texture_indices[i];
+            if ((t.texcoord==NO_INDEX) && (records.texcoords.size()==records.vertices.size()))
+                t.texcoord = position;
+            if ((t.texcoord!=NO_INDEX) && (t.texcoord>=records.texcoords.size()))
+                throw badIndex(records,i,"Face refers to a texture coordinate that does not exist");
+
+            t.normal = records.triangle_normal_indices[i];
+            if ((t.normal==NO_INDEX) && (records.normals.size()==records.vertices.size()))
+                t.normal = position;
+            if ((t.normal!=NO_INDEX) && (t.normal>=records.normals.size()))
+                throw badIndex(records,i,"Face refers to a normal that does not exist");
+
+            pair<typename unordered_map<Triplet,unsigned int,TripletHash>::iterator,bool> result =
+                    vertexIndices.insert(make_pair(t,(unsigned int)unique.size()));
+            if (result.second)
+                unique.push_back(t);
+            primitives[i] = result.first->second;
+        }
+
+        VertexArrays<Layout> vertexData(unique.size());
+        int position = Layout::find("position");
+        int texcoord = Layout::find("texcoord");
+        int normal = Layout::find("normal");
+        bool missingNormals = false;
+
+        parallelFor(unique.size(),numThreads,[&](size_t first,size_t last)
+        {
+            for (size_t i=first;i<last;i++) {
+                const Triplet& t = unique[i];
+
+                if (position>=0)
+                    vertexData.set(position,i,records.vertices[t.position]);
+                if ((t.texcoord!=NO_INDEX) && (texcoord>=0))
+                    vertexData.set(texcoord,i,records.texcoords[t.texcoord]);
+                if ((t.normal!=NO_INDEX) && (normal>=0))
+                    vertexData.set(normal,i,records.normals[t.normal]);
+            }
+        });
+        for (size_t i=0;(i<unique.size()) && !missingNormals;i++)
+            missingNormals = (unique[i].normal==NO_INDEX);
+
+        if (stats!=NULL)
+        {
+            stats->weldedPositions = welded;
+            stats->vertices = unique.size();
+        }
+
+        mesh.swapVertexArrays(vertexData);
+        mesh.setPrimitives(primitives);
+        mesh.setPrimitiveType(GL_TRIANGLES);
+        mesh.setPrimitiveSize(3);
+
+        //vertices of faces that give no normals get computed ones. Those
+        //of the other faces keep the normals of the file
+        if (missingNormals)
+        {
+            mesh.computeNormals(numThreads);
+            if ((normal>=0) && !records.normals.empty())
+                restoreNormals(mesh,records,unique,normal,numThreads);
+        }
+        return mesh;
+    }
+
+    /*
+     * Set the normals of the vertices that were given one by the file again,
+     * after computeNormals has replaced all of them
+     */
+    static void restoreNormals(PolygonMesh<K>& mesh,
+                               const ObjRecords& records,
+                               const vector<Triplet>& unique,
+                               int normal,
+                               unsigned int numThreads)
+    {
+        VertexArrays<Layout> vertexData;
+
+        mesh.swapVertexArrays(vertexData);
+        parallelFor(unique.size(),numThreads,[&](size_t first,size_t last)
+        {
+            for (size_t i=first;i<last;i++) {
+                if (unique[i].normal!=NO_INDEX)
+                    vertexData.set(normal,i,records.normals[unique[i].normal]);
+            }
+        });
+        mesh.swapVertexArrays(vertexData);
+    }
+
+    /*
+     * The message for a face corner (an index into the index lists of
+     * records) that refers to an element that does not exist
+     */
+    static string badIndex(const ObjRecords& records,size_t corner,const char *error)
+    {
+        stringstream str;
+        str << "Line " << records.triangleLines[corner/3] << ": " << error;
+        return str.str();
+    }
+
+    /*
+     * Counts the records of an OBJ file, for the first pass of streamFile
+     */
+    struct RecordCounts
+    {
+        size_t vertices,texcoords,normals,corners;
+        int lines;
+        int errorLine;
+        const char *error;
+
+        RecordCounts()
+        {
+            vertices = texcoords = normals = corners = 0;
+            lines = 0;
+            errorLine = 0;
+            error = NULL;
+        }
+
+        void addVertex(const glm::vec4&) { vertices++;}
+        void addTexcoord(const glm::vec4&) { texcoords++;}
+        void addNormal(const glm::vec4&) { normals++;}
+        void addCorner(int,int,int) { corners++;}
+    };
+
+    /*
+     * Writes the records of an OBJ file straight into preallocated vertex and
+     * index arrays, for the second pass of streamFile. As in buildMesh,
+     * texture coordinates and normals are only kept if there is exactly one
+     * per position.
+     */
+    struct StreamedRecords
+    {
+        VertexArrays<Layout>& vertexData;
+        vector<unsigned int>& primitives;
+        int position,texcoord,normal; //attribute indices in the layout, or -1
+        size_t vertices,texcoords,normals,corners;
+        glm::vec4 minimum,maximum; //bounds of the positions, as read
+        int lines;
+        int errorLine;
+        const char *error;
+
+        StreamedRecords(VertexArrays<Layout>& vertexData,
+                        vector<unsigned int>& primitives,
+                        bool withTexcoords,
+                        bool withNormals)
+            :vertexData(vertexData),
+              primitives(primitives)
+        {
+            position = Layout::find("position");
+            texcoord = withTexcoords?Layout::find("texcoord"):-1;
+            normal = withNormals?Layout::find("normal"):-1;
+            vertices = texcoords = normals = corners = 0;
+            lines = 0;
+            errorLine = 0;
+            error = NULL;
+        }
+
+        void addVertex(const glm::vec4& v)
+        {
+            if (vertices>=vertexData.size())
+            {
+                changed();
+                return;
+            }
+            if (vertices==0)
+                minimum = maximum = v;
+            minimum = glm::min(minimum,v);
+            maximum = glm::max(maximum,v);
+            if (position>=0)
+                vertexData.set(position,vertices,v);
+            vertices++;
+        }
+
+        void addTexcoord(const glm::vec4& t)
+        {
+            if ((texcoord>=0) && (texcoords<vertexData.size()))
+                vertexData.set(texcoord,texcoords,t);
+            texcoords++;
+        }
+
+        void addNormal(const glm::vec4& n)
+        {
+            if ((normal>=0) && (normals<vertexData.size()))
+                vertexData.set(normal,normals,n);
+            normals++;
+        }
+
+        void addCorner(int v,int,int)
+        {
+            if (corners>=primitives.size())
+            {
+                changed();
+                return;
+            }
+            primitives[corners++] = (v<0)?(unsigned int)(vertices+v):(unsigned int)(v-1);
+        }
+
+        void changed()
+        {
+            if (error==NULL)
+            {
+                error = "File changed while it was being read";
+                errorLine = lines;
+            }
+        }
+    };
+
+    /*
+     * The size of the buffer through which streamFile reads a file
+     */
+    static const size_t STREAM_BLOCK_SIZE = 1<<20;
+
+    /*
+     * Read the file with the given name through a fixed-size buffer and call
+     * f(begin,end) for each block of whole lines, in order. Reading stops
+     * early if f returns false. A line longer than the buffer makes the
+     * buffer grow.
+     */
+    template <class F>
+    static void forEachBlock(const string& filename,F f) throw(string)
+    {
+        ifstream in(filename.c_str(),ios::in | ios::binary);
+        vector<char> buffer(STREAM_BLOCK_SIZE);
+        size_t carried = 0;
+
+        if (!in.is_open())
+            throw string("Could not open file: "+filename);
+
+        while (true)
+        {
+            in.read(&buffer[carried],buffer.size()-carried);
+            size_t filled = carried + (size_t)in.gcount();
+            const char *begin = &buffer[0];
+
+            if (filled<buffer.size())
+            {
+                //end of file: the rest is the last line
+                if (filled>0)
+                    f(begin,begin+filled);
+                return;
+            }
+
+            const char *lineEnd = begin+filled;
+            while ((lineEnd>begin) && (lineEnd[-1]!='\n'))
+                lineEnd--;
+
+            if (lineEnd==begin)
+            {
+                //no complete line in the buffer
+                carried = filled;
+                buffer.resize(2*buffer.size());
+                continue;
+            }
+
+            if (!f(begin,lineEnd))
+                return;
+            carried = (begin+filled)-lineEnd;
+            memmove(&buffer[0],lineEnd,carried);
+        }
+    }
+
+    /*
+     * Copy the records of one chunk to the given offsets of the combined
+     * index list, shifting relative indices by the number of elements that
+     * precede the chunk
+     */
+    static void stitchIndices(const vector<unsigned int>& chunk,
+                              const vector<size_t>& relative,
+                              size_t indexOffset,
+                              size_t elementOffset,
+                              vector<unsigned int>& combined)
+    {
+        if (chunk.size()>0)
+            memcpy(&combined[indexOffset],&chunk[0],chunk.size()*sizeof(unsigned int));
+        for (size_t i=0;i<relative.size();i++)
+        {
+            combined[indexOffset+relative[i]] += (unsigned int)elementOffset;
+        }
+    }
+
+    static void stitchLines(const vector<int>& chunk,
+                            size_t offset,
+                            int firstLine,
+                            vector<int>& combined)
+    {
+        for (size_t i=0;i<chunk.size();i++)
+            combined[offset+i] = firstLine+chunk[i];
+    }
+
+    static void stitchElements(const vector<glm::vec4>& chunk,
+                               size_t offset,
+                               vector<glm::vec4>& combined)
+    {
+        if (chunk.size()>0)
+            memcpy(&combined[offset],&chunk[0],chunk.size()*sizeof(glm::vec4));
+    }
+
+    /*
+     * Parse [begin,end) with numThreads threads and combine the results into
+     * records, exactly as if the whole range had been parsed at once. The
+     * range is split at line boundaries; the offsets of every chunk into the
+     * combined arrays (and its first line number) are prefix sums over the
+     * preceding chunks.
+     */
+    static void parseChunks(const char *begin,const char *end,
+                            unsigned int numThreads,ObjRecords& records)
+    {
+        vector<const char *> bounds(numThreads+1);
+        vector<ObjRecords> chunks(numThreads);
+        unsigned int t;
+
+        bounds[0] = begin;
+        for (t=1;t<numThreads;t++)
+        {
+            const char *p = begin + (end-begin)*(size_t)t/numThreads;
+            if (p<bounds[t-1])
+                p = bounds[t-1];
+            p = (const char *)memchr(p,'\n',end-p);
+            bounds[t] = (p!=NULL)?p+1:end;
+        }
+        bounds[numThreads] = end;
+
+        parallelFor(numThreads,numThreads,[&](size_t first,size_t last)
+        {
+            for (size_t c=first;c<last;c++)
+                parseRecords(bounds[c],bounds[c+1],chunks[c]);
+        });
+
+        //prefix sums of the sizes of all the chunks
+        vector<size_t> vertexOffset(numThreads+1,0),normalOffset(numThreads+1,0),
+                texcoordOffset(numThreads+1,0),triangleOffset(numThreads+1,0),
+                textureIndexOffset(numThreads+1,0),normalIndexOffset(numThreads+1,0);
+        vector<int> lineOffset(numThreads+1,0);
+        int lines = 0;
+
+        for (t=0;t<numThreads;t++)
+        {
+            const ObjRecords& c = chunks[t];
+
+            if (c.error!=NULL)
+            {
+                //report the first error in the file, as a serial parse would
+                records.error = c.error;
+                records.errorLine = lines + c.errorLine;
+                return;
+            }
+            lines += c.lines;
+            lineOffset[t+1] = lines;
+            vertexOffset[t+1] = vertexOffset[t] + c.vertices.size();
+            normalOffset[t+1] = normalOffset[t] + c.normals.size();
+            texcoordOffset[t+1] = texcoordOffset[t] + c.texcoords.size();
+            triangleOffset[t+1] = triangleOffset[t] + c.triangles.size();
+            textureIndexOffset[t+1] = textureIndexOffset[t] + c.triangle_texture_indices.size();
+            normalIndexOffset[t+1] = normalIndexOffset[t] + c.triangle_normal_indices.size();
+        }
+
+        records.lines = lines;
+        records.vertices.resize(vertexOffset[numThreads]);
+        records.normals.resize(normalOffset[numThreads]);
+        records.texcoords.resize(texcoordOffset[numThreads]);
+        records.triangles.resize(triangleOffset[numThreads]);
+        records.triangle_texture_indices.resize(textureIndexOffset[numThreads]);
+        records.triangle_normal_indices.resize(normalIndexOffset[numThreads]);
+        records.triangleLines.resize(triangleOffset[numThreads]/3);
+
+        parallelFor(numThreads,numThreads,[&](size_t first,size_t last)
+        {
+            for (size_t c=first;c<last;c++)
+            {
+                stitchElements(chunks[c].vertices,vertexOffset[c],records.vertices);
+                stitchElements(chunks[c].normals,normalOffset[c],records.normals);
+                stitchElements(chunks[c].texcoords,texcoordOffset[c],records.texcoords);
+                stitchIndices(chunks[c].triangles,chunks[c].relativeTriangles,
+                              triangleOffset[c],vertexOffset[c],records.triangles);
+                stitchIndices(chunks[c].triangle_texture_indices,chunks[c].relativeTextureIndices,
+                              textureIndexOffset[c],texcoordOffset[c],
+                              records.triangle_texture_indices);
+                stitchIndices(chunks[c].triangle_normal_indices,chunks[c].relativeNormalIndices,
+                              normalIndexOffset[c],normalOffset[c],
+                              records.triangle_normal_indices);
+                stitchLines(chunks[c].triangleLines,triangleOffset[c]/3,lineOffset[c],
+                            records.triangleLines);
+            }
+        });
+    }
+
+
+    static bool isBlank(char c)
+    {
+        return (c==' ') || (c=='\t') || (c=='\r') || (c=='\v') || (c=='\f');
+    }
+
+    /*
+     * Advance p past blanks and return true if another token starts before
+     * the end of the line
+     */
+    static bool nextToken(const char *&p,const char *end)
+    {
+        while ((p<end) && isBlank(*p))
+            p++;
+        return (p<end) && (*p!='\n');
+    }
+
+    static const char *tokenEnd(const char *p,const char *end)
+    {
+        while ((p<end) && !isBlank(*p) && (*p!='\n'))
+            p++;
+        return p;
+    }
+
+    /*
+     * Parse a float from [p,end). Numbers with at most 7 significant digits
+     * and a small exponent (the common case in OBJ files) are converted with a
+     * single correctly-rounded float operation, which gives exactly what
+     * strtof gives. Everything else is handed to strtof. Returns false if
+     * there is no number at p.
+     */
+    static bool scanFloat(const char *p,const char *end,float& value)
+    {
+        static const float powersOf10[] = {1e0f,1e1f,1e2f,1e3f,1e4f,1e5f,
+                                           1e6f,1e7f,1e8f,1e9f,1e10f};
+        const char *start = p;
+        bool negative = false;
+        unsigned long long mantissa = 0;
+        int digits = 0,exponent = 0;
+        bool any = false;
+
+        if ((p<end) && ((*p=='-') || (*p=='+')))
+        {
+            negative = (*p=='-');
+            p++;
+        }
+        while ((p<end) && (*p>='0') && (*p<='9'))
+        {
+            if ((mantissa!=0) || (*p!='0'))
+                digits++;
+            if (digits<=19)
+                mantissa = mantissa*10 + (*p-'0');
+            else
+                exponent++;
+            p++;
+            any = true;
+        }
+        if ((p<end) && (*p=='.'))
+        {
+            p++;
+            while ((p<end) && (*p>='0') && (*p<='9'))
+            {
+                if ((mantissa!=0) || (*p!='0'))
+                    digits++;
+                if (digits<=19)
+                {
+                    mantissa = mantissa*10 + (*p-'0');
+                    exponent--;
+                }
+                p++;
+                any = true;
+            }
+        }
+        if (!any)
+            return false;
+        if ((p<end) && ((*p=='e') || (*p=='E')))
+        {
+            const char *q = p+1;
+            bool negativeExponent = false;
+            int e = 0;
+
+            if ((q<end) && ((*q=='-') || (*q=='+')))
+            {
+                negativeExponent = (*q=='-');
+                q++;
+            }
+            if ((q<end) && (*q>='0') && (*q<='9'))
+            {
+                while ((q<end) && (*q>='0') && (*q<='9'))
+                {
+                    if (e<10000)
+                        e = e*10 + (*q-'0');
+                    q++;
+                }
+                exponent += negativeExponent?-e:e;
+                p = q;
+            }
+        }
+
+        if ((mantissa<=(1ULL<<24)) && (exponent>=-10) && (exponent<=10))
+        {
+            value = (float)mantissa;
+            if (exponent<0)
+                value = value / powersOf10[-exponent];
+            else
+                value = value * powersOf10[exponent];
+            if (negative)
+                value = -value;
+            return true;
+        }
+
+        //rare case: copy the token so that strtof sees a terminated string
+        char buffer[128];
+        size_t length = p-start;
+        if (length>=sizeof(buffer))
+            length = sizeof(buffer)-1;
+        memcpy(buffer,start,length);
+        buffer[length] = '\0';
+        value = strtof(buffer,NULL);
+        return true;
+    }
+
+    /*
+     * Parse a (possibly signed) integer from [p,end), advancing p past it.
+     * Returns false if there is no number at p.
+     */
+    static bool scanInt(const char *&p,const char *end,int& value)
+    {
+        bool negative = false;
+        const char *start;
+
+        if ((p<end) && ((*p=='-') || (*p=='+')))
+        {
+            negative = (*p=='-');
+            p++;
+        }
+        start = p;
+        value = 0;
+        while ((p<end) && (*p>='0') && (*p<='9'))
+        {
+            value = value*10 + (*p-'0');
+            p++;
+        }
+        if (negative)
+            value = -value;
+        return p!=start;
+    }
+
+    /*
+     * Read up to maxValues floats from the rest of the line starting at p.
+     * Returns the number of tokens on the line (which may exceed maxValues),
+     * leaving p at the end of the line.
+     */
+    static int scanFloats(const char *&p,const char *end,float *values,int maxValues)
+    {
+        int count = 0;
+
+        while (nextToken(p,end))
+        {
+            const char *e = tokenEnd(p,end);
+            if (count<maxValues)
+            {
+                if (!scanFloat(p,e,values[count]))
+                    values[count] = 0.0f;
+            }
+            count++;
+            p = e;
+        }
+        return count;
+    }
+
+    /*
+     * Convert an OBJ index (which begins at 1, or counts backwards from the
+     * most recent element if negative) into a 0-based index and append it to
+     * indices. A missing index (0) becomes NO_INDEX. The position of every
+     * relative (negative) index is remembered in relative, because it depends
+     * on how many elements precede this part of the file.
+     */
+    static void emitIndex(int index,size_t count,
+                          vector<unsigned int>& indices,vector<size_t>& relative)
+    {
+        if (index<0)
+        {
+            relative.push_back(indices.size());
+            indices.push_back((unsigned int)(count+index));
+        }
+        else
+            indices.push_back((unsigned int)(index-1));
+    }
+
+    /*
+     * Parse the v/vt/vn/f records in [begin,end) and append them to records.
+     * Line numbers are counted from 1 at begin. This function never throws
+     * and does not allocate except to grow the output vectors.
+     */
+    static void parseRecords(const char *begin,const char *end,ObjRecords& records)
+    {
+        parseLines(begin,end,records);
+    }
+
+    /*
+     * Parse the v/vt/vn/f records in [begin,end) and pass them on to
+     * records, which may be an ObjRecords or any other class with the same
+     * addVertex/addTexcoord/addNormal/addCorner functions and
+     * lines/errorLine/error fields. Faces are passed on as triangle corners.
+     * Line numbers continue from records.lines.
+     */
+    template <class Records>
+    static void parseLines(const char *begin,const char *end,Records& records)
+    {
+        const char *p = begin;
+        //the OBJ indices of the corners of the current face
+        vector<int> t_triangles,t_tex,t_normal;
+
+        while (p<end)
+        {
+            const char *lineEnd = (const char *)memchr(p,'\n',end-p);
+            if (lineEnd==NULL)
+                lineEnd = end;
+
+            records.lines++;
+
+            if ((p==lineEnd) || (*p=='#') || !nextToken(p,lineEnd))
+            {
+                //line is empty or a comment, ignore
+                p = lineEnd+1;
+                continue;
+            }
+
+            const char *keyEnd = tokenEnd(p,lineEnd);
+            size_t keyLength = keyEnd-p;
+
+            if ((keyLength==1) && (p[0]=='v'))
+            {
+                float values[4];
+                int n;
+
+                p = keyEnd;
+                n = scanFloats(p,lineEnd,values,4);
+                if ((n<3) || (n>6))
+                {
+                    records.error = "Vertex coordinate has an invalid number of values";
+                    records.errorLine = records.lines;
+                    return;
+                }
+
+                glm::vec4 v(values[0],values[1],values[2],1.0f);
+                if ((n==4) && (values[3]!=0))
+                {
+                    v.x/=values[3];
+                    v.y/=values[3];
+                    v.z/=values[3];
+                }
+                records.addVertex(v);
+            }
+            else if ((keyLength==2) && (p[0]=='v') && (p[1]=='t'))
+            {
+                float values[3];
+                int n;
+
+                p = keyEnd;
+                n = scanFloats(p,lineEnd,values,3);
+                if ((n<2) || (n>3))
+                {
+                    records.error = "Texture coordinate has an invalid number of values";
+                    records.errorLine = records.lines;
+                    return;
+                }
+
+                records.addTexcoord(glm::vec4(values[0],values[1],
+                                              (n>2)?values[2]:0.0f,1.0f));
+            }
+            else if ((keyLength==2) && (p[0]=='v') && (p[1]=='n'))
+            {
+                float values[3];
+                int n;
+
+                p = keyEnd;
+                n = scanFloats(p,lineEnd,values,3);
+                if (n!=3)
+                {
+                    records.error = "Normal has an invalid number of values";
+                    records.errorLine = records.lines;
+                    return;
+                }
+
+                glm::vec3 v = glm::normalize(glm::vec3(values[0],values[1],values[2]));
+                records.addNormal(glm::vec4(v,0.0f));
+            }
+            else if ((keyLength==1) && (p[0]=='f'))
+            {
+                t_triangles.clear();
+                t_tex.clear();
+                t_normal.clear();
+
+                p = keyEnd;
+                while (nextToken(p,lineEnd))
+                {
+                    const char *e = tokenEnd(p,lineEnd);
+                    int vi;
+
+                    if (!scanInt(p,e,vi))
+                        vi = 0;
+                    t_triangles.push_back(vi);
+
+                    //0 marks a missing texture or normal index
+                    int ti = 0,ni = 0;
+                    if ((p<e) && (*p=='/'))
+                    {
+                        p++;
+                        if (!scanInt(p,e,ti))
+                            ti = 0;
+
+                        if ((p<e) && (*p=='/'))
+                        {
+                            p++;
+                            if (!scanInt(p,e,ni))
+                                ni = 0;
+                        }
+                    }
+                    t_tex.push_back(ti);
+                    t_normal.push_back(ni);
+                    p = e;
+                }
+
+                if (t_triangles.size()<3)
+                {
+                    records.error = "Fewer than 3 vertices for a polygon";
+                    records.errorLine = records.lines;
+                    return;
+                }
+
+                //if face has more than 3 vertices, break down into a triangle fan
+                for (size_t i=2;i<t_triangles.size();i++)
+                {
+                    size_t corners[3] = {0,i-1,i};
+
+                    for (int k=0;k<3;k++)
+                    {
+                        records.addCorner(t_triangles[corners[k]],
+                                          t_tex[corners[k]],
+                                          t_normal[corners[k]]);
+                    }
+                }
+            }
+
+            p = lineEnd+1;
+        }
+    }
 };
+
+template <class K>
+const unsigned int ObjImporter<K>::NO_INDEX;
 }
 
 #endif
@@ -3,11 +3,16 @@
 
 #include "PolygonMesh.h"
 #include <string>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
 using namespace std;
 #include "OpenGLFunctions.h"
 #include "ShaderProgram.h"
 #include "ShaderLocationsVault.h"
+#include "BufferArena.h"
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 namespace util 
 {	
@@ -30,11 +35,38 @@ namespace util
      */
 
   public:
+    /*
+     * The formats in which the vertex data of a mesh can be sent to the GPU.
+     *
+     * FLOAT_VERTICES sends every attribute as the floats stored in the mesh.
+     *
+     * COMPACT_VERTICES sends the attributes named "position", "normal" and
+     * "texcoord" in fewer bytes (16 instead of 48 per vertex for VertexAttrib):
+     * <ul>
+     *     <li>position: 4 snorm16 values, relative to the bounding box of the
+     *         mesh. The shader gets the position back as
+     *         vPosition*positionscale + positionoffset</li>
+     *     <li>normal: 2 snorm16 values, the octahedral encoding of the unit
+     *         normal. The shader decodes it if octahedralnormals is true</li>
+     *     <li>texcoord: s and t as 2 half floats</li>
+     * </ul>
+     * Other attributes are sent as floats.
+     */
+    enum VertexFormat
+    {
+      FLOAT_VERTICES,
+      COMPACT_VERTICES
+    };
+
     ObjectInstance(const string& name)
     {
       //set the name
       setName(name);
-
+      vao = 0;
+      arena = NULL;
+      format = FLOAT_VERTICES;
+      positionScale = glm::vec4(1,1,1,1);
+      positionOffset = glm::vec4(0,0,0,0);
 
     }
     ~ObjectInstance(){}
@@ -44,20 +76,106 @@ namespace util
                          ShaderProgram& program,
                          const ShaderLocationsVault& shaderLocations,
                          const map<string,string>& shaderVarsToAttributeNames,
-                         const PolygonMesh<K>& mesh) ;
+                         const PolygonMesh<K>& mesh,
+                         VertexFormat format=FLOAT_VERTICES,
+                         BufferArenas *arenas=NULL) ;
     template <class K>
     void initPolygonMesh(OpenGLFunctions& gl,
                          const ShaderLocationsVault& shaderLocations,
                          const map<string,string>& shaderVarsToAttributeNames,
-                         const PolygonMesh<K>& mesh) ;
+                         const PolygonMesh<K>& mesh,
+                         VertexFormat format=FLOAT_VERTICES,
+                         BufferArenas *arenas=NULL) ;
     inline void draw(OpenGLFunctions& gl) const;
+    /*
+     * Draw this object, assuming that its VAO (getVertexArray) is already
+     * bound. Objects in the same buffer arena share their VAO, so they can
+     * be drawn one after the other with a single bind.
+     */
+    inline void drawElements(OpenGLFunctions& gl) const;
+    /*
+     * Draw the given number of instances of this object in one call, under
+     * the same assumption as drawElements. The shader tells the instances
+     * apart by gl_InstanceID.
+     */
+    inline void drawElementsInstanced(OpenGLFunctions& gl,int instances) const;
+    inline GLuint getVertexArray() const;
+    /*
+     * Where the vertices and indices of this object start in its buffers.
+     * Both are 0 unless the object is in a buffer arena
+     */
+    inline size_t getBaseVertex() const;
+    inline size_t getFirstIndex() const;
     inline void setName(string name);
     inline string getName() const;
     inline glm::vec4 getMinimumBounds() const;
     inline glm::vec4 getMaximumBounds() const;
+    /*
+     * The number of indices drawn by draw()
+     */
+    inline unsigned int getPrimitiveCount() const;
+    /*
+     * The format in which the vertex data was sent to the GPU, and how the
+     * shader gets back the positions (identity for FLOAT_VERTICES)
+     */
+    inline VertexFormat getVertexFormat() const;
+    inline glm::vec4 getPositionScale() const;
+    inline glm::vec4 getPositionOffset() const;
     inline void cleanup(OpenGLFunctions& gl);
   private:
+    /*
+     * How one attribute is laid out in the vertex buffer, in the terms of
+     * glVertexAttribPointer
+     */
+    struct PackedAttribute
+    {
+      GLenum type;
+      int size;
+      GLboolean normalized;
+      int offset; //in bytes
+    };
+
+    /*
+     * How one attribute of the mesh is turned into a PackedAttribute
+     */
+    enum Conversion
+    {
+      COPY_FLOATS,
+      SNORM_POSITION,
+      OCTAHEDRAL_NORMAL,
+      HALF_TEXCOORD
+    };
+
+    struct VertexStream
+    {
+      int attribute; //index in the layout of the mesh
+      int components; //floats per vertex in the mesh
+      Conversion conversion;
+      PackedAttribute packed;
+    };
+
     inline void initVertexObjects(OpenGLFunctions& gl);
+    template <class K>
+    int layoutVertexData(const PolygonMesh<K>& mesh,
+                         const map<string,string>& shaderVarsToAttributeNames,
+                         vector<VertexStream>& streams,
+                         map<string,PackedAttribute>& packed) throw(runtime_error);
+    template <class K>
+    void writeVertexData(const PolygonMesh<K>& mesh,
+                         const vector<VertexStream>& streams,
+                         int sizeOfOneVertex,
+                         unsigned char *dest) const;
+    template <class K>
+    void fillVertexBuffer(OpenGLFunctions& gl,
+                          GLenum target,
+                          size_t offset,
+                          const PolygonMesh<K>& mesh,
+                          const vector<VertexStream>& streams,
+                          int sizeOfOneVertex) const;
+    template <int N>
+    static void copyInterleaved(const float *src,size_t count,
+                                unsigned char *dest,int sizeOfOneVertex);
+    static inline glm::vec2 encodeOctahedral(const float *n);
 
   protected:
     GLuint vao; //our VAO
@@ -65,6 +183,11 @@ namespace util
     string name; //a unique "name" for this object
     unsigned int primitiveType;
     unsigned int primitiveCount;
+    VertexFormat format;
+    glm::vec4 positionScale,positionOffset;
+    glm::vec4 minBounds,maxBounds; //bounding box of the mesh
+    BufferArena *arena; //NULL if this object has buffers of its own
+    BufferArena::Range range; //its part of the arena
   };
 
 
@@ -84,231 +207,308 @@ namespace util
 
 
   /*
- * A helper method that sets this object up for rendering
- * \param program the shader program to be used to render this object
- * \param shaderLocations the locations of various shader variables relevant
- *        to this object
- * \param shaderVarsToAttributeNames a mapping of
- *        shader variable -> vertex attributes in the underlying mesh
- * \param mesh the underlying polygon mesh
+ * Work out where each of the vertex attributes named in
+ * shaderVarsToAttributeNames goes in an interleaved vertex (in the order of
+ * that map), in the format of this object
+ * \param streams receives how to convert and place each attribute
+ * \param packed receives the layout of each attribute in a vertex
+ * \return the number of bytes in one vertex
+ * \throws runtime_error if the mesh does not have one of the attributes
  */
   template<class K>
-  void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
-                                       ShaderProgram& program,
-                                       const ShaderLocationsVault& shaderLocations,
+  int ObjectInstance::layoutVertexData(const PolygonMesh<K>& mesh,
                                        const map<string,string>& shaderVarsToAttributeNames,
-                                       const PolygonMesh<K>& mesh)
+                                       vector<VertexStream>& streams,
+                                       map<string,PackedAttribute>& packed) throw(runtime_error)
   {
-    unsigned int i,j;
-
-    initVertexObjects(gl);
-
-
-    primitiveType = mesh.getPrimitiveType();
-    primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
-
-
-    //No need to create buffers in C++!
-
+    typedef typename PolygonMesh<K>::Layout Layout;
     int sizeOfOneVertex=0;
-    map<string,int> offsets;
-
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
-
-    int stride;
-
-    if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
-    else
-      stride = 0;
-
 
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
+    positionScale = glm::vec4(1,1,1,1);
+    positionOffset = glm::vec4(0,0,0,0);
 
-    for (i=0;i<vertexDataList.size();i++)
+    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
       {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
+        VertexStream stream;
+        PackedAttribute& a = stream.packed;
+
+        stream.attribute = Layout::find(it->second);
+        if (stream.attribute<0)
+          throw runtime_error("No attribute: " + it->second + " found!");
+        stream.components = Layout::components(stream.attribute);
+        stream.conversion = COPY_FLOATS;
+
+        a.type = GL_FLOAT;
+        a.size = stream.components;
+        a.normalized = GL_FALSE;
+        if (format==COMPACT_VERTICES)
           {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
+            if ((it->second=="position") && (stream.components>=3))
+              {
+                stream.conversion = SNORM_POSITION;
+                a.type = GL_SHORT;
+                a.size = 4;
+                a.normalized = GL_TRUE;
+
+                //relative to the bounding box
+                glm::vec4 minimum = mesh.getMinimumBounds();
+                glm::vec4 maximum = mesh.getMaximumBounds();
+                glm::vec4 center = (minimum+maximum)*0.5f;
+                glm::vec4 halfSize = (maximum-minimum)*0.5f;
+
+                for (int k=0;k<3;k++)
+                  {
+                    if (halfSize[k]<=0.0f)
+                      halfSize[k] = 1.0f;
+                  }
+                positionScale = glm::vec4(halfSize.x,halfSize.y,halfSize.z,1.0f);
+                positionOffset = glm::vec4(center.x,center.y,center.z,0.0f);
+              }
+            else if ((it->second=="normal") && (stream.components>=3))
               {
-                vertexDataAsFloats.push_back(data[j]);
+                stream.conversion = OCTAHEDRAL_NORMAL;
+                a.type = GL_SHORT;
+                a.size = 2;
+                a.normalized = GL_TRUE;
+              }
+            else if ((it->second=="texcoord") && (stream.components>=2))
+              {
+                stream.conversion = HALF_TEXCOORD;
+                a.type = GL_HALF_FLOAT;
+                a.size = 2;
               }
           }
-      }
-
-
+        a.offset = sizeOfOneVertex;
+        sizeOfOneVertex += a.size*((a.type==GL_FLOAT)?sizeof(float):sizeof(unsigned short));
 
+        streams.push_back(stream);
+        packed[it->second] = a;
+      }
+    return sizeOfOneVertex;
+  }
 
+  /*
+ * Copy N floats a vertex from a packed array to every sizeOfOneVertex bytes
+ * of dest. As N is known at compile time, copying one vertex takes a couple
+ * of moves instead of a call to memcpy
+ */
+  template<int N>
+  void ObjectInstance::copyInterleaved(const float *src,size_t count,
+                                       unsigned char *dest,int sizeOfOneVertex)
+  {
+    for (size_t i=0;i<count;i++)
+      {
+        memcpy(dest,src,N*sizeof(float));
+        src += N;
+        dest += sizeOfOneVertex;
+      }
+  }
 
-    /*
-     * Bind the VAO as the current VAO, so that all subsequent commands affect it
-     */
-    gl.glBindVertexArray(vao);
+  /*
+ * Write the vertex data of the mesh, laid out as worked out by
+ * layoutVertexData, to dest, which must have room for all the vertices
+ */
+  template<class K>
+  void ObjectInstance::writeVertexData(const PolygonMesh<K>& mesh,
+                                       const vector<VertexStream>& streams,
+                                       int sizeOfOneVertex,
+                                       unsigned char *dest) const
+  {
+    typedef typename PolygonMesh<K>::Layout Layout;
+    const VertexArrays<Layout>& arrays = mesh.getVertexArrays();
+    size_t count = arrays.size();
+    size_t i;
 
-    //enable the program
-    program.enable(gl);
+    for (size_t j=0;j<streams.size();j++)
+      {
+        const VertexStream& stream = streams[j];
+        int components = stream.components;
+        const float *src = arrays.data(stream.attribute);
+        unsigned char *d = dest + stream.packed.offset;
 
-    //copy all the data to the vbo[0]
-    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    gl.glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
-        GL_STATIC_DRAW);
+        switch (stream.conversion)
+          {
+          case COPY_FLOATS:
+            //a lone attribute is kept in the mesh exactly as the buffer
+            //wants it
+            if (components*(int)sizeof(float)==sizeOfOneVertex)
+              memcpy(d,src,count*sizeOfOneVertex);
+            else if (components==4)
+              copyInterleaved<4>(src,count,d,sizeOfOneVertex);
+            else if (components==3)
+              copyInterleaved<3>(src,count,d,sizeOfOneVertex);
+            else if (components==2)
+              copyInterleaved<2>(src,count,d,sizeOfOneVertex);
+            else
+              {
+                for (i=0;i<count;i++)
+                  {
+                    memcpy(d,src,components*sizeof(float));
+                    src += components;
+                    d += sizeOfOneVertex;
+                  }
+              }
+            break;
+          case SNORM_POSITION:
+            for (i=0;i<count;i++)
+              {
+                unsigned short q[4];
+
+                for (int k=0;k<3;k++)
+                  q[k] = glm::packSnorm1x16((src[k]-positionOffset[k])/positionScale[k]);
+                q[3] = glm::packSnorm1x16((components>3)?src[3]:1.0f);
+                memcpy(d,q,sizeof(q));
+                src += components;
+                d += sizeOfOneVertex;
+              }
+            break;
+          case OCTAHEDRAL_NORMAL:
+            for (i=0;i<count;i++)
+              {
+                glm::vec2 e = encodeOctahedral(src);
+                unsigned short q[2] = {glm::packSnorm1x16(e.x),glm::packSnorm1x16(e.y)};
 
+                memcpy(d,q,sizeof(q));
+                src += components;
+                d += sizeOfOneVertex;
+              }
+            break;
+          case HALF_TEXCOORD:
+            for (i=0;i<count;i++)
+              {
+                unsigned short h[2] = {glm::packHalf1x16(src[0]),glm::packHalf1x16(src[1])};
 
+                memcpy(d,h,sizeof(h));
+                src += components;
+                d += sizeOfOneVertex;
+              }
+            break;
+          }
+      }
+  }
 
-    /*
-     * go through all variables and enable that
-     * attribute.
-     */
+  /*
+ * Write the vertex data of the mesh into the buffer bound to target,
+ * starting offset bytes in. The buffer is mapped with glMapBufferRange and
+ * written in place. Only if the buffer cannot be mapped is the data put
+ * together in memory first.
+ */
+  template<class K>
+  void ObjectInstance::fillVertexBuffer(OpenGLFunctions& gl,
+                                        GLenum target,
+                                        size_t offset,
+                                        const PolygonMesh<K>& mesh,
+                                        const vector<VertexStream>& streams,
+                                        int sizeOfOneVertex) const
+  {
+    size_t bytes = (size_t)mesh.getVertexCount()*sizeOfOneVertex;
 
+    if (bytes==0)
+      return;
 
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
-         it!=shaderVarsToAttributeNames.cend();
-         it++)
+    void *mapped = gl.glMapBufferRange(target,offset,bytes,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    if (mapped!=NULL)
       {
-        /*
-         * e.key: the name of the shader variable
-         * e.value: the name of the corresponding vertex attribute in polygon mesh
-         */
-
-
-        int shaderLocation = shaderLocations.getLocation(it->first);
-
-        if (shaderLocation>=0)
-          {
-            //tell opengl how to interpret the above data
-            gl.glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
-            //enable this attribute so that when rendered, this is sent to the vertex shader
-            gl.glEnableVertexAttribArray(shaderLocation);
-          }
+        writeVertexData(mesh,streams,sizeOfOneVertex,(unsigned char *)mapped);
+        //false if the contents of the buffer were lost while it was mapped
+        if (gl.glUnmapBuffer(target)==GL_TRUE)
+          return;
       }
 
+    vector<unsigned char> vertexData(bytes);
+    writeVertexData(mesh,streams,sizeOfOneVertex,&vertexData[0]);
+    gl.glBufferSubData(target,offset,bytes,&vertexData[0]);
+  }
 
+  /*
+ * Map a normal onto the octahedron |x|+|y|+|z|=1 and unfold it into the
+ * square [-1,1]x[-1,1]. A zero normal maps to (0,0).
+ */
+  glm::vec2 ObjectInstance::encodeOctahedral(const float *n)
+  {
+    float sum = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
 
+    if (sum<=0.0f)
+      return glm::vec2(0.0f,0.0f);
 
+    glm::vec2 e(n[0]/sum,n[1]/sum);
+    if (n[2]<0.0f)
+      {
+        glm::vec2 folded(1.0f-fabs(e.y),1.0f-fabs(e.x));
+        e.x = (e.x>=0.0f)?folded.x:-folded.x;
+        e.y = (e.y>=0.0f)?folded.y:-folded.y;
+      }
+    return e;
+  }
 
-    /*
-     * Allocate the VBO for triangle indices and send it to GPU
-     */
-    gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
-    gl.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                    primitives.size()*sizeof(GLuint),
-                    &primitives[0],
-        GL_STATIC_DRAW);
 
-    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
 
 
-    /*
-     * Unbind the VAO to prevent accidental change to all the settings
-     * so at this point, this VAO has two VBOs and two enabled VertexAttribPointers.
-     * It is going to remember all of that!
-     */
-    gl.glBindVertexArray(0);
+  /*
+ * A helper method that sets this object up for rendering
+ * \param program the shader program to be used to render this object
+ * \param shaderLocations the locations of various shader variables relevant
+ *        to this object
+ * \param shaderVarsToAttributeNames a mapping of
+ *        shader variable -> vertex attributes in the underlying mesh
+ * \param mesh the underlying polygon mesh
+ * \param arenas if not NULL, the mesh is put in the arena for its vertex
+ *        format instead of buffers of its own
+ */
+  template<class K>
+  void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
+                                       ShaderProgram& program,
+                                       const ShaderLocationsVault& shaderLocations,
+                                       const map<string,string>& shaderVarsToAttributeNames,
+                                       const PolygonMesh<K>& mesh,
+                                       VertexFormat format,
+                                       BufferArenas *arenas)
+  {
+    //enable the program
+    program.enable(gl);
+    initPolygonMesh(gl,shaderLocations,shaderVarsToAttributeNames,mesh,format,arenas);
     program.disable(gl);
   }
 
   /*
  * A helper method that sets this object up for rendering
- * \param program the shader program to be used to render this object
  * \param shaderLocations the locations of various shader variables relevant
  *        to this object
  * \param shaderVarsToAttributeNames a mapping of
  *        shader variable -> vertex attributes in the underlying mesh
  * \param mesh the underlying polygon mesh
+ * \param arenas if not NULL, the mesh is put in the arena for its vertex
+ *        format instead of buffers of its own
  */
   template<class K>
   void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
                                        const ShaderLocationsVault& shaderLocations,
                                        const map<string,string>& shaderVarsToAttributeNames,
-                                       const PolygonMesh<K>& mesh)
+                                       const PolygonMesh<K>& mesh,
+                                       VertexFormat format,
+                                       BufferArenas *arenas)
   {
-    unsigned int i,j;
-
-    initVertexObjects(gl);
-
     primitiveType = mesh.getPrimitiveType();
     primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
-
-
-    //No need to create buffers in C++!
-
-    int sizeOfOneVertex=0;
-    map<string,int> offsets;
-
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
-
-    int stride;
-
-    if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
-    else
-      stride = 0;
-
-
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
-
-    for (i=0;i<vertexDataList.size();i++)
-      {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
-          {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
-              {
-                vertexDataAsFloats.push_back(data[j]);
-              }
-          }
-      }
-
-
+    minBounds = mesh.getMinimumBounds();
+    maxBounds = mesh.getMaximumBounds();
+    ArrayView<unsigned int> primitives = mesh.getPrimitivesView();
 
+    map<string,PackedAttribute> packed;
+    vector<VertexStream> streams;
 
+    this->format = format;
+    int sizeOfOneVertex = layoutVertexData(mesh,
+                                           shaderVarsToAttributeNames,
+                                           streams,
+                                           packed);
 
     /*
-     * Bind the VAO as the current VAO, so that all subsequent commands affect it
+     * go through all variables and find out how the shader reads each
+     * attribute that it has
      */
-    gl.glBindVertexArray(vao);
-
-
-    //copy all the data to the vbo[0]
-    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    gl.glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
-        GL_STATIC_DRAW);
-
-
-
-    /*
-     * go through all variables and enable that
-     * attribute.
-     */
-
+    vector<VertexAttributeFormat> attributes;
 
     for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
          it!=shaderVarsToAttributeNames.cend();
@@ -318,27 +518,59 @@ namespace util
          * e.key: the name of the shader variable
          * e.value: the name of the corresponding vertex attribute in polygon mesh
          */
-
-
         int shaderLocation = shaderLocations.getLocation(it->first);
 
         if (shaderLocation>=0)
           {
-            //tell opengl how to interpret the above data
-            gl.glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
-            //enable this attribute so that when rendered, this is sent to the vertex shader
-            gl.glEnableVertexAttribArray(shaderLocation);
+            const PackedAttribute& a = packed[it->second];
+            VertexAttributeFormat f;
+
+            f.location = shaderLocation;
+            f.size = a.size;
+            f.type = a.type;
+            f.normalized = a.normalized;
+            f.offset = a.offset;
+            attributes.push_back(f);
           }
       }
 
+    if (arenas!=NULL)
+      {
+        //share the buffers and VAO of every mesh with the same vertex format
+        arena = &arenas->get(sizeOfOneVertex,attributes);
+        arena->allocate(gl,mesh.getVertexCount(),primitives.size(),range);
+
+        gl.glBindBuffer(GL_COPY_WRITE_BUFFER,arena->getVertexBuffer());
+        fillVertexBuffer(gl,
+                         GL_COPY_WRITE_BUFFER,
+                         range.baseVertex*sizeOfOneVertex,
+                         mesh,
+                         streams,
+                         sizeOfOneVertex);
+        arena->writeIndices(gl,range,primitives.data());
+        return;
+      }
 
+    initVertexObjects(gl);
 
+    /*
+     * Bind the VAO as the current VAO, so that all subsequent commands affect it
+     */
+    gl.glBindVertexArray(vao);
+
+    //copy all the data to the vbo[0]
+    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    gl.glBufferData(GL_ARRAY_BUFFER,
+                    (size_t)mesh.getVertexCount()*sizeOfOneVertex,
+                    NULL,
+                    GL_STATIC_DRAW);
+    fillVertexBuffer(gl,GL_ARRAY_BUFFER,0,mesh,streams,sizeOfOneVertex);
 
+    //tell opengl how to interpret the above data, and enable each attribute
+    //so that when rendered, it is sent to the vertex shader
+    BufferArena::setAttributePointers(gl,
+                                      attributes,
+                                      (shaderVarsToAttributeNames.size()>1)?sizeOfOneVertex:0);
 
     /*
      * Allocate the VBO for triangle indices and send it to GPU
@@ -346,7 +578,7 @@ namespace util
     gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
     gl.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
                     primitives.size()*sizeof(GLuint),
-                    &primitives[0],
+                    primitives.data(),
         GL_STATIC_DRAW);
 
     gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
@@ -361,14 +593,51 @@ namespace util
   }
 
 
+  glm::vec4 ObjectInstance::getMinimumBounds() const
+  {
+    return minBounds;
+  }
+
+  glm::vec4 ObjectInstance::getMaximumBounds() const
+  {
+    return maxBounds;
+  }
+
+  unsigned int ObjectInstance::getPrimitiveCount() const
+  {
+    return primitiveCount;
+  }
+
+  ObjectInstance::VertexFormat ObjectInstance::getVertexFormat() const
+  {
+    return format;
+  }
+
+  glm::vec4 ObjectInstance::getPositionScale() const
+  {
+    return positionScale;
+  }
+
+  glm::vec4 ObjectInstance::getPositionOffset() const
+  {
+    return positionOffset;
+  }
+
   void ObjectInstance::cleanup(OpenGLFunctions& gl)
   {
-    if (vao!=0)
+    if (arena!=NULL)
+      {
+        //give back the ranges to the arena, so that other meshes can use them
+        arena->release(range);
+        arena = NULL;
+      }
+    else if (vao!=0)
       {
         //give back the VBO IDs to OpenGL, so that they can be reused
         gl.glDeleteBuffers(2,vbo);
         //give back the VAO ID to OpenGL, so that it can be reused
         gl.glDeleteVertexArrays(1,&vao);
+        vao = 0;
       }
   }
 
@@ -381,16 +650,51 @@ namespace util
   {
 
     //1. bind its VAO
-    gl.glBindVertexArray(vao);
+    gl.glBindVertexArray(getVertexArray());
 
     //2. execute the "superpower" command
-    //this effectively reads the index buffer, grabs the vertex data using
-    //the indices and sends them to the shader
-    gl.glDrawElements(primitiveType,primitiveCount, GL_UNSIGNED_INT,(GLvoid *)0);
+    drawElements(gl);
 
     gl.glBindVertexArray(0);
   }
 
+  void ObjectInstance::drawElements(OpenGLFunctions& gl) const
+  {
+    //this effectively reads the index buffer, grabs the vertex data using
+    //the indices and sends them to the shader. The indices of the mesh are
+    //relative to its first vertex
+    gl.glDrawElementsBaseVertex(primitiveType,
+                                primitiveCount,
+                                GL_UNSIGNED_INT,
+                                (GLvoid *)(range.firstIndex*sizeof(GLuint)),
+                                (GLint)range.baseVertex);
+  }
+
+  void ObjectInstance::drawElementsInstanced(OpenGLFunctions& gl,int instances) const
+  {
+    gl.glDrawElementsInstancedBaseVertex(primitiveType,
+                                         primitiveCount,
+                                         GL_UNSIGNED_INT,
+                                         (GLvoid *)(range.firstIndex*sizeof(GLuint)),
+                                         instances,
+                                         (GLint)range.baseVertex);
+  }
+
+  GLuint ObjectInstance::getVertexArray() const
+  {
+    return (arena!=NULL)?arena->getVertexArray():vao;
+  }
+
+  size_t ObjectInstance::getBaseVertex() const
+  {
+    return range.baseVertex;
+  }
+
+  size_t ObjectInstance::getFirstIndex() const
+  {
+    return range.firstIndex;
+  }
+
 
 
   /*
@@ -0,0 +1,159 @@
+#ifndef _OBJECTPOOL_H_
+#define _OBJECTPOOL_H_
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Hands out blocks of one size, taken from chunks that hold many of them.
+ * Freed blocks are kept in a list and handed out again before the next chunk
+ * is taken, so making and freeing many objects of one type costs one call
+ * to the allocator per chunk instead of one per object. Chunks are only
+ * given back when the pool goes away.
+ *
+ * A pool is not safe to use from more than one thread at a time.
+ */
+class ObjectPool
+{
+public:
+    /*
+     * \param blockSize the size of the blocks
+     * \param blocksPerChunk how many blocks a chunk holds
+     */
+    ObjectPool(size_t blockSize,size_t blocksPerChunk=1024)
+    {
+        //every block must be able to hold the link of the free list, and be
+        //aligned like anything else that is allocated
+        const size_t alignment = alignof(std::max_align_t);
+
+        if (blockSize<sizeof(Free))
+            blockSize = sizeof(Free);
+        this->blockSize = (blockSize+alignment-1)/alignment*alignment;
+        this->blocksPerChunk = blocksPerChunk;
+        freeList = NULL;
+        used = 0;
+    }
+
+    ~ObjectPool()
+    {
+        for (size_t i=0;i<chunks.size();i++)
+            std::free(chunks[i]);
+    }
+
+    /*
+     * A block of the size of this pool
+     */
+    void *allocate()
+    {
+        if (freeList==NULL)
+            addChunk();
+
+        Free *block = freeList;
+        freeList = block->next;
+        used++;
+        return block;
+    }
+
+    /*
+     * Gives a block back to this pool
+     * \param block a block handed out by allocate. Nothing is done if it is NULL
+     */
+    void deallocate(void *block)
+    {
+        if (block==NULL)
+            return;
+
+        Free *free = static_cast<Free *>(block);
+        free->next = freeList;
+        freeList = free;
+        used--;
+    }
+
+    size_t getBlockSize() const
+    {
+        return blockSize;
+    }
+
+    /*
+     * The number of blocks handed out and not given back
+     */
+    size_t getUsed() const
+    {
+        return used;
+    }
+
+    /*
+     * The bytes taken from the allocator
+     */
+    size_t getReserved() const
+    {
+        return chunks.size()*blocksPerChunk*blockSize;
+    }
+
+private:
+    struct Free
+    {
+        Free *next;
+    };
+
+    ObjectPool(const ObjectPool&);
+    ObjectPool& operator=(const ObjectPool&);
+
+    void addChunk()
+    {
+        char *chunk = static_cast<char *>(std::malloc(blocksPerChunk*blockSize));
+
+        if (chunk==NULL)
+            throw std::bad_alloc();
+        chunks.push_back(chunk);
+        //link the blocks so that they are handed out in order
+        for (size_t i=blocksPerChunk;i>0;i--)
+        {
+            Free *block = reinterpret_cast<Free *>(chunk+(i-1)*blockSize);
+            block->next = freeList;
+            freeList = block;
+        }
+    }
+
+    size_t blockSize,blocksPerChunk;
+    vector<char *> chunks;
+    Free *freeList;
+    size_t used;
+};
+
+/*
+ * Class specific operator new and delete that take the objects of a class
+ * from a pool of its own (see ObjectPool), which is made the first time it
+ * is needed. The pool is never destroyed, so that objects may still be
+ * deleted while the program exits. Objects of classes derived from it that
+ * are larger are not taken from the pool.
+ * \param Class the class that uses these in its declaration
+ */
+#define UTIL_POOLED_ALLOCATION(Class) \
+    static util::ObjectPool& pool() \
+    { \
+        static util::ObjectPool *objects = new util::ObjectPool(sizeof(Class)); \
+        return *objects; \
+    } \
+    static void *operator new(size_t size) \
+    { \
+        if (size!=sizeof(Class)) \
+            return ::operator new(size); \
+        return pool().allocate(); \
+    } \
+    static void operator delete(void *p,size_t size) \
+    { \
+        if (size!=sizeof(Class)) \
+            ::operator delete(p); \
+        else \
+            pool().deallocate(p); \
+    }
+}
+
+#endif
@@ -2,6 +2,10 @@
 #define _OPENGLFUNCTIONS_H_
 
 #include <QOpenGLFunctions_3_3_Core>
+#include <map>
+#include <utility>
+#include <cstring>
+#include <cstddef>
 
 namespace util
 {
@@ -10,14 +14,294 @@ namespace util
  * Wrapper class for Qt opengl Functions. This is so that it is easier to
  * change version of opengl to be supported.
  * Just use the appropriate Qt profile above and below
+ *
+ * It also keeps track of the program, VAO, textures, capabilities and
+ * uniforms that are set through it, and drops calls that would set them to
+ * what they already are. The state is kept from one frame to the next. State
+ * changed behind its back (for instance by Qt) must be forgotten before it
+ * is relied on again, with invalidateState or with the narrower functions
+ * that forget only what was changed.
  */
 class OpenGLFunctions:public QOpenGLFunctions_3_3_Core
 {
 public:
+    //the texture units whose GL_TEXTURE_2D bindings are tracked
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    /*
+     * Numbers of calls, one for each kind of state
+     */
+    struct StateCounters
+    {
+        size_t programs,vertexArrays,textures,capabilities,uniforms;
+
+        StateCounters()
+        {
+            programs = vertexArrays = textures = capabilities = uniforms = 0;
+        }
+    };
+
     OpenGLFunctions()
     {
         initializeOpenGLFunctions();
+        debug = false;
+        invalidateState();
+    }
+
+    /*
+     * Forget all the state that is kept track of, so that the next call to
+     * set each piece of it is made
+     */
+    void invalidateState()
+    {
+        invalidateBindings();
+        capabilities.clear();
+        intUniforms.clear();
+        matrixUniforms.clear();
+    }
+
+    /*
+     * Forget the GL_TEXTURE_2D binding of every texture unit, for instance
+     * after Qt has made a texture, which binds it
+     */
+    void invalidateTextureBindings()
+    {
+        for (int i=0;i<MAX_TEXTURE_UNITS;i++)
+            textures[i] = UNKNOWN;
+    }
+
+    /*
+     * Forget the current program, the bound VAO, the active texture unit and
+     * the texture bindings, but not the uniforms or the capabilities
+     */
+    void invalidateBindings()
+    {
+        program = vertexArray = UNKNOWN;
+        activeTexture = 0;
+        invalidateTextureBindings();
+    }
+
+    /*
+     * Forget whether a capability is enabled
+     */
+    void invalidateCapability(GLenum cap)
+    {
+        capabilities.erase(cap);
+    }
+
+    /*
+     * In debug mode, the calls that set state are counted, and so are the
+     * ones of them that are dropped
+     */
+    void setDebug(bool debug)
+    {
+        this->debug = debug;
+    }
+
+    bool isDebug() const
+    {
+        return debug;
+    }
+
+    const StateCounters& getRequestedCalls() const
+    {
+        return requested;
+    }
+
+    const StateCounters& getFilteredCalls() const
+    {
+        return filtered;
+    }
+
+    void resetCounters()
+    {
+        requested = StateCounters();
+        filtered = StateCounters();
+    }
+
+    void glUseProgram(GLuint program)
+    {
+        if (tally(requested.programs,filtered.programs,program==this->program))
+            return;
+        this->program = program;
+        QOpenGLFunctions_3_3_Core::glUseProgram(program);
+    }
+
+    void glLinkProgram(GLuint program)
+    {
+        //linking sets all the uniforms of the program back to 0
+        forgetUniforms(program);
+        QOpenGLFunctions_3_3_Core::glLinkProgram(program);
+    }
+
+    void glDeleteProgram(GLuint program)
+    {
+        forgetUniforms(program);
+        if (program==this->program)
+            this->program = UNKNOWN;
+        QOpenGLFunctions_3_3_Core::glDeleteProgram(program);
+    }
+
+    void glBindVertexArray(GLuint array)
+    {
+        if (tally(requested.vertexArrays,filtered.vertexArrays,array==vertexArray))
+            return;
+        vertexArray = array;
+        QOpenGLFunctions_3_3_Core::glBindVertexArray(array);
+    }
+
+    void glDeleteVertexArrays(GLsizei n,const GLuint *arrays)
+    {
+        //deleting the bound VAO binds 0
+        for (GLsizei i=0;i<n;i++)
+        {
+            if (arrays[i]==vertexArray)
+                vertexArray = 0;
+        }
+        QOpenGLFunctions_3_3_Core::glDeleteVertexArrays(n,arrays);
+    }
+
+    void glActiveTexture(GLenum texture)
+    {
+        if (tally(requested.textures,filtered.textures,texture==activeTexture))
+            return;
+        activeTexture = texture;
+        QOpenGLFunctions_3_3_Core::glActiveTexture(texture);
+    }
+
+    void glBindTexture(GLenum target,GLuint texture)
+    {
+        int unit = (int)activeTexture-GL_TEXTURE0;
+
+        if ((target!=GL_TEXTURE_2D) || (activeTexture==0) || (unit>=MAX_TEXTURE_UNITS))
+        {
+            QOpenGLFunctions_3_3_Core::glBindTexture(target,texture);
+            return;
+        }
+        if (tally(requested.textures,filtered.textures,texture==textures[unit]))
+            return;
+        textures[unit] = texture;
+        QOpenGLFunctions_3_3_Core::glBindTexture(target,texture);
+    }
+
+    void glDeleteTextures(GLsizei n,const GLuint *textures)
+    {
+        //deleting a bound texture binds 0 in its place
+        for (GLsizei i=0;i<n;i++)
+        {
+            for (int u=0;u<MAX_TEXTURE_UNITS;u++)
+            {
+                if (this->textures[u]==textures[i])
+                    this->textures[u] = 0;
+            }
+        }
+        QOpenGLFunctions_3_3_Core::glDeleteTextures(n,textures);
+    }
+
+    void glEnable(GLenum cap)
+    {
+        if (setCapability(cap,true))
+            QOpenGLFunctions_3_3_Core::glEnable(cap);
+    }
+
+    void glDisable(GLenum cap)
+    {
+        if (setCapability(cap,false))
+            QOpenGLFunctions_3_3_Core::glDisable(cap);
+    }
+
+    /*
+     * Uniforms are kept track of for each program, while the program that
+     * they are set in is known
+     */
+    void glUniform1i(GLint location,GLint v0)
+    {
+        if ((location>=0) && (program!=UNKNOWN))
+        {
+            UniformKey key(program,location);
+            std::map<UniformKey,GLint>::iterator it = intUniforms.find(key);
+            bool same = (it!=intUniforms.end()) && (it->second==v0);
+
+            if (tally(requested.uniforms,filtered.uniforms,same))
+                return;
+            intUniforms[key] = v0;
+        }
+        QOpenGLFunctions_3_3_Core::glUniform1i(location,v0);
     }
+
+    void glUniformMatrix4fv(GLint location,GLsizei count,GLboolean transpose,const GLfloat *value)
+    {
+        if ((location>=0) && (program!=UNKNOWN) && (count==1) && !transpose)
+        {
+            UniformKey key(program,location);
+            std::map<UniformKey,Matrix>::iterator it = matrixUniforms.find(key);
+            bool same = (it!=matrixUniforms.end())
+                    && (memcmp(it->second.values,value,sizeof(Matrix))==0);
+
+            if (tally(requested.uniforms,filtered.uniforms,same))
+                return;
+            memcpy(matrixUniforms[key].values,value,sizeof(Matrix));
+        }
+        QOpenGLFunctions_3_3_Core::glUniformMatrix4fv(location,count,transpose,value);
+    }
+
+private:
+    typedef std::pair<GLuint,GLint> UniformKey;
+    struct Matrix
+    {
+        GLfloat values[16];
+    };
+
+    //a name that stands for state that is not known
+    static const GLuint UNKNOWN = 0xffffffffu;
+
+    /*
+     * Count a call in debug mode
+     * \param redundant whether the call would not change anything
+     * \return redundant
+     */
+    bool tally(size_t& requestedCalls,size_t& filteredCalls,bool redundant)
+    {
+        if (debug)
+        {
+            requestedCalls++;
+            if (redundant)
+                filteredCalls++;
+        }
+        return redundant;
+    }
+
+    /*
+     * Remember the state of a capability
+     * \return whether the call to set it must be made
+     */
+    bool setCapability(GLenum cap,bool enabled)
+    {
+        std::map<GLenum,bool>::iterator it = capabilities.find(cap);
+        bool same = (it!=capabilities.end()) && (it->second==enabled);
+
+        if (tally(requested.capabilities,filtered.capabilities,same))
+            return false;
+        capabilities[cap] = enabled;
+        return true;
+    }
+
+    void forgetUniforms(GLuint program)
+    {
+        intUniforms.erase(intUniforms.lower_bound(UniformKey(program,0)),
+                          intUniforms.lower_bound(UniformKey(program+1,0)));
+        matrixUniforms.erase(matrixUniforms.lower_bound(UniformKey(program,0)),
+                             matrixUniforms.lower_bound(UniformKey(program+1,0)));
+    }
+
+    bool debug;
+    StateCounters requested,filtered;
+    GLuint program,vertexArray;
+    GLenum activeTexture; //0 if not known
+    GLuint textures[MAX_TEXTURE_UNITS]; //bound to GL_TEXTURE_2D of each unit
+    std::map<GLenum,bool> capabilities;
+    std::map<UniformKey,GLint> intUniforms;
+    std::map<UniformKey,Matrix> matrixUniforms;
 };
 }
 
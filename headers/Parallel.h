@@ -0,0 +1,58 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <vector>
+#include <thread>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Split [0,count) into numThreads contiguous ranges and call f(first,last)
+ * for each of them concurrently. The calling thread handles the first range.
+ * To give every thread its own state, call it with count equal to numThreads
+ * and use first as the index of the thread.
+ */
+template <class F>
+void parallelFor(size_t count,unsigned int numThreads,F f)
+{
+    if ((numThreads<=1) || (count<numThreads))
+    {
+        f(0,count);
+        return;
+    }
+
+    vector<thread> workers;
+    for (unsigned int t=1;t<numThreads;t++)
+    {
+        workers.push_back(thread(f,count*t/numThreads,count*(t+1)/numThreads));
+    }
+    f(0,count/numThreads);
+    for (unsigned int t=0;t<workers.size();t++)
+    {
+        workers[t].join();
+    }
+}
+
+/*
+ * The number of threads to use for count items of work.
+ * \param count the number of items
+ * \param numThreads the number of threads asked for, or 0 to use all the
+ *        cores of the machine
+ * \param grain no thread is started for fewer than this many items
+ */
+inline unsigned int threadCount(size_t count,unsigned int numThreads,size_t grain)
+{
+    if (numThreads==0)
+        numThreads = thread::hardware_concurrency();
+
+    size_t most = count/grain + 1;
+    if (numThreads>most)
+        numThreads = (unsigned int)most;
+    return (numThreads<1)?1:numThreads;
+}
+}
+
+#endif
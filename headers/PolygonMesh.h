@@ -4,6 +4,10 @@
 #define GLM_SWIZZLE
 #include <glm/glm.hpp>
 #include <vector>
+#include "VertexLayout.h"
+#include "ArrayView.h"
+#include "MeshKernels.h"
+#include <utility>
 using namespace std;
 
 namespace util
@@ -18,9 +22,12 @@ namespace util
  * It stores a polygon mesh as follows:
  *
  * <ul>
- *     <li>A list of vertices: Each vertex is represented by an object that
- *         stores various attributes of that vertex like position, normal,
- *         texture coordinates and others.</li>
+ *     <li>A list of vertices: Each vertex has various attributes like
+ *         position, normal, texture coordinates and others. They are stored
+ *         as VertexArrays, i.e. one contiguous array per attribute, laid out
+ *         as described by the VertexLayout of the vertex class. Lists of
+ *         vertex objects are converted to and from this form by
+ *         setVertexData and getVertexAttributes.</li>
  *     <li>A list of indices: these are indices into the above array.
  *         This is called indexed representation and allows us to share vertices
  *         between polygons efficiently.</li>
@@ -37,8 +44,18 @@ class PolygonMesh
 
 
 public:
+    typedef typename VertexTraits<VertexType>::Layout Layout;
+
     PolygonMesh();
     ~PolygonMesh();
+    /*
+     * Meshes can be large, so they should be moved rather than copied
+     * wherever the source is not needed anymore
+     */
+    PolygonMesh(const PolygonMesh& other) = default;
+    PolygonMesh(PolygonMesh&& other) = default;
+    PolygonMesh& operator=(const PolygonMesh& other) = default;
+    PolygonMesh& operator=(PolygonMesh&& other) = default;
     /*
      * Set the primitive type. The primitive type is represented by an integer.
      * For example in OpenGL, these would be GL_TRIANGLES, GL_TRIANGLE_FAN,
@@ -60,22 +77,50 @@ public:
     glm::vec4 getMaximumBounds() const;
     vector<VertexType> getVertexAttributes() const;
     vector<unsigned int> getPrimitives() const;
+    /*
+     * A view of the indices of this mesh, without copying them. It is valid
+     * until the indices are changed or the mesh is destroyed.
+     */
+    ArrayView<unsigned int> getPrimitivesView() const;
     void setVertexData(const vector<VertexType>& vp);
     void setPrimitives(const vector<unsigned int>& t);
+    /*
+     * Take over the given indices without copying them
+     */
+    void setPrimitives(vector<unsigned int>&& t);
+    /*
+     * Exchange the indices of this mesh with the given list, without copying
+     * either of them
+     */
+    void swapPrimitives(vector<unsigned int>& t);
+    /*
+     * The vertex data of this mesh, one array per attribute of the layout
+     */
+    const VertexArrays<Layout>& getVertexArrays() const;
+    void setVertexArrays(const VertexArrays<Layout>& arrays);
+    void setVertexArrays(VertexArrays<Layout>&& arrays);
+    /*
+     * Exchange the vertex data of this mesh with the given arrays, without
+     * copying either of them. The bounding box is recomputed.
+     */
+    void swapVertexArrays(VertexArrays<Layout>& arrays);
     /*
      * Compute vertex normals in this polygon mesh using Newell's method, if
      * position data exists
+     * \param numThreads the number of threads to use at most. 0 means one
+     *        per core. Small meshes always use one thread.
      */
-    void computeNormals();
+    void computeNormals(unsigned int numThreads=0);
     /*
      * Compute the bounding box of this polygon mesh, if there is position data
+     * \param numThreads as for computeNormals
      */
-    void computeBoundingBox();
+    void computeBoundingBox(unsigned int numThreads=0);
 
 
 
 protected:
-    vector<VertexType> vertexData;
+    VertexArrays<Layout> vertexData;
     vector<unsigned int> primitives;
     int primitiveType;
     int primitiveSize;
@@ -146,7 +191,10 @@ glm::vec4 PolygonMesh<VertexType>::getMaximumBounds() const
 template<class VertexType>
 vector<VertexType> PolygonMesh<VertexType>::getVertexAttributes() const
 {
-    return vector<VertexType>(vertexData);
+    vector<VertexType> vertices;
+
+    fromVertexArrays(vertexData,vertices);
+    return vertices;
 }
 
 template<class VertexType>
@@ -155,10 +203,16 @@ vector<unsigned int> PolygonMesh<VertexType>::getPrimitives() const
     return vector<unsigned int>(primitives);
 }
 
+template<class VertexType>
+ArrayView<unsigned int> PolygonMesh<VertexType>::getPrimitivesView() const
+{
+    return ArrayView<unsigned int>(primitives);
+}
+
 template <class VertexType>
 void PolygonMesh<VertexType>::setVertexData(const vector<VertexType>& vp)
 {
-    vertexData = vector<VertexType>(vp);
+    toVertexArrays(vp,vertexData);
     computeBoundingBox();
 }
 
@@ -168,72 +222,60 @@ void PolygonMesh<VertexType>::setPrimitives(const vector<unsigned int>& t)
     primitives = vector<unsigned int>(t);
 }
 
+template<class VertexType>
+void PolygonMesh<VertexType>::setPrimitives(vector<unsigned int>&& t)
+{
+    primitives = std::move(t);
+}
 
 template<class VertexType>
-void PolygonMesh<VertexType>::computeBoundingBox()
+void PolygonMesh<VertexType>::swapPrimitives(vector<unsigned int>& t)
 {
-    unsigned int i,j;
+    primitives.swap(t);
+}
 
-    if (vertexData.size()<=0)
-        return;
+template<class VertexType>
+const VertexArrays<typename PolygonMesh<VertexType>::Layout>&
+PolygonMesh<VertexType>::getVertexArrays() const
+{
+    return vertexData;
+}
 
-    if (!vertexData[0].hasData("position"))
-    {
-        return;
-    }
+template<class VertexType>
+void PolygonMesh<VertexType>::setVertexArrays(const VertexArrays<Layout>& arrays)
+{
+    vertexData = arrays;
+    computeBoundingBox();
+}
 
-    vector<glm::vec4> positions;
+template<class VertexType>
+void PolygonMesh<VertexType>::setVertexArrays(VertexArrays<Layout>&& arrays)
+{
+    vertexData = std::move(arrays);
+    computeBoundingBox();
+}
 
-    for (i=0;i<vertexData.size();i++)
-    {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos = glm::vec4(0,0,0,1);
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
-        }
-        positions.push_back(pos);
-    }
+template<class VertexType>
+void PolygonMesh<VertexType>::swapVertexArrays(VertexArrays<Layout>& arrays)
+{
+    vertexData.swap(arrays);
+    computeBoundingBox();
+}
 
-    minBounds = glm::vec4(positions[0]);
-    maxBounds = glm::vec4(positions[0]);
 
-    for (j=0;j<positions.size();j++)
+template<class VertexType>
+void PolygonMesh<VertexType>::computeBoundingBox(unsigned int numThreads)
+{
+    int position = Layout::find("position");
+
+    if ((position<0) || (Layout::components(position)<3))
     {
-        glm::vec4 p = positions[j];
-
-        if (p.x<minBounds.x)
-        {
-            minBounds.x = p.x;
-        }
-
-        if (p.x>maxBounds.x)
-        {
-            maxBounds.x = p.x;
-        }
-
-        if (p.y<minBounds.y)
-        {
-            minBounds.y = p.y;
-        }
-
-        if (p.y>maxBounds.y)
-        {
-            maxBounds.y = p.y;
-        }
-
-        if (p.z<minBounds.z)
-        {
-            minBounds.z = p.z;
-        }
-
-        if (p.z>maxBounds.z)
-        {
-            maxBounds.z = p.z;
-        }
+        return;
     }
+
+    MeshKernels::bounds(vertexData.data(position),vertexData.size(),
+                        Layout::components(position),
+                        minBounds,maxBounds,numThreads);
 }
 
 /*
@@ -242,88 +284,27 @@ void PolygonMesh<VertexType>::computeBoundingBox()
  */
 
 template<class VertexType>
-void PolygonMesh<VertexType>::computeNormals()
+void PolygonMesh<VertexType>::computeNormals(unsigned int numThreads)
 {
-    int i,j,k;
+    int position = Layout::find("position");
+    int normal = Layout::find("normal");
 
-    if (vertexData.size()<=0)
-        return;
-
-    if (!vertexData[0].hasData("position"))
+    if ((position<0) || (Layout::components(position)<3))
     {
         return;
     }
 
-    if (!vertexData[0].hasData("normal"))
+    if ((normal<0) || (Layout::components(normal)<3))
         return;
 
-    vector<glm::vec4> positions;
-
-    for (i=0;i<positions.size();i++) {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos;
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
-        }
-        positions.push_back(pos);
-    }
-    vector<glm::vec4> normals;
-
-    for (i=0;i<positions.size();i++)
-    {
-        normals.push_back(glm::vec4(0.0f,0.0f,0.0f,0.0f));
-    }
-
-    for (i=0;i<primitives.size();i+=primitiveSize)
-    {
-        glm::vec4 norm = glm::vec4(0.0f,0.0f,0.0f,0.0f);
-
-
-
-        //compute the normal of this triangle
-        vector<unsigned int>v;
-
-        for (k=0;k<primitiveSize;k++)
-        {
-            v.push_back(primitives[i+k]);
-        }
-
-        //the newell's method to calculate normal
-
-        for (k=0;k<primitiveSize;k++)
-        {
-            norm.x += (positions[v[k]].y-positions[v[(k+1)%primitiveSize]].y)*
-                      (positions[v[k]].z+positions[v[(k+1)%primitiveSize]].z);
-            norm.y += (positions[v[k]].z-positions[v[(k+1)%primitiveSize]].z)*
-                      (positions[v[k]].x+positions[v[(k+1)%primitiveSize]].x);
-            norm.z += (positions[v[k]].x-positions[v[(k+1)%primitiveSize]].x)*
-                      (positions[v[k]].y+positions[v[(k+1)%primitiveSize]].y);
-        }
-        norm = glm::normalize(norm);
-
-        for (k=0;k<primitiveSize;k++)
-        {
-            normals[v[k]] = normals[v[k]] + norm;
-        }
-    }
-
-    for (i=0;i<normals.size();i++)
-    {
+    if (Layout::components(position)!=Layout::components(normal))
+        return;
 
-        normals[i] = glm::normalize(normals[i]);
-    }
-    for (i=0;i<vertexData.size();i++) {
-        vector<float> n;
-
-        n.push_back(normals[i].x);
-        n.push_back(normals[i].y);
-        n.push_back(normals[i].z);
-        n.push_back(normals[i].w);
-        vertexData[i].setData("normal",n);
-    }
+    MeshKernels::normals(vertexData.data(position),vertexData.size(),
+                         primitives.empty()?NULL:&primitives[0],primitives.size(),
+                         primitiveSize,
+                         vertexData.data(normal),Layout::components(normal),
+                         numThreads);
 }
 }
 #endif
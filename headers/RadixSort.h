@@ -0,0 +1,63 @@
+#ifndef _RADIXSORT_H_
+#define _RADIXSORT_H_
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A 64-bit sort key and the index of the item it belongs to
+ */
+struct SortItem
+{
+    uint64_t key;
+    uint32_t index;
+};
+
+/*
+ * Sorts items by key, from the least key to the greatest, keeping items with
+ * the same key in the order they were in (least significant digit radix
+ * sort, one byte at a time). Bytes that are the same in every key are
+ * skipped, so keys that only use a few bits cost only a few passes.
+ * \param items the items to sort
+ * \param scratch room for the same number of items, kept by the caller so
+ * that sorting every frame does not allocate
+ */
+inline void radixSort(vector<SortItem>& items,vector<SortItem>& scratch)
+{
+    size_t counts[8][256] = {{0}};
+
+    for (size_t i=0;i<items.size();i++)
+    {
+        uint64_t key = items[i].key;
+        for (int d=0;d<8;d++)
+            counts[d][(key>>(8*d))&0xff]++;
+    }
+
+    scratch.resize(items.size());
+    for (int d=0;d<8;d++)
+    {
+        size_t *count = counts[d];
+        size_t offset = 0;
+
+        if (items.empty() || (count[(items[0].key>>(8*d))&0xff]==items.size()))
+            continue;
+
+        for (int b=0;b<256;b++)
+        {
+            size_t c = count[b];
+            count[b] = offset;
+            offset += c;
+        }
+        for (size_t i=0;i<items.size();i++)
+            scratch[count[(items[i].key>>(8*d))&0xff]++] = items[i];
+        items.swap(scratch);
+    }
+}
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef _UNIFORMBUFFERS_H_
+#define _UNIFORMBUFFERS_H_
+
+#include "OpenGLFunctions.h"
+#include "Material.h"
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A uniform buffer that is written from front to back. A block is either
+ * written and bound to a uniform block binding point at once (bind), or
+ * staged in memory with the other blocks of a batch (stage), which are all
+ * written with one glBufferSubData (upload) and bound one by one afterwards
+ * (bindRange). Blocks start at multiples of
+ * GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+ *
+ * When the end is reached the storage is orphaned (given new storage with
+ * glBufferData) and writing starts over at the front, so that a block is
+ * never written while a draw that reads it may still be in flight.
+ */
+class UniformRing
+{
+public:
+    UniformRing()
+    {
+        buffer = 0;
+        capacity = 0;
+        head = 0;
+        alignment = 256;
+        stagedSize = stagedEnd = 0;
+    }
+
+    GLuint getBuffer() const
+    {
+        return buffer;
+    }
+
+    /*
+     * Make the buffer
+     * \param capacity the size of the buffer in bytes
+     */
+    void init(OpenGLFunctions& gl,size_t capacity)
+    {
+        GLint a = 0;
+
+        cleanup(gl);
+        gl.glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&a);
+        alignment = std::max(a,1);
+        this->capacity = capacity;
+        head = 0;
+        stagedSize = stagedEnd = 0;
+        gl.glGenBuffers(1,&buffer);
+        gl.glBindBuffer(GL_UNIFORM_BUFFER,buffer);
+        gl.glBufferData(GL_UNIFORM_BUFFER,capacity,NULL,GL_STREAM_DRAW);
+    }
+
+    /*
+     * Copy a block into the ring and bind it to a binding point
+     * \param binding the uniform block binding point
+     * \param data the block, laid out as std140
+     * \param size the size of the block in bytes
+     * \param rangeSize the size of the range to bind, if the block is only
+     * the front part of a larger one (a partly filled array). The range must
+     * fit in the capacity
+     * \return the offset of the block in the buffer
+     */
+    size_t bind(OpenGLFunctions& gl,GLuint binding,const void *data,size_t size,
+                size_t rangeSize=0)
+    {
+        size_t offset = (head+alignment-1)/alignment*alignment;
+
+        rangeSize = std::max(rangeSize,size);
+        if (offset+rangeSize>capacity)
+        {
+            gl.glBindBuffer(GL_UNIFORM_BUFFER,buffer);
+            gl.glBufferData(GL_UNIFORM_BUFFER,capacity,NULL,GL_STREAM_DRAW);
+            offset = 0;
+        }
+        //this also binds the buffer to GL_UNIFORM_BUFFER for the write
+        gl.glBindBufferRange(GL_UNIFORM_BUFFER,binding,buffer,offset,rangeSize);
+        gl.glBufferSubData(GL_UNIFORM_BUFFER,offset,size,data);
+        head = offset+rangeSize;
+        return offset;
+    }
+
+    /*
+     * Add a block to the batch that upload writes. The block must be written
+     * to the memory returned before the next block is staged
+     * \param size the size of the block in bytes
+     * \param rangeSize the size of the range that will be bound, if the block
+     * is only the front part of a larger one. The ranges of blocks may
+     * overlap the blocks after them
+     * \param offset receives the offset of the block from the start of the
+     * batch
+     * \return where to write the block
+     */
+    void *stage(size_t size,size_t rangeSize,size_t& offset)
+    {
+        offset = (stagedSize+alignment-1)/alignment*alignment;
+        if (staging.size()<offset+size)
+            staging.resize(std::max(offset+size,2*staging.size()));
+        stagedSize = offset+size;
+        stagedEnd = std::max(stagedEnd,offset+std::max(rangeSize,size));
+        return &staging[offset];
+    }
+
+    /*
+     * Write the blocks staged since the last upload to the buffer, with one
+     * glBufferSubData, and start a new batch. If the batch does not fit in
+     * the capacity, the buffer is made as large as it
+     * \return the offset of the batch in the buffer, which the offsets of its
+     * blocks are from
+     */
+    size_t upload(OpenGLFunctions& gl)
+    {
+        size_t offset = (head+alignment-1)/alignment*alignment;
+
+        if (stagedSize==0)
+            return offset;
+
+        gl.glBindBuffer(GL_UNIFORM_BUFFER,buffer);
+        if (offset+stagedEnd>capacity)
+        {
+            capacity = std::max(capacity,stagedEnd);
+            gl.glBufferData(GL_UNIFORM_BUFFER,capacity,NULL,GL_STREAM_DRAW);
+            offset = 0;
+        }
+        gl.glBufferSubData(GL_UNIFORM_BUFFER,offset,stagedSize,&staging[0]);
+        head = offset+stagedEnd;
+        stagedSize = stagedEnd = 0;
+        return offset;
+    }
+
+    /*
+     * Bind a block that has been uploaded to a binding point
+     * \param binding the uniform block binding point
+     * \param offset the offset of the block in the buffer
+     * \param rangeSize the size of the range to bind
+     */
+    void bindRange(OpenGLFunctions& gl,GLuint binding,size_t offset,size_t rangeSize)
+    {
+        gl.glBindBufferRange(GL_UNIFORM_BUFFER,binding,buffer,offset,rangeSize);
+    }
+
+    void cleanup(OpenGLFunctions& gl)
+    {
+        if (buffer!=0)
+        {
+            gl.glDeleteBuffers(1,&buffer);
+            buffer = 0;
+        }
+    }
+
+private:
+    GLuint buffer;
+    size_t capacity;
+    size_t head;
+    size_t alignment;
+
+    /*
+     * The blocks of the batch being staged, which take up stagedSize bytes
+     * and whose ranges end stagedEnd bytes from its start. The memory is
+     * kept from batch to batch
+     */
+    vector<unsigned char> staging;
+    size_t stagedSize,stagedEnd;
+};
+
+/*
+ * A uniform buffer holding an array of materials, that draws refer to by
+ * index. A material is written into the table the first time it is asked
+ * for, and draws with the same material afterwards reuse its entry.
+ *
+ * When the table is full the user issues the draws that refer to it so far
+ * and starts the table over. Entries that are overwritten that way still
+ * read as before in those draws, because GL applies buffer updates in order
+ * with draws.
+ */
+class MaterialTable
+{
+public:
+    //must match the size of the array in the shader
+    static const int MAX_MATERIALS = 256;
+
+    /*
+     * One material, laid out as the std140 struct
+     * { vec4 ambient; vec4 diffuse; vec4 specular; float shininess; }
+     */
+    struct Entry
+    {
+        glm::vec4 ambient,diffuse,specular;
+        glm::vec4 shininess; //in x
+
+        bool operator<(const Entry& other) const
+        {
+            return memcmp(this,&other,sizeof(Entry))<0;
+        }
+    };
+
+    MaterialTable()
+    {
+        buffer = 0;
+        last = -1;
+    }
+
+    GLuint getBuffer() const
+    {
+        return buffer;
+    }
+
+    /*
+     * The size of the table in bytes
+     */
+    static size_t getSize()
+    {
+        return MAX_MATERIALS*sizeof(Entry);
+    }
+
+    void init(OpenGLFunctions& gl)
+    {
+        cleanup(gl);
+        gl.glGenBuffers(1,&buffer);
+        gl.glBindBuffer(GL_UNIFORM_BUFFER,buffer);
+        gl.glBufferData(GL_UNIFORM_BUFFER,getSize(),NULL,GL_DYNAMIC_DRAW);
+    }
+
+    /*
+     * The index of a material in the table, writing it if it is not in yet
+     * \return -1 if the material is not in the table and the table is full
+     */
+    int indexOf(OpenGLFunctions& gl,const Material& material)
+    {
+        Entry entry;
+
+        entry.ambient = material.getAmbient();
+        entry.diffuse = material.getDiffuse();
+        entry.specular = material.getSpecular();
+        entry.shininess = glm::vec4(material.getShininess(),0,0,0);
+
+        //neighbouring draws often have the same material
+        if ((last>=0) && (memcmp(&entry,&lastEntry,sizeof(Entry))==0))
+            return last;
+
+        map<Entry,int>::iterator it = indices.find(entry);
+        if (it!=indices.end())
+            last = it->second;
+        else
+        {
+            if ((int)indices.size()==MAX_MATERIALS)
+                return -1;
+            last = (int)indices.size();
+            indices[entry] = last;
+            gl.glBindBuffer(GL_UNIFORM_BUFFER,buffer);
+            gl.glBufferSubData(GL_UNIFORM_BUFFER,last*sizeof(Entry),sizeof(Entry),&entry);
+        }
+        lastEntry = entry;
+        return last;
+    }
+
+    /*
+     * Empty the table, so that materials are written from the first entry
+     * again
+     */
+    void startOver()
+    {
+        indices.clear();
+        last = -1;
+    }
+
+    void cleanup(OpenGLFunctions& gl)
+    {
+        if (buffer!=0)
+        {
+            gl.glDeleteBuffers(1,&buffer);
+            buffer = 0;
+        }
+        startOver();
+    }
+
+private:
+    GLuint buffer;
+    map<Entry,int> indices;
+    int last; //the index of the material asked for last
+    Entry lastEntry;
+};
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef _VERTEXLAYOUT_H_
+#define _VERTEXLAYOUT_H_
+
+#include <glm/glm.hpp>
+#include "ArrayView.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Descriptors of the vertex attributes that a VertexLayout can be made of.
+ * Each descriptor gives the name of the attribute (as used by IVertexData),
+ * the number of floats it is made of, and the value that an attribute has
+ * before it is set (the same defaults that VertexAttrib uses).
+ */
+struct PositionAttribute
+{
+    static const char *name() { return "position";}
+    static constexpr int components = 4;
+    static glm::vec4 defaultValue() { return glm::vec4(0,0,0,1);}
+};
+
+struct NormalAttribute
+{
+    static const char *name() { return "normal";}
+    static constexpr int components = 4;
+    static glm::vec4 defaultValue() { return glm::vec4(0,0,0,0);}
+};
+
+struct TexcoordAttribute
+{
+    static const char *name() { return "texcoord";}
+    static constexpr int components = 4;
+    static glm::vec4 defaultValue() { return glm::vec4(0,0,0,1);}
+};
+
+/*
+ * Compile-time helpers for VertexLayout: the total number of floats in a list
+ * of attributes, and the position of an attribute within such a list.
+ */
+template <class... Attributes>
+struct LayoutSize;
+
+template <>
+struct LayoutSize<>
+{
+    static constexpr int value = 0;
+};
+
+template <class A,class... Rest>
+struct LayoutSize<A,Rest...>
+{
+    static constexpr int value = A::components + LayoutSize<Rest...>::value;
+};
+
+//not defined if T is not in the list, so asking for a missing attribute
+//does not compile
+template <class T,class... Attributes>
+struct LayoutPosition;
+
+template <class T,class... Rest>
+struct LayoutPosition<T,T,Rest...>
+{
+    static constexpr int index = 0;
+    static constexpr int offset = 0;
+};
+
+template <class T,class A,class... Rest>
+struct LayoutPosition<T,A,Rest...>
+{
+    static constexpr int index = 1 + LayoutPosition<T,Rest...>::index;
+    static constexpr int offset = A::components + LayoutPosition<T,Rest...>::offset;
+};
+
+/*
+ * A vertex layout fixed at compile time: an ordered list of attribute
+ * descriptors. The index, offset and size of every attribute are
+ * compile-time constants, so code written against a layout does not have to
+ * look attributes up by name.
+ *
+ * Offsets and the stride are counted in floats, for the layout in which all
+ * the attributes of a vertex are interleaved in the order given.
+ *
+ * Code that only knows an attribute by its name at run time (e.g. from a
+ * shader variable mapping) can find it with find().
+ */
+template <class... Attributes>
+class VertexLayout
+{
+public:
+    static constexpr int attributeCount = sizeof...(Attributes);
+    static constexpr int stride = LayoutSize<Attributes...>::value;
+
+    template <class A>
+    static constexpr int index() { return LayoutPosition<A,Attributes...>::index;}
+
+    template <class A>
+    static constexpr int offset() { return LayoutPosition<A,Attributes...>::offset;}
+
+    static const char *name(int i)
+    {
+        static const char *names[] = {Attributes::name()...};
+        return names[i];
+    }
+
+    static int components(int i)
+    {
+        static const int counts[] = {Attributes::components...};
+        return counts[i];
+    }
+
+    static int offset(int i)
+    {
+        int o = 0;
+        for (int j=0;j<i;j++)
+            o += components(j);
+        return o;
+    }
+
+    static glm::vec4 defaultValue(int i)
+    {
+        static const glm::vec4 values[] = {Attributes::defaultValue()...};
+        return values[i];
+    }
+
+    /*
+     * Returns the index of the attribute with the given name, or -1 if this
+     * layout does not have it
+     */
+    static int find(const string& attribName)
+    {
+        for (int i=0;i<attributeCount;i++)
+        {
+            if (attribName==name(i))
+                return i;
+        }
+        return -1;
+    }
+};
+
+/*
+ * Vertex data stored as a structure of arrays: the values of each attribute
+ * of all vertices are kept in one contiguous array of floats, in vertex
+ * order. Loops over one attribute (e.g. all positions) therefore touch only
+ * contiguous memory, and reading or writing a value does not allocate.
+ */
+template <class Layout>
+class VertexArrays
+{
+public:
+    VertexArrays()
+    {
+        count = 0;
+    }
+
+    explicit VertexArrays(size_t n)
+    {
+        count = 0;
+        resize(n);
+    }
+
+    size_t size() const { return count;}
+
+    /*
+     * Change the number of vertices. New vertices have the default value of
+     * every attribute.
+     */
+    void resize(size_t n)
+    {
+        for (int a=0;a<Layout::attributeCount;a++)
+        {
+            int c = Layout::components(a);
+            glm::vec4 initial = Layout::defaultValue(a);
+            size_t old = arrays[a].size();
+
+            arrays[a].resize(n*c);
+            for (size_t i=old;i<arrays[a].size();i+=c)
+            {
+                for (int k=0;k<c;k++)
+                    arrays[a][i+k] = (k<4)?initial[k]:0.0f;
+            }
+        }
+        count = n;
+    }
+
+    void clear()
+    {
+        for (int a=0;a<Layout::attributeCount;a++)
+            vector<float>().swap(arrays[a]);
+        count = 0;
+    }
+
+    void swap(VertexArrays& other)
+    {
+        for (int a=0;a<Layout::attributeCount;a++)
+            arrays[a].swap(other.arrays[a]);
+        std::swap(count,other.count);
+    }
+
+    /*
+     * The values of the given attribute of all vertices, components of a
+     * vertex next to each other
+     */
+    float *data(int attribute)
+    {
+        return arrays[attribute].empty()?NULL:&arrays[attribute][0];
+    }
+
+    const float *data(int attribute) const
+    {
+        return arrays[attribute].empty()?NULL:&arrays[attribute][0];
+    }
+
+    template <class A>
+    float *data() { return data(Layout::template index<A>());}
+
+    template <class A>
+    const float *data() const { return data(Layout::template index<A>());}
+
+    ArrayView<float> view(int attribute) const
+    {
+        return ArrayView<float>(arrays[attribute]);
+    }
+
+    template <class A>
+    ArrayView<float> view() const { return view(Layout::template index<A>());}
+
+    /*
+     * Returns the given attribute of vertex i. Attributes with fewer than 4
+     * components are padded with the default value of the attribute.
+     */
+    glm::vec4 get(int attribute,size_t i) const
+    {
+        int c = Layout::components(attribute);
+        const float *f = &arrays[attribute][i*c];
+        glm::vec4 v = Layout::defaultValue(attribute);
+
+        for (int k=0;(k<c) && (k<4);k++)
+            v[k] = f[k];
+        return v;
+    }
+
+    void set(int attribute,size_t i,const glm::vec4& v)
+    {
+        int c = Layout::components(attribute);
+        float *f = &arrays[attribute][i*c];
+
+        for (int k=0;(k<c) && (k<4);k++)
+            f[k] = v[k];
+    }
+
+    template <class A>
+    glm::vec4 get(size_t i) const
+    {
+        static_assert(A::components<=4,"get() only handles up to 4 components");
+        const float *f = &arrays[Layout::template index<A>()][i*A::components];
+        glm::vec4 v = A::defaultValue();
+
+        for (int k=0;k<A::components;k++)
+            v[k] = f[k];
+        return v;
+    }
+
+    template <class A>
+    void set(size_t i,const glm::vec4& v)
+    {
+        static_assert(A::components<=4,"set() only handles up to 4 components");
+        float *f = &arrays[Layout::template index<A>()][i*A::components];
+
+        for (int k=0;k<A::components;k++)
+            f[k] = v[k];
+    }
+
+private:
+    vector<float> arrays[Layout::attributeCount];
+    size_t count;
+};
+
+/*
+ * Associates a vertex class with its VertexLayout. By default the vertex
+ * class names its layout as a nested type called Layout.
+ */
+template <class K>
+struct VertexTraits
+{
+    typedef typename K::Layout Layout;
+};
+
+/*
+ * Adapters between a list of vertex objects (anything implementing
+ * IVertexData, like VertexAttrib) and VertexArrays. Attributes are matched
+ * by name. Attributes that only one side has are left alone.
+ */
+template <class K,class Layout>
+void toVertexArrays(const vector<K>& vertices,VertexArrays<Layout>& arrays)
+{
+    arrays.resize(vertices.size());
+    if (vertices.empty())
+        return;
+
+    K first = vertices[0];
+    for (int a=0;a<Layout::attributeCount;a++)
+    {
+        if (!first.hasData(Layout::name(a)))
+            continue;
+
+        string name = Layout::name(a);
+        size_t c = (size_t)Layout::components(a);
+        float *f = arrays.data(a);
+        for (size_t i=0;i<vertices.size();i++,f+=c)
+        {
+            K v = vertices[i];
+            vector<float> values = v.getData(name);
+            std::copy(values.begin(),values.begin()+std::min(values.size(),c),f);
+        }
+    }
+}
+
+template <class K,class Layout>
+void fromVertexArrays(const VertexArrays<Layout>& arrays,vector<K>& vertices)
+{
+    vertices.assign(arrays.size(),K());
+    if (vertices.empty())
+        return;
+
+    for (int a=0;a<Layout::attributeCount;a++)
+    {
+        if (!vertices[0].hasData(Layout::name(a)))
+            continue;
+
+        string name = Layout::name(a);
+        size_t c = (size_t)Layout::components(a);
+        const float *f = arrays.data(a);
+        vector<float> values(c);
+        for (size_t i=0;i<vertices.size();i++,f+=c)
+        {
+            values.assign(f,f+c);
+            vertices[i].setData(name,values);
+        }
+    }
+}
+}
+
+#endif